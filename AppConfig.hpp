@@ -0,0 +1,208 @@
+#pragma once
+
+#include <cstdint>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+
+constexpr uint32_t WIDTH = 800;
+constexpr uint32_t HEIGHT = 600;
+
+//Swapchain present mode, falls back towards fifo (the only mode every driver has) when the surface lacks it
+enum class PresentPolicy {
+	Fifo,		//vsync, lowest power, a full queue of latency
+	FifoRelaxed,	//vsync, but tears instead of waiting a whole refresh when a frame is late
+	Mailbox,	//no tearing, newest frame replaces the queued one, burns gpu on frames that are never shown
+	Immediate	//lowest latency, tears
+};
+
+static const char* presentPolicyName(PresentPolicy policy) {
+	switch (policy) {
+		case PresentPolicy::Fifo:		return "fifo";
+		case PresentPolicy::FifoRelaxed:	return "fifo-relaxed";
+		case PresentPolicy::Mailbox:		return "mailbox";
+		case PresentPolicy::Immediate:		return "immediate";
+	}
+	return "unknown";
+}
+
+static PresentPolicy parsePresentPolicy(const std::string& value) {
+	for (PresentPolicy policy : { PresentPolicy::Fifo, PresentPolicy::FifoRelaxed, PresentPolicy::Mailbox, PresentPolicy::Immediate }) {
+		if (value == presentPolicyName(policy)) {
+			return policy;
+		}
+	}
+	throw std::runtime_error("invalid value for --present-mode: " + value);
+}
+
+//Everything that can be changed from the command line lives here so main and the benchmark share one parser
+struct AppConfig {
+	bool headless = false;		//render into offscreen images with no window, surface or swapchain
+	uint32_t width = WIDTH;
+	uint32_t height = HEIGHT;
+	uint32_t benchmarkFrames = 0;	//number of timed frames, only used by the benchmark target
+	uint32_t warmupFrames = 0;	//frames rendered before timing starts so pipeline/driver warmup is not counted
+	bool profile = false;		//gpu timestamp/pipeline statistics scopes around command recording
+	std::string tracePath;		//if set, dump profiler scopes as chrome trace json here on shutdown
+	std::string pipelineCachePath = "pipeline_cache.bin";	//empty disables loading/saving the cache
+	uint32_t instanceCount = 1;	//instances of the mesh drawn with a single drawIndexed
+	uint32_t materialCount = 1;	//entries in the bindless material table, instances use them round robin
+	bool sweepInstances = false;	//benchmark: time 1, 10, ... 1M instances instead of a single run
+	bool gpuCulling = false;	//compute frustum culling feeding one instanced drawIndexedIndirect
+	uint32_t drawCalls = 1;		//split the instances over this many drawIndexed calls
+	uint32_t recordThreads = 1;	//>1 records secondary command buffers in parallel, 0 = one per core
+	std::string device;		//force a gpu by enumeration index or (case insensitive) name substring
+	PresentPolicy presentMode = PresentPolicy::Mailbox;
+	std::string shaderDir = "../shaders";	//where the .spv files are loaded from (and watched with --hot-reload)
+	std::string assetArchive;	//packed .pak (see assetpack) searched before the loose files in shaderDir
+	std::string texturePath;	//binary ppm streamed in the background and sampled once resident
+	bool hotReload = false;		//recompile/rebuild the graphics pipeline when shader.slang or slang.spv change
+	uint32_t targetFps = 0;		//cap the frame rate, 0 = as fast as the present mode allows
+	bool lowLatency = false;	//start each frame just in time for its present instead of queueing frames up
+	uint32_t spinDegrees = 0;	//instances rotate this many degrees per second, every other draw call the other way
+	uint32_t msaaSamples = 4;	//color/depth samples per pixel, lowered to what the device supports, 1 turns msaa off
+	std::string capturePath;	//if set, every rendered frame is read back and written into this directory
+	bool captureRaw = false;	//write captured frames as raw rgba instead of png
+	bool animateScene = false;	//keep the instances in a SceneStore and update its hierarchy every frame
+	uint32_t dynamicResolutionFps = 0;	//scale the render resolution to keep gpu time within 1/fps, 0 = off
+	uint32_t minResolutionPercent = 50;	//lowest scale dynamic resolution may go to, per axis
+};
+
+static void printUsage(const char* program) {
+	std::cout << "Usage: " << program << " [options]\n"
+		  << "  --headless                Render offscreen with no window (works on software ICDs like lavapipe)\n"
+		  << "  --windowed                Render to a GLFW window\n"
+		  << "  --width <px>              Render width\n"
+		  << "  --height <px>             Render height\n"
+		  << "  --frames <n>              Frames to time (benchmark)\n"
+		  << "  --warmup <n>              Untimed frames before measuring (benchmark)\n"
+		  << "  --profile                 Print rolling gpu/cpu timings per recorded scope\n"
+		  << "  --trace <file>            Also write a chrome://tracing json of every scope (implies --profile)\n"
+		  << "  --pipeline-cache <file>   Where the pipeline cache is loaded from and saved to\n"
+		  << "  --no-pipeline-cache       Always build pipelines cold\n"
+		  << "  --instances <n>           Number of instances drawn in one instanced draw\n"
+		  << "  --materials <n>           Number of bindless materials the instances cycle through\n"
+		  << "  --sweep-instances         Benchmark 1 to 1M instances and report draw throughput (benchmark)\n"
+		  << "  --gpu-culling             Cull instances in a compute pass and draw them indirectly\n"
+		  << "  --draw-calls <n>          Split the instances over n draw calls\n"
+		  << "  --record-threads <n>      Record draws on n threads with secondary command buffers (0 = all cores)\n"
+		  << "  --device <index|name>     Use this gpu instead of the highest scoring one\n"
+		  << "  --present-mode <mode>     fifo, fifo-relaxed, mailbox (default) or immediate\n"
+		  << "  --shader-dir <dir>        Directory the compiled shaders are loaded from\n"
+		  << "  --assets <file.pak>       Load shaders from a packed archive before falling back to --shader-dir\n"
+		  << "  --texture <file.ppm>      Stream this texture in on the transfer queue (P6 ppm)\n"
+		  << "  --hot-reload              Rebuild the graphics pipeline in the background when its shader changes\n"
+		  << "  --target-fps <n>          Cap the frame rate (0 = no cap)\n"
+		  << "  --low-latency             Pace frames to start just in time for their present, minimizes input latency\n"
+		  << "  --spin <degrees/s>        Rotate the instances over time (per draw push constant)\n"
+		  << "  --msaa <samples>          Multisample count (1, 2, 4, 8...), 1 disables msaa\n"
+		  << "  --capture <dir>           Read every frame back and write it to dir as png, frames are dropped, never waited for\n"
+		  << "  --capture-raw             Write captured frames as raw rgba instead of png\n"
+		  << "  --animate                 Update the instances as a transform hierarchy on all cores every frame\n"
+		  << "  --dynamic-resolution <fps> Lower the render resolution when the gpu can't keep this frame rate, upscale to the window\n"
+		  << "  --min-resolution <percent> Lowest render scale per axis for --dynamic-resolution (default 50)\n"
+		  << "  -h, --help                Show this help message\n";
+}
+
+static uint32_t parseUint(const std::string& arg, const std::string& value) {
+	try {
+		size_t used = 0;
+		unsigned long parsed = std::stoul(value, &used);
+		if (used != value.size()) {
+			throw std::invalid_argument(value);
+		}
+		return static_cast<uint32_t>(parsed);
+	} catch (const std::logic_error&) {
+		throw std::runtime_error("invalid value for " + arg + ": " + value);
+	}
+}
+
+//returns false if the program should exit (help was printed)
+static bool parseArgs(int argc, char** argv, AppConfig& config) {
+	for (int i = 1; i < argc; i++) {
+		std::string arg = argv[i];
+		auto nextValue = [&]() -> std::string {
+			if (i + 1 >= argc) {
+				throw std::runtime_error("missing value for " + arg);
+			}
+			return argv[++i];
+		};
+
+		if (arg == "-h" || arg == "--help") {
+			printUsage(argv[0]);
+			return false;
+		} else if (arg == "--headless") {
+			config.headless = true;
+		} else if (arg == "--windowed") {
+			config.headless = false;
+		} else if (arg == "--width") {
+			config.width = parseUint(arg, nextValue());
+		} else if (arg == "--height") {
+			config.height = parseUint(arg, nextValue());
+		} else if (arg == "--frames") {
+			config.benchmarkFrames = parseUint(arg, nextValue());
+		} else if (arg == "--warmup") {
+			config.warmupFrames = parseUint(arg, nextValue());
+		} else if (arg == "--profile") {
+			config.profile = true;
+		} else if (arg == "--trace") {
+			config.tracePath = nextValue();
+			config.profile = true;
+		} else if (arg == "--pipeline-cache") {
+			config.pipelineCachePath = nextValue();
+		} else if (arg == "--no-pipeline-cache") {
+			config.pipelineCachePath.clear();
+		} else if (arg == "--instances") {
+			config.instanceCount = parseUint(arg, nextValue());
+		} else if (arg == "--materials") {
+			config.materialCount = parseUint(arg, nextValue());
+		} else if (arg == "--sweep-instances") {
+			config.sweepInstances = true;
+		} else if (arg == "--gpu-culling") {
+			config.gpuCulling = true;
+		} else if (arg == "--draw-calls") {
+			config.drawCalls = parseUint(arg, nextValue());
+		} else if (arg == "--record-threads") {
+			config.recordThreads = parseUint(arg, nextValue());
+		} else if (arg == "--device") {
+			config.device = nextValue();
+		} else if (arg == "--present-mode") {
+			config.presentMode = parsePresentPolicy(nextValue());
+		} else if (arg == "--shader-dir") {
+			config.shaderDir = nextValue();
+		} else if (arg == "--assets") {
+			config.assetArchive = nextValue();
+		} else if (arg == "--texture") {
+			config.texturePath = nextValue();
+		} else if (arg == "--hot-reload") {
+			config.hotReload = true;
+		} else if (arg == "--target-fps") {
+			config.targetFps = parseUint(arg, nextValue());
+		} else if (arg == "--low-latency") {
+			config.lowLatency = true;
+		} else if (arg == "--spin") {
+			config.spinDegrees = parseUint(arg, nextValue());
+		} else if (arg == "--msaa") {
+			config.msaaSamples = parseUint(arg, nextValue());
+			if (config.msaaSamples == 0 || (config.msaaSamples & (config.msaaSamples - 1)) != 0) {
+				throw std::runtime_error("--msaa has to be a power of two");
+			}
+		} else if (arg == "--capture") {
+			config.capturePath = nextValue();
+		} else if (arg == "--capture-raw") {
+			config.captureRaw = true;
+		} else if (arg == "--animate") {
+			config.animateScene = true;
+		} else if (arg == "--dynamic-resolution") {
+			config.dynamicResolutionFps = parseUint(arg, nextValue());
+		} else if (arg == "--min-resolution") {
+			config.minResolutionPercent = parseUint(arg, nextValue());
+			if (config.minResolutionPercent == 0 || config.minResolutionPercent > 100) {
+				throw std::runtime_error("--min-resolution has to be between 1 and 100");
+			}
+		} else {
+			throw std::runtime_error("unknown argument: " + arg);
+		}
+	}
+	return true;
+}
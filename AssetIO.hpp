@@ -0,0 +1,261 @@
+#pragma once
+
+#include <algorithm>
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <memory>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#ifdef _WIN32
+#include <filesystem>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+//Read-only view of a whole file. On posix it is an mmap, so the bytes come straight out of the page cache with
+//no heap copy and the data pointer is page aligned. Elsewhere it falls back to one read into a uint32_t backed
+//buffer so the alignment guarantee (enough for spir-v words and vertex data) still holds.
+//Files have to be replaced by rename rather than rewritten in place while they are mapped.
+class MappedFile {
+public:
+	explicit MappedFile(const std::string& path) {
+#ifdef _WIN32
+		std::ifstream file(path, std::ios::ate | std::ios::binary);
+		if (!file.is_open()) {
+			throw std::runtime_error("failed to open " + path);
+		}
+		length = static_cast<size_t>(file.tellg());
+		fallback.resize((length + sizeof(uint32_t) - 1) / sizeof(uint32_t));
+		file.seekg(0);
+		file.read(reinterpret_cast<char*>(fallback.data()), static_cast<std::streamsize>(length));
+		base = reinterpret_cast<const std::byte*>(fallback.data());
+#else
+		int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+		if (fd < 0) {
+			throw std::runtime_error("failed to open " + path);
+		}
+		struct stat info{};
+		if (fstat(fd, &info) != 0) {
+			close(fd);
+			throw std::runtime_error("failed to stat " + path);
+		}
+		length = static_cast<size_t>(info.st_size);
+		if (length > 0) {
+			void* mapping = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+			if (mapping == MAP_FAILED) {
+				close(fd);
+				throw std::runtime_error("failed to map " + path);
+			}
+			base = static_cast<const std::byte*>(mapping);
+			//assets are read front to back once, let the kernel read ahead aggressively
+			madvise(mapping, length, MADV_SEQUENTIAL);
+			madvise(mapping, length, MADV_WILLNEED);
+		}
+		//the mapping keeps the file alive on its own
+		close(fd);
+#endif
+	}
+
+	~MappedFile() {
+#ifndef _WIN32
+		if (base) {
+			munmap(const_cast<std::byte*>(base), length);
+		}
+#endif
+	}
+
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator=(const MappedFile&) = delete;
+
+	[[nodiscard]] std::span<const std::byte> bytes() const { return { base, length }; }
+	[[nodiscard]] size_t size() const { return length; }
+
+private:
+	const std::byte* base = nullptr;
+	size_t length = 0;
+#ifdef _WIN32
+	std::vector<uint32_t> fallback;
+#endif
+};
+
+//Spir-v is consumed as 32 bit words, this checks the span really can be used as one without a copy
+inline std::span<const uint32_t> spirvWords(std::span<const std::byte> bytes) {
+	if (bytes.size() % sizeof(uint32_t) != 0 || reinterpret_cast<uintptr_t>(bytes.data()) % alignof(uint32_t) != 0) {
+		throw std::runtime_error("spir-v blob is not a whole number of aligned 32 bit words");
+	}
+	return { reinterpret_cast<const uint32_t*>(bytes.data()), bytes.size() / sizeof(uint32_t) };
+}
+
+//Packed asset archive (.pak), many assets in one file behind a sorted name index:
+//
+//	PackHeader
+//	PackEntry[entryCount]		sorted by name
+//	name bytes			entries point into this with nameOffset/nameLength
+//	asset data			each asset starts on a DATA_ALIGNMENT boundary
+//
+//All offsets are from the start of the file, everything is little endian.
+struct PackHeader {
+	char magic[4];			//"HTPK"
+	uint32_t version;
+	uint32_t entryCount;
+	uint32_t reserved;
+};
+
+struct PackEntry {
+	uint64_t offset;
+	uint64_t size;
+	uint32_t nameOffset;
+	uint32_t nameLength;
+};
+
+class AssetArchive {
+public:
+	static constexpr uint32_t VERSION = 1;
+	static constexpr uint64_t DATA_ALIGNMENT = 16;
+
+	explicit AssetArchive(const std::string& path) : file(std::make_shared<MappedFile>(path)) {
+		auto bytes = file->bytes();
+		if (bytes.size() < sizeof(PackHeader)) {
+			throw std::runtime_error(path + " is too small to be an asset archive");
+		}
+		PackHeader header{};
+		std::memcpy(&header, bytes.data(), sizeof(header));
+		if (std::memcmp(header.magic, "HTPK", 4) != 0 || header.version != VERSION) {
+			throw std::runtime_error(path + " is not a version " + std::to_string(VERSION) + " asset archive");
+		}
+
+		uint64_t indexEnd = sizeof(PackHeader) + uint64_t(header.entryCount) * sizeof(PackEntry);
+		if (indexEnd > bytes.size()) {
+			throw std::runtime_error(path + " has a truncated index");
+		}
+		entries.resize(header.entryCount);
+		std::memcpy(entries.data(), bytes.data() + sizeof(PackHeader), entries.size() * sizeof(PackEntry));
+		//validate once here so lookups never have to
+		for (const PackEntry& entry : entries) {
+			if (entry.nameOffset + uint64_t(entry.nameLength) > bytes.size() || entry.offset > bytes.size() ||
+			    entry.size > bytes.size() - entry.offset || entry.offset % DATA_ALIGNMENT != 0) {
+				throw std::runtime_error(path + " has an entry pointing outside the file");
+			}
+		}
+	}
+
+	//empty if the archive has no asset with that name
+	[[nodiscard]] std::span<const std::byte> find(std::string_view name) const {
+		auto it = std::ranges::lower_bound(entries, name, {}, [this](const PackEntry& entry) { return nameOf(entry); });
+		if (it == entries.end() || nameOf(*it) != name) {
+			return {};
+		}
+		return file->bytes().subspan(it->offset, it->size);
+	}
+
+	[[nodiscard]] bool contains(std::string_view name) const { return find(name).data() != nullptr; }
+	[[nodiscard]] size_t assetCount() const { return entries.size(); }
+	[[nodiscard]] const std::shared_ptr<MappedFile>& mapping() const { return file; }
+
+	//Packs (name, source path) pairs into an archive at outputPath, names must be unique
+	static void write(const std::string& outputPath, std::vector<std::pair<std::string, std::string>> assets) {
+		std::ranges::sort(assets);
+		if (std::ranges::adjacent_find(assets, {}, [](const auto& asset) { return asset.first; }) != assets.end()) {
+			throw std::runtime_error("duplicate asset name in archive");
+		}
+
+		std::vector<PackEntry> index(assets.size());
+		std::string names;
+		for (const auto& asset : assets) {
+			names += asset.first;
+		}
+		//names sit right after the index, data starts after the names
+		uint64_t nameCursor = sizeof(PackHeader) + index.size() * sizeof(PackEntry);
+		uint64_t cursor = nameCursor + names.size();
+		for (size_t i = 0; i < assets.size(); i++) {
+			MappedFile source(assets[i].second);
+			cursor = (cursor + DATA_ALIGNMENT - 1) / DATA_ALIGNMENT * DATA_ALIGNMENT;
+			index[i].offset = cursor;
+			index[i].size = source.size();
+			index[i].nameOffset = static_cast<uint32_t>(nameCursor);
+			index[i].nameLength = static_cast<uint32_t>(assets[i].first.size());
+			nameCursor += index[i].nameLength;
+			cursor += source.size();
+		}
+
+		std::string tempPath = outputPath + ".tmp";
+		{
+			std::ofstream out(tempPath, std::ios::binary | std::ios::trunc);
+			if (!out.is_open()) {
+				throw std::runtime_error("failed to create " + tempPath);
+			}
+			PackHeader header{ { 'H', 'T', 'P', 'K' }, VERSION, static_cast<uint32_t>(index.size()), 0 };
+			out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+			out.write(reinterpret_cast<const char*>(index.data()), static_cast<std::streamsize>(index.size() * sizeof(PackEntry)));
+			out.write(names.data(), static_cast<std::streamsize>(names.size()));
+			for (size_t i = 0; i < assets.size(); i++) {
+				MappedFile source(assets[i].second);
+				static const char padding[DATA_ALIGNMENT] = {};
+				out.write(padding, static_cast<std::streamsize>(index[i].offset - static_cast<uint64_t>(out.tellp())));
+				auto bytes = source.bytes();
+				out.write(reinterpret_cast<const char*>(bytes.data()), static_cast<std::streamsize>(bytes.size()));
+			}
+			if (!out) {
+				throw std::runtime_error("failed to write " + tempPath);
+			}
+		}
+		if (std::rename(tempPath.c_str(), outputPath.c_str()) != 0) {
+			std::string reason = std::strerror(errno);
+			std::remove(tempPath.c_str());
+			throw std::runtime_error("failed to replace " + outputPath + ": " + reason);
+		}
+	}
+
+private:
+	std::shared_ptr<MappedFile> file;
+	std::vector<PackEntry> entries;
+
+	[[nodiscard]] std::string_view nameOf(const PackEntry& entry) const {
+		return { reinterpret_cast<const char*>(file->bytes().data()) + entry.nameOffset, entry.nameLength };
+	}
+};
+
+//A loaded asset, the span stays valid for as long as this (or a copy) is alive
+struct Asset {
+	std::shared_ptr<MappedFile> file;
+	std::span<const std::byte> bytes;
+};
+
+//Resolves asset names against an optional archive first and then loose files in a directory
+class AssetLoader {
+public:
+	AssetLoader(std::string directory, const std::string& archivePath) : directory(std::move(directory)) {
+		if (!archivePath.empty()) {
+			archive = std::make_unique<AssetArchive>(archivePath);
+		}
+	}
+
+	[[nodiscard]] Asset load(const std::string& name) const {
+		if (archive) {
+			auto bytes = archive->find(name);
+			if (bytes.data()) {
+				return { archive->mapping(), bytes };
+			}
+		}
+		auto file = std::make_shared<MappedFile>(directory + "/" + name);
+		return { file, file->bytes() };
+	}
+
+	[[nodiscard]] const std::string& looseDirectory() const { return directory; }
+
+private:
+	std::string directory;
+	std::unique_ptr<AssetArchive> archive;
+};
@@ -0,0 +1,82 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iomanip>
+#include <ostream>
+#include <string>
+#include <utility>
+#include <vector>
+
+//Raw per-frame samples collected by HelloTriangleApplication::runBenchmark()
+struct FrameTimings {
+	std::vector<double> frameMs;	//wall time from the start of one drawFrame() to the next
+	std::vector<double> recordMs;	//cpu time spent inside recordCommandBuffer()
+	std::vector<double> latencyMs;	//frame start (input poll) to present, or to gpu completion without present wait
+	double totalSeconds = 0.0;	//wall time for all timed frames including the final waitIdle
+
+	//nearest-rank percentile, p in [0, 1]
+	static double percentile(std::vector<double> samples, double p) {
+		if (samples.empty()) {
+			return 0.0;
+		}
+		std::sort(samples.begin(), samples.end());
+		auto rank = static_cast<size_t>(std::ceil(p * static_cast<double>(samples.size())));
+		return samples[std::clamp<size_t>(rank, 1, samples.size()) - 1];
+	}
+
+	[[nodiscard]] double framesPerSecond() const {
+		return totalSeconds > 0.0 ? static_cast<double>(frameMs.size()) / totalSeconds : 0.0;
+	}
+
+	//one line per run so CI logs can be grepped/diffed
+	void report(std::ostream& out, const std::string& label) const {
+		out << std::fixed << std::setprecision(3)
+		    << "[" << label << "]"
+		    << " frames=" << frameMs.size()
+		    << " fps=" << framesPerSecond()
+		    << " frame_p50_ms=" << percentile(frameMs, 0.50)
+		    << " frame_p99_ms=" << percentile(frameMs, 0.99)
+		    << " record_p50_ms=" << percentile(recordMs, 0.50)
+		    << " record_p99_ms=" << percentile(recordMs, 0.99)
+		    << " latency_p50_ms=" << percentile(latencyMs, 0.50)
+		    << " latency_p99_ms=" << percentile(latencyMs, 0.99)
+		    << "\n";
+	}
+
+	//draw throughput for instanced runs, the point where record time stops mattering is where
+	//instances/sec keeps climbing while fps falls
+	void reportThroughput(std::ostream& out, uint64_t instances, uint64_t trianglesPerInstance) const {
+		double fps = framesPerSecond();
+		out << std::fixed << std::setprecision(3)
+		    << "[sweep] instances=" << instances
+		    << " fps=" << fps
+		    << " frame_p50_ms=" << percentile(frameMs, 0.50)
+		    << " frame_p99_ms=" << percentile(frameMs, 0.99)
+		    << " record_p50_ms=" << percentile(recordMs, 0.50)
+		    << std::setprecision(0)
+		    << " instances_per_sec=" << fps * static_cast<double>(instances)
+		    << " triangles_per_sec=" << fps * static_cast<double>(instances * trianglesPerInstance)
+		    << "\n";
+	}
+};
+
+//Wall-clock marks from process start up to the first presented frame, to compare warm/cold pipeline cache runs
+struct StartupTimings {
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	std::vector<std::pair<std::string, double>> marks;	//name, ms since start
+	double pipelineMs = 0.0;				//just the vkCreateGraphicsPipelines call(s)
+
+	void mark(const std::string& name) {
+		marks.emplace_back(name, std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+	}
+
+	void report(std::ostream& out, const std::string& cacheStatus) const {
+		out << std::fixed << std::setprecision(3) << "[startup] cache=\"" << cacheStatus << "\"";
+		for (const auto& [name, ms] : marks) {
+			out << " " << name << "_ms=" << ms;
+		}
+		out << " pipeline_create_ms=" << pipelineMs << "\n";
+	}
+};
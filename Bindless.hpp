@@ -0,0 +1,198 @@
+#pragma once
+
+#include <vulkan/vulkan_raii.hpp>
+#include <glm/glm.hpp>
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <stdexcept>
+#include <vector>
+
+#include "GpuAllocator.hpp"
+
+//Matches Material in shaders/shader.slang (StructuredBuffer, std430)
+struct MaterialData {
+	glm::vec4 baseColor;		//multiplied with the sampled albedo
+	uint32_t albedoTexture;		//index into the bindless texture array
+	uint32_t padding[3];
+};
+static_assert(sizeof(MaterialData) == 32, "MaterialData has to match the std430 layout in shader.slang");
+
+//One descriptor set for every draw: binding 0 is the material table (storage buffer), binding 1 a runtime sized array
+//of combined image samplers. Instances carry a material id, the fragment shader looks the material up and indexes the
+//texture array with it, so adding a texture or material never allocates a set or changes what a draw binds.
+//
+//The texture binding is update-after-bind, partially bound and update-unused-while-pending: addTexture() writes a slot
+//no in-flight frame can be reading, while the set stays bound. Materials live in a device local buffer that is
+//rewritten with updateBuffer from the frame's own command buffer (recordUpdates()), so the barrier in front of it
+//orders the write after every earlier frame's reads and nothing has to be double buffered.
+class BindlessTable {
+public:
+	static constexpr uint32_t BINDING_MATERIALS = 0;
+	static constexpr uint32_t BINDING_TEXTURES = 1;
+
+	//textureCapacity has to be within the device's update-after-bind sampler/sampled image limits
+	BindlessTable(const vk::raii::Device& device, GpuAllocator& allocator, vk::Sampler sampler, uint32_t textureCapacity,
+			uint32_t materialCapacity)
+		: device(device), sampler(sampler), textureCapacity(textureCapacity), materialCapacity(std::max(materialCapacity, 1u))
+	{
+		std::array<vk::DescriptorSetLayoutBinding, 2> bindings = {
+			vk::DescriptorSetLayoutBinding{
+				.binding = BINDING_MATERIALS,
+				.descriptorType = vk::DescriptorType::eStorageBuffer,
+				.descriptorCount = 1,
+				.stageFlags = vk::ShaderStageFlagBits::eFragment },
+			vk::DescriptorSetLayoutBinding{
+				.binding = BINDING_TEXTURES,
+				.descriptorType = vk::DescriptorType::eCombinedImageSampler,
+				.descriptorCount = textureCapacity,
+				.stageFlags = vk::ShaderStageFlagBits::eFragment } };
+		//variable count has to be on the last binding
+		std::array<vk::DescriptorBindingFlags, 2> bindingFlags = {
+			vk::DescriptorBindingFlags{},
+			vk::DescriptorBindingFlagBits::eUpdateAfterBind | vk::DescriptorBindingFlagBits::eUpdateUnusedWhilePending |
+			vk::DescriptorBindingFlagBits::ePartiallyBound | vk::DescriptorBindingFlagBits::eVariableDescriptorCount };
+		vk::DescriptorSetLayoutBindingFlagsCreateInfo flagsInfo{
+			.bindingCount = static_cast<uint32_t>(bindingFlags.size()),
+			.pBindingFlags = bindingFlags.data() };
+		descriptorSetLayout = vk::raii::DescriptorSetLayout(device, vk::DescriptorSetLayoutCreateInfo{
+			.pNext = &flagsInfo,
+			.flags = vk::DescriptorSetLayoutCreateFlagBits::eUpdateAfterBindPool,
+			.bindingCount = static_cast<uint32_t>(bindings.size()),
+			.pBindings = bindings.data() });
+
+		std::array<vk::DescriptorPoolSize, 2> poolSizes = {
+			vk::DescriptorPoolSize{ .type = vk::DescriptorType::eStorageBuffer, .descriptorCount = 1 },
+			vk::DescriptorPoolSize{ .type = vk::DescriptorType::eCombinedImageSampler, .descriptorCount = textureCapacity } };
+		descriptorPool = vk::raii::DescriptorPool(device, vk::DescriptorPoolCreateInfo{
+			.flags = vk::DescriptorPoolCreateFlagBits::eFreeDescriptorSet | vk::DescriptorPoolCreateFlagBits::eUpdateAfterBind,
+			.maxSets = 1,
+			.poolSizeCount = static_cast<uint32_t>(poolSizes.size()),
+			.pPoolSizes = poolSizes.data() });
+
+		vk::DescriptorSetVariableDescriptorCountAllocateInfo variableCount{
+			.descriptorSetCount = 1,
+			.pDescriptorCounts = &this->textureCapacity };
+		descriptorSet = std::move(vk::raii::DescriptorSets(device, vk::DescriptorSetAllocateInfo{
+			.pNext = &variableCount,
+			.descriptorPool = descriptorPool,
+			.descriptorSetCount = 1,
+			.pSetLayouts = &*descriptorSetLayout }).front());
+
+		materialBuffer = GpuBuffer(allocator, device, sizeof(MaterialData) * this->materialCapacity,
+			vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eTransferDst,
+			vk::MemoryPropertyFlagBits::eDeviceLocal);
+		materials.reserve(this->materialCapacity);
+		vk::DescriptorBufferInfo bufferInfo{ .buffer = materialBuffer.handle(), .offset = 0, .range = vk::WholeSize };
+		device.updateDescriptorSets(vk::WriteDescriptorSet{
+			.dstSet = descriptorSet,
+			.dstBinding = BINDING_MATERIALS,
+			.descriptorCount = 1,
+			.descriptorType = vk::DescriptorType::eStorageBuffer,
+			.pBufferInfo = &bufferInfo }, {});
+	}
+
+	BindlessTable(const BindlessTable&) = delete;
+	BindlessTable& operator=(const BindlessTable&) = delete;
+
+	//Index the shader uses for this view. The view (in shader read only layout) has to outlive every frame that samples it.
+	uint32_t addTexture(vk::ImageView view) {
+		if (texturesUsed == textureCapacity) {
+			throw std::runtime_error("bindless texture table is full");
+		}
+		vk::DescriptorImageInfo imageInfo{
+			.sampler = sampler,
+			.imageView = view,
+			.imageLayout = vk::ImageLayout::eShaderReadOnlyOptimal };
+		device.updateDescriptorSets(vk::WriteDescriptorSet{
+			.dstSet = descriptorSet,
+			.dstBinding = BINDING_TEXTURES,
+			.dstArrayElement = texturesUsed,
+			.descriptorCount = 1,
+			.descriptorType = vk::DescriptorType::eCombinedImageSampler,
+			.pImageInfo = &imageInfo }, {});
+		return texturesUsed++;
+	}
+
+	uint32_t addMaterial(const MaterialData& material) {
+		if (materials.size() == materialCapacity) {
+			throw std::runtime_error("bindless material table is full");
+		}
+		materials.push_back(material);
+		markDirty(static_cast<uint32_t>(materials.size() - 1));
+		return static_cast<uint32_t>(materials.size() - 1);
+	}
+
+	//only reaches the gpu with the next recordUpdates()
+	void setMaterial(uint32_t id, const MaterialData& material) {
+		materials.at(id) = material;
+		markDirty(id);
+	}
+
+	[[nodiscard]] const MaterialData& material(uint32_t id) const { return materials.at(id); }
+	[[nodiscard]] uint32_t materialCount() const { return static_cast<uint32_t>(materials.size()); }
+	[[nodiscard]] uint32_t textureCount() const { return texturesUsed; }
+
+	//Uploads materials changed since the last call, outside of any rendering block and before anything in this
+	//command buffer reads them. Only the dirty range is written.
+	void recordUpdates(const vk::raii::CommandBuffer& commandBuffer) {
+		if (dirtyBegin >= dirtyEnd) {
+			return;
+		}
+		//earlier frames may still be reading the table, on this queue the barrier covers them too
+		memoryBarrier(commandBuffer,
+			vk::PipelineStageFlagBits2::eFragmentShader, vk::AccessFlagBits2::eShaderStorageRead,
+			vk::PipelineStageFlagBits2::eAllTransfer, vk::AccessFlagBits2::eTransferWrite);
+		//updateBuffer is limited to 64KiB per call
+		constexpr uint32_t MATERIALS_PER_UPDATE = 65536 / sizeof(MaterialData);
+		for (uint32_t first = dirtyBegin; first < dirtyEnd; first += MATERIALS_PER_UPDATE) {
+			uint32_t count = std::min(MATERIALS_PER_UPDATE, dirtyEnd - first);
+			commandBuffer.updateBuffer<MaterialData>(materialBuffer.handle(), sizeof(MaterialData) * first,
+				vk::ArrayProxy<const MaterialData>(count, materials.data() + first));
+		}
+		memoryBarrier(commandBuffer,
+			vk::PipelineStageFlagBits2::eAllTransfer, vk::AccessFlagBits2::eTransferWrite,
+			vk::PipelineStageFlagBits2::eFragmentShader, vk::AccessFlagBits2::eShaderStorageRead);
+		dirtyBegin = UINT32_MAX;
+		dirtyEnd = 0;
+	}
+
+	void bind(const vk::raii::CommandBuffer& commandBuffer, vk::PipelineLayout pipelineLayout, uint32_t set) const {
+		commandBuffer.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, pipelineLayout, set, *descriptorSet, {});
+	}
+
+	[[nodiscard]] vk::DescriptorSetLayout layout() const { return *descriptorSetLayout; }
+
+private:
+	const vk::raii::Device& device;
+	vk::Sampler sampler;
+	uint32_t textureCapacity;
+	uint32_t texturesUsed = 0;
+	uint32_t materialCapacity;
+
+	vk::raii::DescriptorSetLayout descriptorSetLayout = nullptr;
+	vk::raii::DescriptorPool descriptorPool = nullptr;
+	vk::raii::DescriptorSet descriptorSet = nullptr;
+
+	GpuBuffer materialBuffer;
+	std::vector<MaterialData> materials;	//cpu copy, the buffer is only ever written from this
+	uint32_t dirtyBegin = UINT32_MAX;
+	uint32_t dirtyEnd = 0;
+
+	void markDirty(uint32_t id) {
+		dirtyBegin = std::min(dirtyBegin, id);
+		dirtyEnd = std::max(dirtyEnd, id + 1);
+	}
+
+	static void memoryBarrier(const vk::raii::CommandBuffer& commandBuffer,
+			vk::PipelineStageFlags2 srcStage, vk::AccessFlags2 srcAccess,
+			vk::PipelineStageFlags2 dstStage, vk::AccessFlags2 dstAccess)
+	{
+		vk::MemoryBarrier2 barrier{
+			.srcStageMask = srcStage,
+			.srcAccessMask = srcAccess,
+			.dstStageMask = dstStage,
+			.dstAccessMask = dstAccess };
+		commandBuffer.pipelineBarrier2(vk::DependencyInfo{ .memoryBarrierCount = 1, .pMemoryBarriers = &barrier });
+	}
+};
@@ -0,0 +1,126 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <span>
+#include <stdexcept>
+#include <string>
+
+//Cooked mesh (.mesh), written by assetcook and read straight out of a mapping with no parsing or copies:
+//
+//	CookedMeshHeader
+//	CookedVertex[vertexCount]			quantized, in first use order
+//	uint16_t or uint32_t[indexCount]		indexSize bytes each, vertex cache and overdraw optimized
+//	Meshlet[meshletCount]
+//	uint32_t[meshletVertexCount]			mesh vertex index of every meshlet vertex
+//	uint8_t[meshletTriangleCount * 3]		meshlet local vertex indices, three per triangle
+//
+//Every section starts on a SECTION_ALIGNMENT boundary, offsets are from the start of the file, little endian.
+struct CookedMeshHeader {
+	char magic[4];			//"HTMS"
+	uint32_t version;
+	uint32_t vertexCount;
+	uint32_t indexCount;
+	uint32_t indexSize;		//2 or 4
+	uint32_t meshletCount;
+	uint32_t meshletVertexCount;
+	uint32_t meshletTriangleCount;
+	float positionOffset[3];	//position = positionOffset + snorm * positionScale
+	float positionScale[3];
+	uint64_t vertexOffset;
+	uint64_t indexOffset;
+	uint64_t meshletOffset;
+	uint64_t meshletVertexOffset;
+	uint64_t meshletTriangleOffset;
+};
+
+//16 bytes instead of the 32 of float position/normal/uv
+struct CookedVertex {
+	int16_t position[4];		//R16G16B16A16_SNORM within the mesh bounds, w is always 1
+	int8_t normal[2];		//R8G8_SNORM octahedral encoding
+	uint16_t uv[2];			//R16G16_SFLOAT
+	uint16_t padding;
+};
+static_assert(sizeof(CookedVertex) == 16, "CookedVertex is read straight out of the file");
+
+//Up to MAX_VERTICES vertices and MAX_TRIANGLES triangles, with what a culling pass needs to reject it whole
+struct Meshlet {
+	static constexpr uint32_t MAX_VERTICES = 64;
+	static constexpr uint32_t MAX_TRIANGLES = 124;
+
+	uint32_t vertexOffset;		//first entry in the meshlet vertex list
+	uint32_t triangleOffset;	//first triangle in the meshlet triangle list
+	uint32_t vertexCount;
+	uint32_t triangleCount;
+	float center[3];		//bounding sphere, in mesh space
+	float radius;
+	int8_t coneAxis[3];		//snorm8 normal cone, every triangle faces away from a viewer when
+	int8_t coneCutoff;		//dot(normalize(coneApex - viewer), coneAxis / 127) >= coneCutoff / 127 (127 means never)
+	float coneApex[3];		//in mesh space, behind every triangle's plane
+};
+static_assert(sizeof(Meshlet) == 48, "Meshlet is read straight out of the file");
+
+//Read-only view of a cooked mesh, the spans point into the bytes it was made from (usually a MappedFile or an
+//asset archive entry, both keep the data at least 16 byte aligned)
+class CookedMesh {
+public:
+	static constexpr uint32_t VERSION = 2;
+	static constexpr uint64_t SECTION_ALIGNMENT = 16;
+
+	explicit CookedMesh(std::span<const std::byte> bytes) : bytes(bytes) {
+		if (bytes.size() < sizeof(CookedMeshHeader) || reinterpret_cast<uintptr_t>(bytes.data()) % SECTION_ALIGNMENT != 0) {
+			throw std::runtime_error("cooked mesh is too small or misaligned");
+		}
+		std::memcpy(&header, bytes.data(), sizeof(header));
+		if (std::memcmp(header.magic, "HTMS", 4) != 0 || header.version != VERSION) {
+			throw std::runtime_error("not a version " + std::to_string(VERSION) + " cooked mesh");
+		}
+		if (header.indexSize != 2 && header.indexSize != 4) {
+			throw std::runtime_error("cooked mesh has an invalid index size");
+		}
+		//validate once here so the accessors never have to
+		checkSection(header.vertexOffset, uint64_t(header.vertexCount) * sizeof(CookedVertex));
+		checkSection(header.indexOffset, uint64_t(header.indexCount) * header.indexSize);
+		checkSection(header.meshletOffset, uint64_t(header.meshletCount) * sizeof(Meshlet));
+		checkSection(header.meshletVertexOffset, uint64_t(header.meshletVertexCount) * sizeof(uint32_t));
+		checkSection(header.meshletTriangleOffset, uint64_t(header.meshletTriangleCount) * 3);
+	}
+
+	[[nodiscard]] const CookedMeshHeader& info() const { return header; }
+
+	[[nodiscard]] std::span<const CookedVertex> vertices() const { return section<CookedVertex>(header.vertexOffset, header.vertexCount); }
+	//raw index buffer contents, vk::IndexType::eUint16 or eUint32 depending on info().indexSize
+	[[nodiscard]] std::span<const std::byte> indexBytes() const {
+		return bytes.subspan(header.indexOffset, uint64_t(header.indexCount) * header.indexSize);
+	}
+	[[nodiscard]] std::span<const Meshlet> meshlets() const { return section<Meshlet>(header.meshletOffset, header.meshletCount); }
+	[[nodiscard]] std::span<const uint32_t> meshletVertices() const {
+		return section<uint32_t>(header.meshletVertexOffset, header.meshletVertexCount);
+	}
+	[[nodiscard]] std::span<const uint8_t> meshletTriangles() const {
+		return section<uint8_t>(header.meshletTriangleOffset, uint64_t(header.meshletTriangleCount) * 3);
+	}
+
+	[[nodiscard]] uint32_t index(uint32_t i) const {
+		if (header.indexSize == 2) {
+			return section<uint16_t>(header.indexOffset, header.indexCount)[i];
+		}
+		return section<uint32_t>(header.indexOffset, header.indexCount)[i];
+	}
+
+private:
+	std::span<const std::byte> bytes;
+	CookedMeshHeader header{};
+
+	void checkSection(uint64_t offset, uint64_t size) const {
+		if (offset % SECTION_ALIGNMENT != 0 || offset > bytes.size() || size > bytes.size() - offset) {
+			throw std::runtime_error("cooked mesh has a section outside the file");
+		}
+	}
+
+	template <typename T>
+	[[nodiscard]] std::span<const T> section(uint64_t offset, uint64_t count) const {
+		return { reinterpret_cast<const T*>(bytes.data() + offset), static_cast<size_t>(count) };
+	}
+};
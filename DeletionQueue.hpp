@@ -0,0 +1,56 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <ostream>
+#include <utility>
+
+//Holds on to resources the gpu may still be using until a timeline value says it is done with them.
+//retire() takes ownership of anything movable (raii handles, GpuBuffers, vectors of views...) together with the
+//last timeline value that used it, collect() destroys everything the gpu has passed. Entries are destroyed in
+//the order they were retired, so retire dependents (views, semaphores) before what they depend on.
+//
+//Not thread safe, it is owned and driven by the frame loop.
+class DeletionQueue {
+public:
+	DeletionQueue() = default;
+	DeletionQueue(const DeletionQueue&) = delete;
+	DeletionQueue& operator=(const DeletionQueue&) = delete;
+
+	template <typename T>
+	void retire(T&& resource, uint64_t lastUseValue) {
+		//shared_ptr<void> remembers the real deleter, which is all the type erasure this needs
+		entries.push_back(Entry{ lastUseValue, std::make_shared<std::decay_t<T>>(std::forward<T>(resource)) });
+		totalRetired++;
+		peakPending = std::max(peakPending, entries.size());
+	}
+
+	//Values are normally retired in increasing order, an out of order one just waits for the ones ahead of it
+	//which is late but never unsafe
+	void collect(uint64_t completedValue) {
+		while (!entries.empty() && entries.front().lastUseValue <= completedValue) {
+			entries.pop_front();
+		}
+	}
+
+	//only once the device is idle
+	void flush() { entries.clear(); }
+
+	[[nodiscard]] size_t pending() const { return entries.size(); }
+
+	void report(std::ostream& out) const {
+		out << "[deletion] retired=" << totalRetired << " pending=" << entries.size() << " peak_pending=" << peakPending << "\n";
+	}
+
+private:
+	struct Entry {
+		uint64_t lastUseValue;
+		std::shared_ptr<void> resource;
+	};
+	std::deque<Entry> entries;
+	uint64_t totalRetired = 0;
+	size_t peakPending = 0;
+};
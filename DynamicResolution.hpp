@@ -0,0 +1,173 @@
+#pragma once
+
+#include <vulkan/vulkan_raii.hpp>
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <iomanip>
+#include <ostream>
+#include <stdexcept>
+#include <vector>
+
+struct DynamicResolutionStats {
+	double budgetMs = 0.0;
+	uint64_t frames = 0;		//frames whose gpu time came back
+	uint64_t overBudget = 0;	//of those, frames that took longer than the budget
+	uint64_t changes = 0;		//times the render resolution changed
+	double scaleSum = 0.0;
+	float scaleMin = 1.0f;
+	float scaleMax = 0.0f;
+	double gpuMsSum = 0.0;
+
+	void report(std::ostream& out) const {
+		double count = frames > 0 ? static_cast<double>(frames) : 1.0;
+		out << std::fixed << std::setprecision(3)
+		    << "[dynres] budget_ms=" << budgetMs
+		    << " frames=" << frames
+		    << " scale_avg=" << scaleSum / count
+		    << " scale_min=" << (frames > 0 ? scaleMin : 0.0f)
+		    << " scale_max=" << scaleMax
+		    << " gpu_ms_avg=" << gpuMsSum / count
+		    << " over_budget=" << overBudget
+		    << " changes=" << changes << "\n";
+	}
+};
+
+//Picks the render resolution scale from measured gpu frame times. No vulkan in here, DynamicResolution feeds it.
+//
+//Gpu time is taken to grow with the pixel count, so every measurement is turned into what the frame would have
+//cost at full resolution and the scale that fits the budget is sqrt(budget / that). Costs that don't shrink with the
+//resolution (the upscale, compute passes) make low scales look more expensive per pixel than they are, which errs on
+//the side of staying under the budget.
+//The cost is smoothed, except that a frame over the budget is taken at face value so the scale drops right away.
+//Going back up is one STEP per frame so a single cheap frame can't cause a spike. Scales are multiples of STEP so
+//the resolution doesn't change on every bit of noise.
+class ResolutionController {
+public:
+	static constexpr float STEP = 1.0f / 32.0f;
+	static constexpr double HEADROOM = 0.9;		//aim this far under the budget, timings are noisy
+	static constexpr double RISE_SMOOTHING = 0.5;	//weight of a new sample that is more expensive than the average
+	static constexpr double FALL_SMOOTHING = 0.1;	//and of one that is cheaper
+
+	ResolutionController(double budgetMs, float minScale) : minScale(std::clamp(minScale, STEP, 1.0f)) {
+		stats.budgetMs = budgetMs;
+	}
+
+	[[nodiscard]] float scale() const { return current; }
+
+	//gpuMs is the time of a frame rendered at renderedScale, which is some frames behind scale() by now
+	void frameTime(double gpuMs, float renderedScale) {
+		stats.frames++;
+		stats.gpuMsSum += gpuMs;
+		stats.scaleSum += renderedScale;
+		stats.scaleMin = std::min(stats.scaleMin, renderedScale);
+		stats.scaleMax = std::max(stats.scaleMax, renderedScale);
+		if (gpuMs > stats.budgetMs) {
+			stats.overBudget++;
+		}
+
+		double fullCost = gpuMs / (static_cast<double>(renderedScale) * renderedScale);
+		if (fullResolutionMs == 0.0) {
+			fullResolutionMs = fullCost;
+		} else {
+			fullResolutionMs += (fullCost - fullResolutionMs) * (fullCost > fullResolutionMs ? RISE_SMOOTHING : FALL_SMOOTHING);
+		}
+
+		//over the budget the average lags behind, the frame itself says how far to go down
+		double cost = gpuMs > stats.budgetMs ? std::max(fullCost, fullResolutionMs) : fullResolutionMs;
+		auto desired = static_cast<float>(std::sqrt(stats.budgetMs * HEADROOM / std::max(cost, 1e-6)));
+		float next = current;
+		if (desired < current) {
+			next = std::floor(desired / STEP) * STEP;
+		} else if (desired >= current + STEP) {
+			next = current + STEP;
+		}
+		next = std::clamp(next, minScale, 1.0f);
+		if (next != current) {
+			current = next;
+			stats.changes++;
+		}
+	}
+
+	[[nodiscard]] const DynamicResolutionStats& statistics() const { return stats; }
+
+private:
+	float minScale;
+	float current = 1.0f;
+	double fullResolutionMs = 0.0;	//smoothed gpu time scaled to full resolution
+	DynamicResolutionStats stats;
+};
+
+//Dynamic resolution for the frame loop: times each frame on the gpu with a pair of timestamps and hands the result
+//to a ResolutionController. Like the profiler, every frame slot has its own queries and they are read once the slot
+//comes around again, so the scale reacts a couple of frames late but never waits for the gpu.
+//
+//The scene is always rendered into the top left renderExtent() of full sized targets and blitted up from there, so
+//changing the scale never reallocates anything.
+class DynamicResolution {
+public:
+	DynamicResolution(const vk::raii::Device& device, const vk::raii::PhysicalDevice& physicalDevice, uint32_t queueFamilyIndex,
+			uint32_t framesInFlight, double budgetMs, float minScale)
+		: controller(budgetMs, minScale), slots(framesInFlight)
+	{
+		uint32_t validBits = physicalDevice.getQueueFamilyProperties()[queueFamilyIndex].timestampValidBits;
+		if (validBits == 0) {
+			throw std::runtime_error("dynamic resolution needs timestamp queries on the graphics queue");
+		}
+		timestampMask = validBits >= 64 ? ~0ull : ((1ull << validBits) - 1);
+		timestampPeriodNs = physicalDevice.getProperties().limits.timestampPeriod;
+		timestampPool = vk::raii::QueryPool(device, vk::QueryPoolCreateInfo{
+			.queryType = vk::QueryType::eTimestamp,
+			.queryCount = framesInFlight * 2 });
+	}
+
+	//Call right after commandBuffer.begin(), once the slot's previous frame has been waited on. Feeds that frame's
+	//time to the controller, then fixes this frame's scale.
+	void beginFrame(const vk::raii::CommandBuffer& commandBuffer, uint32_t frameSlot) {
+		currentSlot = frameSlot;
+		Slot& slot = slots[currentSlot];
+		if (slot.recorded) {
+			//no eWait, a result that isn't there is just skipped
+			auto [result, timestamps] = timestampPool.getResults<uint64_t>(currentSlot * 2, 2, 2 * sizeof(uint64_t), sizeof(uint64_t),
+				vk::QueryResultFlagBits::e64);
+			if (result == vk::Result::eSuccess) {
+				uint64_t ticks = ((timestamps[1] & timestampMask) - (timestamps[0] & timestampMask)) & timestampMask;
+				controller.frameTime(static_cast<double>(ticks) * timestampPeriodNs / 1e6, slot.scale);
+			}
+		}
+
+		slot.scale = controller.scale();
+		slot.recorded = true;
+		commandBuffer.resetQueryPool(*timestampPool, currentSlot * 2, 2);
+		commandBuffer.writeTimestamp2(vk::PipelineStageFlagBits2::eTopOfPipe, *timestampPool, currentSlot * 2);
+	}
+
+	//Last thing before commandBuffer.end()
+	void endFrame(const vk::raii::CommandBuffer& commandBuffer) {
+		commandBuffer.writeTimestamp2(vk::PipelineStageFlagBits2::eBottomOfPipe, *timestampPool, currentSlot * 2 + 1);
+	}
+
+	//The part of a full sized target the current frame renders to, same aspect as full
+	[[nodiscard]] vk::Extent2D renderExtent(vk::Extent2D full) const {
+		float scale = slots[currentSlot].scale;
+		return vk::Extent2D{
+			std::max(1u, static_cast<uint32_t>(std::lround(static_cast<float>(full.width) * scale))),
+			std::max(1u, static_cast<uint32_t>(std::lround(static_cast<float>(full.height) * scale))) };
+	}
+
+	[[nodiscard]] float scale() const { return controller.scale(); }
+	[[nodiscard]] const DynamicResolutionStats& statistics() const { return controller.statistics(); }
+
+private:
+	struct Slot {
+		bool recorded = false;
+		float scale = 1.0f;
+	};
+
+	ResolutionController controller;
+	std::vector<Slot> slots;
+	uint32_t currentSlot = 0;
+	vk::raii::QueryPool timestampPool = nullptr;
+	uint64_t timestampMask = 0;
+	float timestampPeriodNs = 1.0f;
+};
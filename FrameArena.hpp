@@ -0,0 +1,78 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <vector>
+
+//Bump allocator for scratch data that only lives for one frame (per worker partial results, temporary index lists).
+//allocate() is a pointer bump, reset() takes everything back at once and nothing is ever freed individually.
+//
+//Memory comes in blocks that are kept across resets. When a frame needed more than one block they are merged into
+//one big enough block at the next reset, so after the first few frames every frame runs out of a single block.
+//Not thread safe, give each thread its own or allocate up front on the owning thread.
+class FrameArena {
+public:
+	static constexpr size_t ALIGNMENT = 64;		//cache line, so per worker slots never share one
+
+	explicit FrameArena(size_t initialSize = 64 * 1024) { addBlock(initialSize); }
+
+	FrameArena(const FrameArena&) = delete;
+	FrameArena& operator=(const FrameArena&) = delete;
+
+	//Uninitialized storage for count Ts, only for types that need no destructor
+	template <typename T>
+	[[nodiscard]] T* allocate(size_t count) {
+		static_assert(std::is_trivially_destructible_v<T>, "the arena never runs destructors");
+		static_assert(alignof(T) <= ALIGNMENT, "over aligned type");
+		size_t size = (sizeof(T) * count + ALIGNMENT - 1) & ~(ALIGNMENT - 1);
+		Block* block = &blocks.back();
+		if (block->used + size > block->size) {
+			block = &addBlock(std::max(size, block->size * 2));
+		}
+		void* memory = block->memory.get() + block->used;
+		block->used += size;
+		usedTotal += size;
+		peak = std::max(peak, usedTotal);
+		return static_cast<T*>(memory);
+	}
+
+	void reset() {
+		if (blocks.size() > 1) {
+			size_t total = 0;
+			for (const Block& block : blocks) {
+				total += block.size;
+			}
+			blocks.clear();
+			addBlock(total);
+		}
+		blocks.back().used = 0;
+		usedTotal = 0;
+	}
+
+	//most bytes handed out between two resets
+	[[nodiscard]] size_t peakBytes() const { return peak; }
+
+private:
+	struct AlignedDelete {
+		void operator()(std::byte* memory) const { ::operator delete[](memory, std::align_val_t(ALIGNMENT)); }
+	};
+	struct Block {
+		std::unique_ptr<std::byte[], AlignedDelete> memory;
+		size_t size = 0;
+		size_t used = 0;
+	};
+	std::vector<Block> blocks;
+	size_t usedTotal = 0;
+	size_t peak = 0;
+
+	Block& addBlock(size_t size) {
+		size = (size + ALIGNMENT - 1) & ~(ALIGNMENT - 1);
+		auto* memory = static_cast<std::byte*>(::operator new[](size, std::align_val_t(ALIGNMENT)));
+		return blocks.emplace_back(Block{ std::unique_ptr<std::byte[], AlignedDelete>(memory), size, 0 });
+	}
+};
@@ -0,0 +1,350 @@
+#pragma once
+
+#include <vulkan/vulkan_raii.hpp>
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <deque>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <mutex>
+#include <optional>
+#include <ostream>
+#include <span>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "GpuAllocator.hpp"
+
+//One read back frame as the sink sees it
+struct CapturedFrame {
+	uint64_t frame;				//frame timeline value that rendered it
+	uint32_t width;
+	uint32_t height;
+	bool bgra;				//channel order in memory, swapchains are usually bgra
+	std::span<const std::byte> pixels;	//width * 4 bytes per row, no padding. Only valid during the sink call.
+};
+
+//Runs on the capture worker thread, one frame at a time
+using FrameSink = std::function<void(const CapturedFrame& frame)>;
+
+struct FrameCaptureStats {
+	uint64_t captured = 0;		//handed to the sink
+	uint64_t dropped = 0;		//no free slot when the frame was recorded, the sink is falling behind
+	uint64_t failed = 0;		//the sink threw
+	double sinkMs = 0.0;		//total time spent in the sink
+
+	void report(std::ostream& out) const {
+		out << std::fixed << std::setprecision(3)
+		    << "[capture] captured=" << captured
+		    << " dropped=" << dropped
+		    << " failed=" << failed
+		    << " sink_ms_per_frame=" << (captured > 0 ? sinkMs / static_cast<double>(captured) : 0.0) << "\n";
+	}
+};
+
+//Reads rendered frames back without the frame loop ever waiting for them. A ring of host visible buffers, each one
+//goes through
+//
+//	free		begin() picks it for this frame, the frame's command buffer copies the image into it (record())
+//	in flight	until the frame timeline passes the frame, collect() checks that once per frame without waiting
+//	sinking		the worker thread hands the mapped memory to the sink, then the slot is free again
+//
+//With every slot in flight or sinking, begin() returns nothing and the frame is simply not captured (counted as
+//dropped), so a slow sink costs frames in the capture and never frame rate. The slots are persistently mapped and
+//host coherent (cached where the device has it, reading uncached memory is very slow), so there is nothing to map
+//or invalidate per frame.
+class FrameCapture {
+public:
+	//8 bit rgba/bgra formats only, the sinks don't convert anything else
+	static bool supports(vk::Format format) {
+		return format == vk::Format::eB8G8R8A8Srgb || format == vk::Format::eB8G8R8A8Unorm ||
+		       format == vk::Format::eR8G8B8A8Srgb || format == vk::Format::eR8G8B8A8Unorm;
+	}
+
+	FrameCapture(const vk::raii::Device& device, GpuAllocator& allocator, uint32_t slotCount, FrameSink sink)
+		: device(device), allocator(allocator), sink(std::move(sink)), slots(slotCount)
+	{
+		worker = std::thread([this] { workerLoop(); });
+	}
+
+	~FrameCapture() { finish(); }
+
+	FrameCapture(const FrameCapture&) = delete;
+	FrameCapture& operator=(const FrameCapture&) = delete;
+
+	//Render thread. Claims a free slot for the frame that will signal tag, nullopt drops the frame.
+	std::optional<uint32_t> begin(vk::Extent2D extent, vk::Format format, uint64_t tag) {
+		if (!supports(format)) {
+			throw std::runtime_error("frame capture does not support " + vk::to_string(format));
+		}
+		std::lock_guard lock(mutex);
+		for (uint32_t i = 0; i < slots.size(); i++) {
+			Slot& slot = slots[i];
+			if (slot.state != State::Free) {
+				continue;
+			}
+			vk::DeviceSize size = vk::DeviceSize(extent.width) * extent.height * 4;
+			if (slot.buffer.size() < size) {
+				//free means neither the gpu nor the worker touches it anymore, so it can just be replaced
+				slot.buffer = GpuBuffer(allocator, device, size, vk::BufferUsageFlagBits::eTransferDst,
+					vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent,
+					vk::MemoryPropertyFlagBits::eHostCached);
+			}
+			slot.state = State::InFlight;
+			slot.tag = tag;
+			slot.extent = extent;
+			slot.bgra = format == vk::Format::eB8G8R8A8Srgb || format == vk::Format::eB8G8R8A8Unorm;
+			return i;
+		}
+		stats.dropped++;
+		return std::nullopt;
+	}
+
+	[[nodiscard]] vk::Buffer buffer(uint32_t slot) const { return slots[slot].buffer.handle(); }
+
+	//The copy out of image (already in transfer src layout) plus the barrier that makes it visible to the host
+	void record(const vk::raii::CommandBuffer& commandBuffer, uint32_t slot, vk::Image image) const {
+		const Slot& target = slots[slot];
+		vk::BufferImageCopy region{
+			.bufferOffset = 0,
+			.bufferRowLength = 0,
+			.bufferImageHeight = 0,
+			.imageSubresource = { vk::ImageAspectFlagBits::eColor, 0, 0, 1 },
+			.imageOffset = { 0, 0, 0 },
+			.imageExtent = { target.extent.width, target.extent.height, 1 } };
+		commandBuffer.copyImageToBuffer(image, vk::ImageLayout::eTransferSrcOptimal, target.buffer.handle(), region);
+
+		vk::MemoryBarrier2 toHost{
+			.srcStageMask = vk::PipelineStageFlagBits2::eTransfer,
+			.srcAccessMask = vk::AccessFlagBits2::eTransferWrite,
+			.dstStageMask = vk::PipelineStageFlagBits2::eHost,
+			.dstAccessMask = vk::AccessFlagBits2::eHostRead };
+		commandBuffer.pipelineBarrier2(vk::DependencyInfo{ .memoryBarrierCount = 1, .pMemoryBarriers = &toHost });
+	}
+
+	//Render thread, once per frame and never waits: slots whose frame the timeline has passed go to the worker
+	void collect(uint64_t completedValue) {
+		bool handed = false;
+		{
+			std::lock_guard lock(mutex);
+			//in tag order, so the sink sees frames in the order they were rendered
+			while (true) {
+				auto oldest = slots.end();
+				for (auto it = slots.begin(); it != slots.end(); ++it) {
+					if (it->state == State::InFlight && it->tag <= completedValue && (oldest == slots.end() || it->tag < oldest->tag)) {
+						oldest = it;
+					}
+				}
+				if (oldest == slots.end()) {
+					break;
+				}
+				oldest->state = State::Sinking;
+				queue.push_back(static_cast<uint32_t>(oldest - slots.begin()));
+				handed = true;
+			}
+		}
+		if (handed) {
+			wake.notify_one();
+		}
+	}
+
+	//Stops the worker once it has sunk everything collect() handed it. Frames still in flight are lost, so
+	//collect() once the device is idle first. Nothing can be captured afterwards.
+	void finish() {
+		{
+			std::lock_guard lock(mutex);
+			stopping = true;
+		}
+		wake.notify_all();
+		if (worker.joinable()) {
+			worker.join();
+		}
+	}
+
+	[[nodiscard]] FrameCaptureStats statistics() const {
+		std::lock_guard lock(mutex);
+		return stats;
+	}
+
+private:
+	enum class State { Free, InFlight, Sinking };
+
+	struct Slot {
+		GpuBuffer buffer;
+		State state = State::Free;
+		uint64_t tag = 0;
+		vk::Extent2D extent;
+		bool bgra = false;
+	};
+
+	const vk::raii::Device& device;
+	GpuAllocator& allocator;
+	FrameSink sink;
+
+	mutable std::mutex mutex;
+	std::condition_variable wake;		//queued slots or stopping
+	std::vector<Slot> slots;		//never resized, so the worker can use a slot outside the lock
+	std::deque<uint32_t> queue;
+	bool stopping = false;
+	FrameCaptureStats stats;
+	std::thread worker;			//last, so it starts after everything above exists
+
+	void workerLoop() {
+		while (true) {
+			uint32_t index = 0;
+			{
+				std::unique_lock lock(mutex);
+				wake.wait(lock, [this] { return stopping || !queue.empty(); });
+				if (queue.empty()) {
+					return;
+				}
+				index = queue.front();
+				queue.pop_front();
+			}
+
+			//the slot is Sinking, begin() won't touch it until it is handed back below
+			const Slot& slot = slots[index];
+			CapturedFrame frame{
+				.frame = slot.tag,
+				.width = slot.extent.width,
+				.height = slot.extent.height,
+				.bgra = slot.bgra,
+				.pixels = { static_cast<const std::byte*>(slot.buffer.mapped()), size_t(slot.extent.width) * slot.extent.height * 4 } };
+			auto start = std::chrono::steady_clock::now();
+			bool ok = true;
+			try {
+				sink(frame);
+			} catch (const std::exception& e) {
+				std::cerr << "[capture] frame " << frame.frame << ": " << e.what() << "\n";
+				ok = false;
+			}
+			double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+			{
+				std::lock_guard lock(mutex);
+				slots[index].state = State::Free;
+				(ok ? stats.captured : stats.failed)++;
+				stats.sinkMs += ms;
+			}
+		}
+	}
+};
+
+namespace CaptureSinks {
+
+	//frame_<n>.png in directory. The image data is zlib "stored" blocks, not deflated: compressing a frame costs
+	//more than rendering one, this keeps the sink at disk speed and any png reader still opens it.
+	inline FrameSink png(std::string directory) {
+		std::filesystem::create_directories(directory);
+		return [directory = std::move(directory)](const CapturedFrame& frame) {
+			auto crcTable = [] {
+				std::array<uint32_t, 256> table{};
+				for (uint32_t n = 0; n < 256; n++) {
+					uint32_t c = n;
+					for (int k = 0; k < 8; k++) {
+						c = (c & 1) ? 0xedb88320u ^ (c >> 1) : c >> 1;
+					}
+					table[n] = c;
+				}
+				return table;
+			};
+			static const std::array<uint32_t, 256> crc = crcTable();
+
+			auto bigEndian = [](std::vector<uint8_t>& out, uint32_t value) {
+				out.insert(out.end(), { uint8_t(value >> 24), uint8_t(value >> 16), uint8_t(value >> 8), uint8_t(value) });
+			};
+			std::vector<uint8_t> file = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n' };
+			auto chunk = [&](const char* type, const std::vector<uint8_t>& data) {
+				bigEndian(file, static_cast<uint32_t>(data.size()));
+				size_t start = file.size();
+				file.insert(file.end(), type, type + 4);
+				file.insert(file.end(), data.begin(), data.end());
+				uint32_t c = 0xffffffffu;
+				for (size_t i = start; i < file.size(); i++) {
+					c = crc[(c ^ file[i]) & 0xff] ^ (c >> 8);
+				}
+				bigEndian(file, c ^ 0xffffffffu);
+			};
+
+			std::vector<uint8_t> header;
+			bigEndian(header, frame.width);
+			bigEndian(header, frame.height);
+			header.insert(header.end(), { 8, 6, 0, 0, 0 });		//8 bit rgba, no interlace
+			chunk("IHDR", header);
+
+			//every row is filter type 0 followed by rgba pixels, split into stored blocks of at most 65535 bytes
+			size_t rowBytes = size_t(frame.width) * 4;
+			size_t rawSize = (rowBytes + 1) * frame.height;
+			std::vector<uint8_t> raw(rawSize);
+			for (uint32_t y = 0; y < frame.height; y++) {
+				uint8_t* row = raw.data() + y * (rowBytes + 1);
+				row[0] = 0;
+				const std::byte* source = frame.pixels.data() + y * rowBytes;
+				for (uint32_t x = 0; x < frame.width; x++) {
+					const std::byte* pixel = source + x * 4;
+					row[1 + x * 4 + 0] = static_cast<uint8_t>(pixel[frame.bgra ? 2 : 0]);
+					row[1 + x * 4 + 1] = static_cast<uint8_t>(pixel[1]);
+					row[1 + x * 4 + 2] = static_cast<uint8_t>(pixel[frame.bgra ? 0 : 2]);
+					row[1 + x * 4 + 3] = 0xff;	//opaque composite, the alpha channel means nothing
+				}
+			}
+			std::vector<uint8_t> zlib = { 0x78, 0x01 };
+			zlib.reserve(rawSize + rawSize / 65535 * 5 + 16);
+			for (size_t offset = 0; offset < rawSize; offset += 65535) {
+				auto length = static_cast<uint16_t>(std::min<size_t>(65535, rawSize - offset));
+				auto inverted = static_cast<uint16_t>(~length);
+				bool last = offset + length >= rawSize;
+				zlib.insert(zlib.end(), { uint8_t(last ? 1 : 0), uint8_t(length), uint8_t(length >> 8),
+					uint8_t(inverted), uint8_t(inverted >> 8) });
+				zlib.insert(zlib.end(), raw.begin() + static_cast<ptrdiff_t>(offset), raw.begin() + static_cast<ptrdiff_t>(offset + length));
+			}
+			uint32_t a = 1, b = 0;
+			for (uint8_t byte : raw) {
+				a = (a + byte) % 65521;
+				b = (b + a) % 65521;
+			}
+			bigEndian(zlib, b << 16 | a);
+			chunk("IDAT", zlib);
+			chunk("IEND", {});
+
+			char name[32];
+			std::snprintf(name, sizeof(name), "frame_%06llu.png", static_cast<unsigned long long>(frame.frame));
+			std::ofstream out(std::filesystem::path(directory) / name, std::ios::binary | std::ios::trunc);
+			out.write(reinterpret_cast<const char*>(file.data()), static_cast<std::streamsize>(file.size()));
+			if (!out.good()) {
+				throw std::runtime_error(std::string("failed to write ") + name);
+			}
+		};
+	}
+
+	//frame_<n>_<width>x<height>.rgba in directory, the pixels exactly as read back except bgra is swizzled to rgba
+	inline FrameSink raw(std::string directory) {
+		std::filesystem::create_directories(directory);
+		return [directory = std::move(directory)](const CapturedFrame& frame) {
+			std::vector<std::byte> pixels(frame.pixels.begin(), frame.pixels.end());
+			if (frame.bgra) {
+				for (size_t i = 0; i < pixels.size(); i += 4) {
+					std::swap(pixels[i], pixels[i + 2]);
+				}
+			}
+			char name[64];
+			std::snprintf(name, sizeof(name), "frame_%06llu_%ux%u.rgba", static_cast<unsigned long long>(frame.frame),
+				frame.width, frame.height);
+			std::ofstream out(std::filesystem::path(directory) / name, std::ios::binary | std::ios::trunc);
+			out.write(reinterpret_cast<const char*>(pixels.data()), static_cast<std::streamsize>(pixels.size()));
+			if (!out.good()) {
+				throw std::runtime_error(std::string("failed to write ") + name);
+			}
+		};
+	}
+
+}
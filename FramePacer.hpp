@@ -0,0 +1,145 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <iomanip>
+#include <optional>
+#include <ostream>
+#include <thread>
+#include <vector>
+
+#include "BenchmarkStats.hpp"
+
+//Decides when the cpu starts on a frame and measures how long each frame takes from that start (which is when
+//input gets polled) until it is presented, or until the gpu finished it when presents can't be observed.
+//
+//Unpaced, the loop runs as fast as acquire lets it. Input read at the start of a frame then waits behind the other
+//frames in flight and the swapchain queue before it is shown. Low latency mode only starts a frame once the
+//previous one is done, then sleeps until the predicted cpu + gpu work would end right at the next present slot.
+//Nothing queues anywhere, and input is read as late as possible.
+//
+//No vulkan in here, the frame loop does the actual waiting and reports completions with completed().
+class FramePacer {
+public:
+	using Clock = std::chrono::steady_clock;
+
+	//targetFps 0 means no cap
+	FramePacer(uint32_t targetFps, bool lowLatency) : lowLatencyMode(lowLatency) {
+		if (targetFps > 0) {
+			targetInterval = std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(1.0 / targetFps));
+		}
+	}
+
+	[[nodiscard]] bool lowLatency() const { return lowLatencyMode; }
+	[[nodiscard]] bool pacing() const { return lowLatencyMode || targetInterval > Clock::duration::zero(); }
+
+	//Sleeps until frame's cpu work should start, then stamps it as started. Calling it again for a frame that was
+	//never submitted (failed acquire) restarts that frame.
+	void waitForStart(uint64_t frame) {
+		Clock::time_point startAt = Clock::now();
+		if (targetInterval > Clock::duration::zero() && lastStart) {
+			startAt = std::max(startAt, *lastStart + targetInterval);
+		}
+		if (lowLatencyMode && lastCompletion && workEstimate) {
+			//the next present slot after the previous frame's, minus what this frame is expected to take. A late
+			//frame costs a whole refresh under fifo, starting early only costs the margin.
+			Clock::duration period = targetInterval > Clock::duration::zero() ? targetInterval : presentInterval.value_or(Clock::duration::zero());
+			startAt = std::max(startAt, *lastCompletion + period - *workEstimate - SAFETY_MARGIN);
+		}
+		Clock::time_point now = Clock::now();
+		if (startAt > now) {
+			std::this_thread::sleep_until(startAt);
+			sleepTotal += Clock::now() - now;
+		}
+
+		now = Clock::now();
+		if (!pending.empty() && pending.back().frame == frame) {
+			pending.back().start = now;
+		} else {
+			pending.push_back(Pending{ frame, now });
+		}
+		lastStart = now;
+	}
+
+	//Oldest started frame whose completion has not been seen yet
+	[[nodiscard]] std::optional<uint64_t> oldestPending() const {
+		return pending.empty() ? std::nullopt : std::optional<uint64_t>(pending.front().frame);
+	}
+
+	//frame (and every earlier one, presents and timeline values are both in order) reached the screen, or finished on
+	//the gpu, at `when`
+	void completed(uint64_t frame, Clock::time_point when) {
+		while (!pending.empty() && pending.front().frame <= frame) {
+			const Pending& done = pending.front();
+			Clock::duration latency = when - done.start;
+			if (done.frame == frame) {
+				//only the frame that was actually waited for is exact, earlier ones were just seen late
+				workEstimate = workEstimate ? (*workEstimate * 7 + latency) / 8 : latency;
+				if (lastCompletion) {
+					Clock::duration interval = when - *lastCompletion;
+					presentInterval = presentInterval ? (*presentInterval * 7 + interval) / 8 : interval;
+				}
+			}
+			double ms = std::chrono::duration<double, std::milli>(latency).count();
+			if (latencyMs.size() < MAX_SAMPLES) {
+				latencyMs.push_back(ms);
+			}
+			frames++;
+			totalMs += ms;
+			maxMs = std::max(maxMs, ms);
+			pending.pop_front();
+		}
+		lastCompletion = when;
+	}
+
+	//Frames presented to a swapchain that was since replaced, their presents can't be waited for anymore
+	void discardPending() {
+		pending.clear();
+		lastCompletion.reset();
+	}
+
+	//start-to-present of every frame completed since the last resetSamples(), in completion order
+	[[nodiscard]] const std::vector<double>& samples() const { return latencyMs; }
+	void resetSamples() { latencyMs.clear(); }
+
+	//source is what ended the measurement, "present" or "gpu"
+	void report(std::ostream& out, const char* source) const {
+		double average = frames > 0 ? totalMs / static_cast<double>(frames) : 0.0;
+		out << std::fixed << std::setprecision(3)
+		    << "[latency] source=" << source
+		    << " mode=" << (lowLatencyMode ? "low-latency" : targetInterval > Clock::duration::zero() ? "capped" : "unpaced")
+		    << " frames=" << frames
+		    << " avg_ms=" << average
+		    << " p50_ms=" << FrameTimings::percentile(latencyMs, 0.50)
+		    << " p99_ms=" << FrameTimings::percentile(latencyMs, 0.99)
+		    << " max_ms=" << maxMs
+		    << " sleep_per_frame_ms=" << (frames > 0 ? std::chrono::duration<double, std::milli>(sleepTotal).count() / static_cast<double>(frames) : 0.0)
+		    << "\n";
+	}
+
+private:
+	static constexpr Clock::duration SAFETY_MARGIN = std::chrono::milliseconds(1);
+	static constexpr size_t MAX_SAMPLES = 1 << 20;	//percentiles cover the first million frames, the totals all of them
+
+	struct Pending {
+		uint64_t frame;
+		Clock::time_point start;
+	};
+
+	bool lowLatencyMode;
+	Clock::duration targetInterval = Clock::duration::zero();
+
+	std::deque<Pending> pending;
+	std::optional<Clock::time_point> lastStart;
+	std::optional<Clock::time_point> lastCompletion;
+	std::optional<Clock::duration> workEstimate;	//start to completion, averaged
+	std::optional<Clock::duration> presentInterval;	//completion to completion, the refresh period under fifo
+
+	std::vector<double> latencyMs;
+	uint64_t frames = 0;
+	double totalMs = 0.0;
+	double maxMs = 0.0;
+	Clock::duration sleepTotal = Clock::duration::zero();
+};
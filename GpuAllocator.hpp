@@ -0,0 +1,526 @@
+#pragma once
+
+#include <vulkan/vulkan_raii.hpp>
+#include <algorithm>
+#include <bit>
+#include <cstdint>
+#include <deque>
+#include <iomanip>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <ostream>
+#include <set>
+#include <stdexcept>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+//Power-of-two buddy allocator over an abstract [0, capacity) range, no Vulkan in here.
+//Every block is aligned to its own size, so rounding a request up to its alignment also satisfies it.
+class BuddyAllocator {
+public:
+	BuddyAllocator(uint64_t capacity, uint64_t minBlockSize)
+		: capacity(capacity), minBlockSize(minBlockSize)
+	{
+		if (!std::has_single_bit(capacity) || !std::has_single_bit(minBlockSize) || minBlockSize > capacity) {
+			throw std::invalid_argument("buddy allocator sizes must be powers of two with minBlockSize <= capacity");
+		}
+		maxLevel = static_cast<uint32_t>(std::countr_zero(capacity) - std::countr_zero(minBlockSize));
+		freeLists.resize(maxLevel + 1);
+		freeLists[0].insert(0);
+	}
+
+	std::optional<uint64_t> allocate(uint64_t size, uint64_t alignment = 1) {
+		uint64_t needed = std::bit_ceil(std::max({ size, alignment, minBlockSize }));
+		if (size == 0 || needed > capacity) {
+			return std::nullopt;
+		}
+		auto targetLevel = static_cast<uint32_t>(std::countr_zero(capacity) - std::countr_zero(needed));
+
+		//smallest free block that fits, then split it down to the size we want
+		int32_t level = static_cast<int32_t>(targetLevel);
+		while (level >= 0 && freeLists[static_cast<uint32_t>(level)].empty()) {
+			level--;
+		}
+		if (level < 0) {
+			return std::nullopt;
+		}
+
+		auto current = static_cast<uint32_t>(level);
+		uint64_t offset = *freeLists[current].begin();
+		freeLists[current].erase(freeLists[current].begin());
+		while (current < targetLevel) {
+			current++;
+			freeLists[current].insert(offset + blockSize(current));
+		}
+
+		allocatedLevels[offset] = targetLevel;
+		usedBytes += needed;
+		return offset;
+	}
+
+	void free(uint64_t offset) {
+		auto it = allocatedLevels.find(offset);
+		if (it == allocatedLevels.end()) {
+			throw std::invalid_argument("buddy allocator: freeing an offset that was never allocated");
+		}
+		uint32_t level = it->second;
+		allocatedLevels.erase(it);
+		usedBytes -= blockSize(level);
+
+		//merge back up for as long as our buddy is free too
+		while (level > 0) {
+			uint64_t buddy = offset ^ blockSize(level);
+			auto buddyIt = freeLists[level].find(buddy);
+			if (buddyIt == freeLists[level].end()) {
+				break;
+			}
+			freeLists[level].erase(buddyIt);
+			offset = std::min(offset, buddy);
+			level--;
+		}
+		freeLists[level].insert(offset);
+	}
+
+	[[nodiscard]] uint64_t size() const { return capacity; }
+	[[nodiscard]] uint64_t used() const { return usedBytes; }
+	[[nodiscard]] bool empty() const { return allocatedLevels.empty(); }
+
+	[[nodiscard]] uint64_t largestFree() const {
+		for (uint32_t level = 0; level <= maxLevel; level++) {
+			if (!freeLists[level].empty()) {
+				return blockSize(level);
+			}
+		}
+		return 0;
+	}
+
+private:
+	uint64_t capacity;
+	uint64_t minBlockSize;
+	uint32_t maxLevel = 0;
+	uint64_t usedBytes = 0;
+	std::vector<std::set<uint64_t>> freeLists;	//ordered so we always hand out the lowest offset first
+	std::unordered_map<uint64_t, uint32_t> allocatedLevels;
+
+	[[nodiscard]] uint64_t blockSize(uint32_t level) const { return capacity >> level; }
+};
+
+//Ring of byte ranges tagged with whatever the caller uses to track gpu progress (frame number,
+//timeline value...). Ranges are handed back in order once retire() is told their tag is done.
+class RingAllocator {
+public:
+	explicit RingAllocator(uint64_t capacity) : capacity(capacity) {}
+
+	std::optional<uint64_t> allocate(uint64_t size, uint64_t alignment, uint64_t tag) {
+		if (size == 0 || size > capacity) {
+			return std::nullopt;
+		}
+		if (inFlight.empty()) {
+			head = tail = 0;
+		} else if (head == tail) {
+			return std::nullopt;	//completely full
+		}
+
+		uint64_t offset = alignUp(head, alignment);
+		if (inFlight.empty() || head > tail) {
+			//free space is [head, capacity) followed by [0, tail)
+			if (offset + size > capacity) {
+				//doesn't fit before the end, wrap around and skip the leftover bytes
+				if (size > tail) {
+					return std::nullopt;
+				}
+				offset = 0;
+			}
+		} else if (offset + size > tail) {
+			//head < tail, free space is just [head, tail)
+			return std::nullopt;
+		}
+
+		head = offset + size;
+		if (!inFlight.empty() && inFlight.back().tag == tag) {
+			inFlight.back().end = head;
+		} else {
+			inFlight.push_back({ tag, head });
+		}
+		return offset;
+	}
+
+	void retire(uint64_t completedTag) {
+		while (!inFlight.empty() && inFlight.front().tag <= completedTag) {
+			tail = inFlight.front().end;
+			inFlight.pop_front();
+		}
+		if (inFlight.empty()) {
+			head = tail = 0;
+		}
+	}
+
+	[[nodiscard]] uint64_t size() const { return capacity; }
+
+	static uint64_t alignUp(uint64_t value, uint64_t alignment) {
+		return alignment > 1 ? (value + alignment - 1) / alignment * alignment : value;
+	}
+
+private:
+	struct Region {
+		uint64_t tag;
+		uint64_t end;
+	};
+
+	uint64_t capacity;
+	uint64_t head = 0;
+	uint64_t tail = 0;
+	std::deque<Region> inFlight;
+};
+
+struct GpuAllocation {
+	vk::DeviceMemory memory;
+	vk::DeviceSize offset = 0;
+	vk::DeviceSize size = 0;
+	void* mapped = nullptr;		//non-null for host visible memory, already offset to this allocation
+	uint32_t poolIndex = ~0u;
+	uint32_t blockIndex = ~0u;
+
+	explicit operator bool() const { return poolIndex != ~0u; }
+};
+
+struct GpuAllocatorStats {
+	uint64_t blockCount = 0;
+	uint64_t allocationCount = 0;
+	uint64_t bytesReserved = 0;	//vk::DeviceMemory actually allocated from the driver
+	uint64_t bytesCommitted = 0;	//bytes handed out including buddy rounding
+	uint64_t bytesUsed = 0;		//bytes callers asked for
+	double fragmentation = 0.0;	//1 - largest free range / total free, 0 means all free space is contiguous
+
+	void report(std::ostream& out) const {
+		out << std::fixed << std::setprecision(3)
+		    << "[memory] blocks=" << blockCount
+		    << " allocations=" << allocationCount
+		    << " reserved_mb=" << static_cast<double>(bytesReserved) / (1024.0 * 1024.0)
+		    << " committed_mb=" << static_cast<double>(bytesCommitted) / (1024.0 * 1024.0)
+		    << " used_mb=" << static_cast<double>(bytesUsed) / (1024.0 * 1024.0)
+		    << " fragmentation=" << fragmentation << "\n";
+	}
+};
+
+//Sub-allocates buffers/images out of large vk::DeviceMemory blocks instead of one allocation per resource,
+//which would run into maxMemoryAllocationCount. One pool per (memory type, linear/optimal) so
+//bufferImageGranularity never has to be considered within a block. Requests bigger than a block get a
+//dedicated allocation. Host visible blocks are mapped once for their whole lifetime.
+class GpuAllocator {
+public:
+	static constexpr vk::DeviceSize DEFAULT_BLOCK_SIZE = 64ull * 1024 * 1024;
+	static constexpr vk::DeviceSize MIN_ALLOCATION = 256;
+
+	GpuAllocator(const vk::raii::Device& device, const vk::raii::PhysicalDevice& physicalDevice, vk::DeviceSize blockSize = DEFAULT_BLOCK_SIZE)
+		: device(device), memoryProperties(physicalDevice.getMemoryProperties()), blockSize(std::bit_ceil(blockSize)) {}
+
+	GpuAllocation allocate(const vk::MemoryRequirements& requirements, vk::MemoryPropertyFlags required,
+			vk::MemoryPropertyFlags preferred = {}, bool linear = true)
+	{
+		std::lock_guard lock(mutex);
+		uint32_t typeIndex = findMemoryType(requirements.memoryTypeBits, required, preferred);
+		uint32_t poolIndex = poolFor(typeIndex, linear);
+		Pool& pool = pools[poolIndex];
+
+		if (requirements.size > blockSize) {
+			uint32_t blockIndex = addBlock(pool, requirements.size, true);
+			Block& block = *pool.blocks[blockIndex];
+			usedBytes += requirements.size;
+			allocationCount++;
+			return { *block.memory, 0, requirements.size, block.mapped, poolIndex, blockIndex };
+		}
+
+		for (uint32_t blockIndex = 0; blockIndex < pool.blocks.size(); blockIndex++) {
+			Block* block = pool.blocks[blockIndex].get();
+			if (!block || block->dedicated) {
+				continue;
+			}
+			if (auto offset = block->buddy->allocate(requirements.size, requirements.alignment)) {
+				return finish(*block, poolIndex, blockIndex, *offset, requirements.size);
+			}
+		}
+
+		uint32_t blockIndex = addBlock(pool, blockSize, false);
+		Block& block = *pool.blocks[blockIndex];
+		auto offset = block.buddy->allocate(requirements.size, requirements.alignment);
+		if (!offset) {
+			throw std::runtime_error("failed to sub-allocate from a fresh memory block");
+		}
+		return finish(block, poolIndex, blockIndex, *offset, requirements.size);
+	}
+
+	void free(const GpuAllocation& allocation) {
+		if (!allocation) {
+			return;
+		}
+		std::lock_guard lock(mutex);
+		Pool& pool = pools[allocation.poolIndex];
+		auto& block = pool.blocks[allocation.blockIndex];
+		usedBytes -= allocation.size;
+		allocationCount--;
+
+		if (block->dedicated) {
+			block.reset();
+			return;
+		}
+		block->buddy->free(allocation.offset);
+
+		//keep one empty block around per pool so alloc/free churn doesn't hit the driver every time
+		if (block->buddy->empty()) {
+			size_t emptyBlocks = std::ranges::count_if(pool.blocks, [](const auto& b) { return b && !b->dedicated && b->buddy->empty(); });
+			if (emptyBlocks > 1) {
+				block.reset();
+			}
+		}
+	}
+
+	[[nodiscard]] GpuAllocatorStats stats() const {
+		std::lock_guard lock(mutex);
+		GpuAllocatorStats stats;
+		stats.allocationCount = allocationCount;
+		stats.bytesUsed = usedBytes;
+
+		uint64_t totalFree = 0;
+		uint64_t largestFree = 0;
+		for (const Pool& pool : pools) {
+			for (const auto& block : pool.blocks) {
+				if (!block) {
+					continue;
+				}
+				stats.blockCount++;
+				stats.bytesReserved += block->size;
+				if (block->dedicated) {
+					stats.bytesCommitted += block->size;
+					continue;
+				}
+				stats.bytesCommitted += block->buddy->used();
+				totalFree += block->buddy->size() - block->buddy->used();
+				largestFree = std::max(largestFree, block->buddy->largestFree());
+			}
+		}
+		stats.fragmentation = totalFree ? 1.0 - static_cast<double>(largestFree) / static_cast<double>(totalFree) : 0.0;
+		return stats;
+	}
+
+	uint32_t findMemoryType(uint32_t typeFilter, vk::MemoryPropertyFlags required, vk::MemoryPropertyFlags preferred = {}) const {
+		//first pass wants everything, second pass settles for just what is required
+		for (vk::MemoryPropertyFlags wanted : { required | preferred, required }) {
+			for (uint32_t i = 0; i < memoryProperties.memoryTypeCount; i++) {
+				if ((typeFilter & (1u << i)) && (memoryProperties.memoryTypes[i].propertyFlags & wanted) == wanted) {
+					return i;
+				}
+			}
+		}
+		throw std::runtime_error("failed to find suitable memory type!");
+	}
+
+	[[nodiscard]] vk::MemoryPropertyFlags propertiesOf(const GpuAllocation& allocation) const {
+		return memoryProperties.memoryTypes[pools[allocation.poolIndex].memoryTypeIndex].propertyFlags;
+	}
+
+private:
+	struct Block {
+		vk::raii::DeviceMemory memory = nullptr;
+		vk::DeviceSize size = 0;
+		void* mapped = nullptr;
+		bool dedicated = false;
+		std::optional<BuddyAllocator> buddy;
+	};
+
+	struct Pool {
+		uint32_t memoryTypeIndex;
+		bool linear;
+		std::vector<std::unique_ptr<Block>> blocks;
+	};
+
+	const vk::raii::Device& device;
+	vk::PhysicalDeviceMemoryProperties memoryProperties;
+	vk::DeviceSize blockSize;
+	std::vector<Pool> pools;
+	uint64_t usedBytes = 0;
+	uint64_t allocationCount = 0;
+	mutable std::mutex mutex;
+
+	uint32_t poolFor(uint32_t typeIndex, bool linear) {
+		for (uint32_t i = 0; i < pools.size(); i++) {
+			if (pools[i].memoryTypeIndex == typeIndex && pools[i].linear == linear) {
+				return i;
+			}
+		}
+		pools.push_back({ typeIndex, linear, {} });
+		return static_cast<uint32_t>(pools.size() - 1);
+	}
+
+	uint32_t addBlock(Pool& pool, vk::DeviceSize size, bool dedicated) {
+		auto block = std::make_unique<Block>();
+		block->size = size;
+		block->dedicated = dedicated;
+		block->memory = vk::raii::DeviceMemory(device, vk::MemoryAllocateInfo{
+			.allocationSize = size,
+			.memoryTypeIndex = pool.memoryTypeIndex });
+		if (memoryProperties.memoryTypes[pool.memoryTypeIndex].propertyFlags & vk::MemoryPropertyFlagBits::eHostVisible) {
+			block->mapped = block->memory.mapMemory(0, vk::WholeSize);
+		}
+		if (!dedicated) {
+			block->buddy.emplace(size, MIN_ALLOCATION);
+		}
+
+		//reuse a slot freed earlier so allocation indices stay small
+		for (uint32_t i = 0; i < pool.blocks.size(); i++) {
+			if (!pool.blocks[i]) {
+				pool.blocks[i] = std::move(block);
+				return i;
+			}
+		}
+		pool.blocks.push_back(std::move(block));
+		return static_cast<uint32_t>(pool.blocks.size() - 1);
+	}
+
+	GpuAllocation finish(Block& block, uint32_t poolIndex, uint32_t blockIndex, vk::DeviceSize offset, vk::DeviceSize size) {
+		usedBytes += size;
+		allocationCount++;
+		void* mapped = block.mapped ? static_cast<char*>(block.mapped) + offset : nullptr;
+		return { *block.memory, offset, size, mapped, poolIndex, blockIndex };
+	}
+};
+
+//vk::raii::Buffer plus the sub-allocation backing it, frees both when it goes away
+class GpuBuffer {
+public:
+	GpuBuffer() = default;
+
+	GpuBuffer(GpuAllocator& allocator, const vk::raii::Device& device, vk::DeviceSize size, vk::BufferUsageFlags usage,
+			vk::MemoryPropertyFlags required, vk::MemoryPropertyFlags preferred = {})
+		: allocator(&allocator), bufferSize(size)
+	{
+		buffer = vk::raii::Buffer(device, vk::BufferCreateInfo{
+			.size = size,
+			.usage = usage,
+			.sharingMode = vk::SharingMode::eExclusive });
+		allocation = allocator.allocate(buffer.getMemoryRequirements(), required, preferred, true);
+		buffer.bindMemory(allocation.memory, allocation.offset);
+	}
+
+	~GpuBuffer() { release(); }
+
+	GpuBuffer(GpuBuffer&& other) noexcept { *this = std::move(other); }
+	GpuBuffer& operator=(GpuBuffer&& other) noexcept {
+		if (this != &other) {
+			release();
+			allocator = std::exchange(other.allocator, nullptr);
+			buffer = std::move(other.buffer);
+			allocation = std::exchange(other.allocation, {});
+			bufferSize = std::exchange(other.bufferSize, 0);
+		}
+		return *this;
+	}
+	GpuBuffer(const GpuBuffer&) = delete;
+	GpuBuffer& operator=(const GpuBuffer&) = delete;
+
+	[[nodiscard]] vk::Buffer handle() const { return *buffer; }
+	[[nodiscard]] void* mapped() const { return allocation.mapped; }
+	[[nodiscard]] vk::DeviceSize size() const { return bufferSize; }
+	explicit operator bool() const { return allocator != nullptr; }
+
+private:
+	GpuAllocator* allocator = nullptr;
+	vk::raii::Buffer buffer = nullptr;
+	GpuAllocation allocation;
+	vk::DeviceSize bufferSize = 0;
+
+	void release() {
+		if (allocator) {
+			buffer.clear();
+			allocator->free(allocation);
+			allocator = nullptr;
+		}
+	}
+};
+
+//vk::raii::Image plus its sub-allocation, optimal tiling images come out of their own pools (linear = false)
+class GpuImage {
+public:
+	GpuImage() = default;
+
+	GpuImage(GpuAllocator& allocator, const vk::raii::Device& device, const vk::ImageCreateInfo& createInfo,
+			vk::MemoryPropertyFlags required, vk::MemoryPropertyFlags preferred = {})
+		: allocator(&allocator)
+	{
+		image = vk::raii::Image(device, createInfo);
+		allocation = allocator.allocate(image.getMemoryRequirements(), required, preferred,
+						createInfo.tiling == vk::ImageTiling::eLinear);
+		image.bindMemory(allocation.memory, allocation.offset);
+	}
+
+	~GpuImage() { release(); }
+
+	GpuImage(GpuImage&& other) noexcept { *this = std::move(other); }
+	GpuImage& operator=(GpuImage&& other) noexcept {
+		if (this != &other) {
+			release();
+			allocator = std::exchange(other.allocator, nullptr);
+			image = std::move(other.image);
+			allocation = std::exchange(other.allocation, {});
+		}
+		return *this;
+	}
+	GpuImage(const GpuImage&) = delete;
+	GpuImage& operator=(const GpuImage&) = delete;
+
+	[[nodiscard]] vk::Image handle() const { return *image; }
+	explicit operator bool() const { return allocator != nullptr; }
+
+private:
+	GpuAllocator* allocator = nullptr;
+	vk::raii::Image image = nullptr;
+	GpuAllocation allocation;
+
+	void release() {
+		if (allocator) {
+			image.clear();
+			allocator->free(allocation);
+			allocator = nullptr;
+		}
+	}
+};
+
+//One persistently mapped host buffer that uploads are carved out of. Ranges are tagged with the value the
+//caller will later pass to retire() once the gpu is done copying out of them (frame number, timeline value).
+class StagingRing {
+public:
+	struct Span {
+		vk::Buffer buffer;
+		vk::DeviceSize offset;
+		void* data;
+	};
+
+	StagingRing(GpuAllocator& allocator, const vk::raii::Device& device, vk::DeviceSize capacity)
+		: buffer(allocator, device, capacity, vk::BufferUsageFlagBits::eTransferSrc,
+			 vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent),
+		  ring(capacity) {}
+
+	//nullopt means the ring is full until more tags retire
+	std::optional<Span> allocate(vk::DeviceSize size, vk::DeviceSize alignment, uint64_t tag) {
+		std::lock_guard lock(mutex);
+		auto offset = ring.allocate(size, alignment, tag);
+		if (!offset) {
+			return std::nullopt;
+		}
+		return Span{ buffer.handle(), *offset, static_cast<char*>(buffer.mapped()) + *offset };
+	}
+
+	void retire(uint64_t completedTag) {
+		std::lock_guard lock(mutex);
+		ring.retire(completedTag);
+	}
+
+	[[nodiscard]] vk::DeviceSize capacity() const { return ring.size(); }
+
+private:
+	GpuBuffer buffer;
+	RingAllocator ring;
+	std::mutex mutex;
+};
@@ -0,0 +1,249 @@
+#pragma once
+
+#include <vulkan/vulkan_raii.hpp>
+#include <glm/glm.hpp>
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstring>
+#include <span>
+#include <vector>
+
+#include "GpuAllocator.hpp"
+
+//Matches CullParams in shaders/cull.slang (push constants, std430)
+struct CullPushConstants {
+	std::array<glm::vec4, 6> planes;	//xyz = normal, w = distance, inside when dot(n, p) + w >= 0
+	uint32_t objectCount;
+	float boundingRadius;			//mesh radius before the per-instance scale
+};
+
+//Gribb/Hartmann plane extraction for Vulkan clip space (z in [0, 1]), planes come out normalized
+static std::array<glm::vec4, 6> extractFrustumPlanes(const glm::mat4& viewProj) {
+	auto row = [&](int i) { return glm::vec4(viewProj[0][i], viewProj[1][i], viewProj[2][i], viewProj[3][i]); };
+	std::array<glm::vec4, 6> planes = {
+		row(3) + row(0),	//left
+		row(3) - row(0),	//right
+		row(3) + row(1),	//bottom
+		row(3) - row(1),	//top
+		row(2),			//near
+		row(3) - row(2)		//far
+	};
+	for (auto& plane : planes) {
+		plane /= glm::length(glm::vec3(plane));
+	}
+	return planes;
+}
+
+//Compute pass that tests every object's bounding sphere against the view frustum and compacts the survivors' instance
+//data into visibleInstances(), counting them in instanceCount of a single VkDrawIndexedIndirectCommand. The draw binds
+//that buffer as its per-instance vertex buffer, so everything visible is one instanced indirect draw and the cpu does
+//no per-object work at all. The compaction is a prefix sum over groups of WORKGROUP_SIZE objects (three dispatches,
+//see shaders/cull.slang) rather than an atomic counter, so survivors keep their order and overlapping instances
+//don't trade places from frame to frame.
+//
+//The visible count is also copied to a per frame slot readback buffer so it can be read (without
+//stalling) once that slot's previous frame has been waited on again.
+class GpuCuller {
+public:
+	static constexpr uint32_t WORKGROUP_SIZE = 64;
+	static constexpr vk::DeviceSize GROUP_STRIDE = 16;	//CullGroup in shaders/cull.slang
+
+	GpuCuller(const vk::raii::Device& device, GpuAllocator& allocator, const vk::raii::PipelineCache& pipelineCache,
+			std::span<const uint32_t> spirv, uint32_t framesInFlight)
+		: device(device), allocator(allocator)
+	{
+		std::array<vk::DescriptorSetLayoutBinding, 4> bindings;
+		for (uint32_t i = 0; i < bindings.size(); i++) {
+			bindings[i] = vk::DescriptorSetLayoutBinding{
+				.binding = i,
+				.descriptorType = vk::DescriptorType::eStorageBuffer,
+				.descriptorCount = 1,
+				.stageFlags = vk::ShaderStageFlagBits::eCompute };
+		}
+		descriptorSetLayout = vk::raii::DescriptorSetLayout(device, vk::DescriptorSetLayoutCreateInfo{
+			.bindingCount = static_cast<uint32_t>(bindings.size()),
+			.pBindings = bindings.data() });
+
+		vk::DescriptorPoolSize poolSize{ .type = vk::DescriptorType::eStorageBuffer, .descriptorCount = 4 };
+		descriptorPool = vk::raii::DescriptorPool(device, vk::DescriptorPoolCreateInfo{
+			.flags = vk::DescriptorPoolCreateFlagBits::eFreeDescriptorSet,
+			.maxSets = 1,
+			.poolSizeCount = 1,
+			.pPoolSizes = &poolSize });
+
+		vk::DescriptorSetAllocateInfo allocInfo{
+			.descriptorPool = descriptorPool,
+			.descriptorSetCount = 1,
+			.pSetLayouts = &*descriptorSetLayout };
+		descriptorSet = std::move(vk::raii::DescriptorSets(device, allocInfo).front());
+
+		vk::PushConstantRange pushConstantRange{
+			.stageFlags = vk::ShaderStageFlagBits::eCompute,
+			.offset = 0,
+			.size = sizeof(CullPushConstants) };
+		pipelineLayout = vk::raii::PipelineLayout(device, vk::PipelineLayoutCreateInfo{
+			.setLayoutCount = 1,
+			.pSetLayouts = &*descriptorSetLayout,
+			.pushConstantRangeCount = 1,
+			.pPushConstantRanges = &pushConstantRange });
+
+		vk::raii::ShaderModule shaderModule(device, vk::ShaderModuleCreateInfo{
+			.codeSize = spirv.size_bytes(),
+			.pCode = spirv.data() });
+		auto createPipeline = [&](const char* entryPoint) {
+			vk::ComputePipelineCreateInfo pipelineInfo{
+				.stage = {
+					.stage = vk::ShaderStageFlagBits::eCompute,
+					.module = shaderModule,
+					.pName = entryPoint },
+				.layout = pipelineLayout };
+			return vk::raii::Pipeline(device, pipelineCache, pipelineInfo);
+		};
+		cullPipeline = createPipeline("cullMain");
+		scanPipeline = createPipeline("scanMain");
+		compactPipeline = createPipeline("compactMain");
+
+		drawCommandBuffer = GpuBuffer(allocator, device, sizeof(vk::DrawIndexedIndirectCommand),
+			vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eIndirectBuffer |
+			vk::BufferUsageFlagBits::eTransferDst | vk::BufferUsageFlagBits::eTransferSrc,
+			vk::MemoryPropertyFlagBits::eDeviceLocal);
+		readbackBuffer = GpuBuffer(allocator, device, sizeof(uint32_t) * framesInFlight, vk::BufferUsageFlagBits::eTransferDst,
+			vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent,
+			vk::MemoryPropertyFlagBits::eHostCached);
+		std::memset(readbackBuffer.mapped(), 0, readbackBuffer.size());
+	}
+
+	//Points the cull pass at a new instance buffer. Only call this while the device is idle since the
+	//descriptor set and the visible instance buffer get replaced underneath any in-flight frames.
+	void setObjects(const GpuBuffer& instanceBuffer, uint32_t count) {
+		objectCount = count;
+		//worst case everything is visible, same size as the input
+		visibleInstanceBuffer = GpuBuffer(allocator, device, instanceBuffer.size(),
+			vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eVertexBuffer,
+			vk::MemoryPropertyFlagBits::eDeviceLocal);
+		groupBuffer = GpuBuffer(allocator, device, std::max(groupCount(), 1u) * GROUP_STRIDE,
+			vk::BufferUsageFlagBits::eStorageBuffer, vk::MemoryPropertyFlagBits::eDeviceLocal);
+
+		std::array<vk::DescriptorBufferInfo, 4> bufferInfos = {
+			vk::DescriptorBufferInfo{ .buffer = instanceBuffer.handle(), .offset = 0, .range = vk::WholeSize },
+			vk::DescriptorBufferInfo{ .buffer = visibleInstanceBuffer.handle(), .offset = 0, .range = vk::WholeSize },
+			vk::DescriptorBufferInfo{ .buffer = drawCommandBuffer.handle(), .offset = 0, .range = vk::WholeSize },
+			vk::DescriptorBufferInfo{ .buffer = groupBuffer.handle(), .offset = 0, .range = vk::WholeSize } };
+		std::array<vk::WriteDescriptorSet, 4> writes;
+		for (uint32_t i = 0; i < writes.size(); i++) {
+			writes[i] = vk::WriteDescriptorSet{
+				.dstSet = descriptorSet,
+				.dstBinding = i,
+				.descriptorCount = 1,
+				.descriptorType = vk::DescriptorType::eStorageBuffer,
+				.pBufferInfo = &bufferInfos[i] };
+		}
+		device.updateDescriptorSets(writes, {});
+	}
+
+	//Records the cull dispatches, must be outside of beginRendering/endRendering. Leaves the draw command and visible
+	//instance buffers as compute shader writes, whoever reads them next (the indirect draw, recordReadback()) needs a
+	//barrier.
+	void record(const vk::raii::CommandBuffer& commandBuffer, uint32_t frameSlot, const glm::mat4& viewProj,
+			uint32_t indexCount, float boundingRadius) const
+	{
+		//last frame's draw may still be reading the command and the visible instances, and its cull the groups
+		bufferBarrier(commandBuffer,
+			vk::PipelineStageFlagBits2::eDrawIndirect | vk::PipelineStageFlagBits2::eVertexAttributeInput |
+				vk::PipelineStageFlagBits2::eTransfer | vk::PipelineStageFlagBits2::eComputeShader,
+			vk::AccessFlagBits2::eIndirectCommandRead | vk::AccessFlagBits2::eVertexAttributeRead |
+				vk::AccessFlagBits2::eTransferRead | vk::AccessFlagBits2::eShaderStorageWrite,
+			vk::PipelineStageFlagBits2::eTransfer | vk::PipelineStageFlagBits2::eComputeShader,
+			vk::AccessFlagBits2::eTransferWrite | vk::AccessFlagBits2::eShaderStorageRead | vk::AccessFlagBits2::eShaderStorageWrite);
+		//scanMain only writes instanceCount, the rest of the command is written here
+		vk::DrawIndexedIndirectCommand command{
+			.indexCount = indexCount,
+			.instanceCount = 0,
+			.firstIndex = 0,
+			.vertexOffset = 0,
+			.firstInstance = 0 };
+		commandBuffer.updateBuffer<vk::DrawIndexedIndirectCommand>(drawCommandBuffer.handle(), 0, command);
+		bufferBarrier(commandBuffer,
+			vk::PipelineStageFlagBits2::eTransfer, vk::AccessFlagBits2::eTransferWrite,
+			vk::PipelineStageFlagBits2::eComputeShader, vk::AccessFlagBits2::eShaderStorageRead | vk::AccessFlagBits2::eShaderStorageWrite);
+
+		CullPushConstants push{
+			.planes = extractFrustumPlanes(viewProj),
+			.objectCount = objectCount,
+			.boundingRadius = boundingRadius };
+		commandBuffer.bindDescriptorSets(vk::PipelineBindPoint::eCompute, *pipelineLayout, 0, *descriptorSet, {});
+		commandBuffer.pushConstants<CullPushConstants>(*pipelineLayout, vk::ShaderStageFlagBits::eCompute, 0, push);
+		//each pass reads what the one before wrote to the groups
+		auto computeBarrier = [&] {
+			bufferBarrier(commandBuffer,
+				vk::PipelineStageFlagBits2::eComputeShader, vk::AccessFlagBits2::eShaderStorageWrite,
+				vk::PipelineStageFlagBits2::eComputeShader, vk::AccessFlagBits2::eShaderStorageRead | vk::AccessFlagBits2::eShaderStorageWrite);
+		};
+		commandBuffer.bindPipeline(vk::PipelineBindPoint::eCompute, *cullPipeline);
+		commandBuffer.dispatch(groupCount(), 1, 1);
+		computeBarrier();
+		commandBuffer.bindPipeline(vk::PipelineBindPoint::eCompute, *scanPipeline);
+		commandBuffer.dispatch(1, 1, 1);
+		computeBarrier();
+		commandBuffer.bindPipeline(vk::PipelineBindPoint::eCompute, *compactPipeline);
+		commandBuffer.dispatch(groupCount(), 1, 1);
+	}
+
+	//Copies the visible count out for visibleCount(), the draw command has to be visible to transfer reads by now
+	void recordReadback(const vk::raii::CommandBuffer& commandBuffer, uint32_t frameSlot) const {
+		commandBuffer.copyBuffer(drawCommandBuffer.handle(), readbackBuffer.handle(),
+			vk::BufferCopy{ offsetof(vk::DrawIndexedIndirectCommand, instanceCount), sizeof(uint32_t) * frameSlot, sizeof(uint32_t) });
+		//semaphore waits only cover device accesses, the host read needs its own dependency
+		bufferBarrier(commandBuffer,
+			vk::PipelineStageFlagBits2::eTransfer, vk::AccessFlagBits2::eTransferWrite,
+			vk::PipelineStageFlagBits2::eHost, vk::AccessFlagBits2::eHostRead);
+	}
+
+	//Inside the rendering block, vertex and index buffers already bound and visibleInstances() as the instance buffer
+	void draw(const vk::raii::CommandBuffer& commandBuffer) const {
+		commandBuffer.drawIndexedIndirect(drawCommandBuffer.handle(), 0, 1, sizeof(vk::DrawIndexedIndirectCommand));
+	}
+
+	//Debug counter, valid once the slot's previous frame has been waited on (it is the count from that frame)
+	[[nodiscard]] uint32_t visibleCount(uint32_t frameSlot) const {
+		return static_cast<const uint32_t*>(readbackBuffer.mapped())[frameSlot];
+	}
+
+	[[nodiscard]] uint32_t submittedCount() const { return objectCount; }
+	[[nodiscard]] vk::Buffer drawCommand() const { return drawCommandBuffer.handle(); }
+	[[nodiscard]] vk::Buffer visibleInstances() const { return visibleInstanceBuffer.handle(); }
+
+private:
+	const vk::raii::Device& device;
+	GpuAllocator& allocator;
+
+	vk::raii::DescriptorSetLayout descriptorSetLayout = nullptr;
+	vk::raii::DescriptorPool descriptorPool = nullptr;
+	vk::raii::DescriptorSet descriptorSet = nullptr;
+	vk::raii::PipelineLayout pipelineLayout = nullptr;
+	vk::raii::Pipeline cullPipeline = nullptr;
+	vk::raii::Pipeline scanPipeline = nullptr;
+	vk::raii::Pipeline compactPipeline = nullptr;
+
+	GpuBuffer drawCommandBuffer;
+	GpuBuffer visibleInstanceBuffer;
+	GpuBuffer groupBuffer;			//per WORKGROUP_SIZE objects: which survived, how many, where they go
+	GpuBuffer readbackBuffer;
+	uint32_t objectCount = 0;
+
+	[[nodiscard]] uint32_t groupCount() const { return (objectCount + WORKGROUP_SIZE - 1) / WORKGROUP_SIZE; }
+
+	static void bufferBarrier(const vk::raii::CommandBuffer& commandBuffer,
+			vk::PipelineStageFlags2 srcStage, vk::AccessFlags2 srcAccess,
+			vk::PipelineStageFlags2 dstStage, vk::AccessFlags2 dstAccess)
+	{
+		//global memory barrier is all we need, both buffers are only touched by this queue
+		vk::MemoryBarrier2 barrier{
+			.srcStageMask = srcStage,
+			.srcAccessMask = srcAccess,
+			.dstStageMask = dstStage,
+			.dstAccessMask = dstAccess };
+		commandBuffer.pipelineBarrier2(vk::DependencyInfo{ .memoryBarrierCount = 1, .pMemoryBarriers = &barrier });
+	}
+};
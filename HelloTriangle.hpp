@@ -13,10 +13,35 @@
 #include <cstdlib>
 #include <limits>
 #include <algorithm>
-#include <fstream>
-
-constexpr uint32_t WIDTH = 800;
-constexpr uint32_t HEIGHT = 600;
+#include <chrono>
+#include <array>
+#include <cstring>
+#include <functional>
+#include <cmath>
+#include <iterator>
+#include <cctype>
+#include <string>
+#include <optional>
+
+#include "AppConfig.hpp"
+#include "BenchmarkStats.hpp"
+#include "Profiler.hpp"
+#include "PipelineCache.hpp"
+#include "PipelineStateCache.hpp"
+#include "GpuAllocator.hpp"
+#include "GpuCulling.hpp"
+#include "JobSystem.hpp"
+#include "DeletionQueue.hpp"
+#include "ShaderReloader.hpp"
+#include "AssetIO.hpp"
+#include "TextureStreamer.hpp"
+#include "Bindless.hpp"
+#include "RenderGraph.hpp"
+#include "FramePacer.hpp"
+#include "UniformRing.hpp"
+#include "FrameCapture.hpp"
+#include "Scene.hpp"
+#include "DynamicResolution.hpp"
 
 const std::vector validationLayers = {
 	"VK_LAYER_KHRONOS_validation"
@@ -35,30 +60,159 @@ constexpr bool enableValidationLayers = false;
 constexpr bool enableValidationLayers = true;
 #endif
 
-static std::vector<char> readFile(const std::string& filename) {
-	std::ifstream file(filename, std::ios::ate | std::ios::binary);
-	if(!file.is_open()) {
-		throw std::runtime_error("failed to open file!");
+struct Vertex {
+	glm::vec2 pos;
+	glm::vec3 color;
+
+	static vk::VertexInputBindingDescription getBindingDescription() {
+		return { 0, sizeof(Vertex), vk::VertexInputRate::eVertex };
+	}
+
+	static std::array<vk::VertexInputAttributeDescription, 2> getAttributeDescriptions() {
+		return {
+			vk::VertexInputAttributeDescription( 0, 0, vk::Format::eR32G32Sfloat, offsetof(Vertex, pos) ),
+			vk::VertexInputAttributeDescription( 1, 0, vk::Format::eR32G32B32Sfloat, offsetof(Vertex, color) )
+		};
 	}
+};
 
-	std::vector<char> buffer(file.tellg());
-	file.seekg(0, std::ios::beg);
-	file.read(buffer.data(), static_cast<std::streamsize>(buffer.size()));
+//same triangle the shader used to hard code, now it comes in through real vertex/index buffers
+const std::vector<Vertex> vertices = {
+	{{0.0f, -0.5f}, {1.0f, 0.0f, 0.0f}},
+	{{0.5f, 0.5f}, {0.0f, 1.0f, 0.0f}},
+	{{-0.5f, 0.5f}, {0.0f, 0.0f, 1.0f}}
+};
 
-	file.close();
-	return buffer;
-}
+const std::vector<uint16_t> indices = {
+	0, 1, 2
+};
+
+//per-instance attributes, fed through a second vertex binding with eInstance input rate
+struct InstanceData {
+	glm::vec2 offset;
+	glm::vec2 scaleRotation;	//x = uniform scale, y = rotation in radians
+	glm::vec4 color;		//multiplied with the vertex color
+	uint32_t materialId;		//index into the bindless material table
+	uint32_t padding[3];		//the cull shader reads these as a std430 struct, which rounds up to 16 bytes
 
+	static vk::VertexInputBindingDescription getBindingDescription() {
+		return { 1, sizeof(InstanceData), vk::VertexInputRate::eInstance };
+	}
+
+	static std::array<vk::VertexInputAttributeDescription, 4> getAttributeDescriptions() {
+		return {
+			vk::VertexInputAttributeDescription( 2, 1, vk::Format::eR32G32Sfloat, offsetof(InstanceData, offset) ),
+			vk::VertexInputAttributeDescription( 3, 1, vk::Format::eR32G32Sfloat, offsetof(InstanceData, scaleRotation) ),
+			vk::VertexInputAttributeDescription( 4, 1, vk::Format::eR32G32B32A32Sfloat, offsetof(InstanceData, color) ),
+			vk::VertexInputAttributeDescription( 5, 1, vk::Format::eR32Uint, offsetof(InstanceData, materialId) )
+		};
+	}
+};
+static_assert(sizeof(InstanceData) == 48, "InstanceData has to match the std430 layout in cull.slang");
+static_assert(sizeof(PackedInstance) == sizeof(InstanceData) && offsetof(PackedInstance, scaleRotation) == offsetof(InstanceData, scaleRotation) &&
+	      offsetof(PackedInstance, color) == offsetof(InstanceData, color) && offsetof(PackedInstance, materialId) == offsetof(InstanceData, materialId),
+	      "the scene writes PackedInstances where the shaders read InstanceData");
+
+//lays the instances out on a square grid over the whole screen, one instance is just the original triangle.
+//Materials are handed out round robin.
+static std::vector<InstanceData> generateInstances(uint32_t count, uint32_t materialCount) {
+	if (count == 1) {
+		return { { {0.0f, 0.0f}, {1.0f, 0.0f}, {1.0f, 1.0f, 1.0f, 1.0f}, 0, {} } };
+	}
+	std::vector<InstanceData> instances(count);
+	auto side = static_cast<uint32_t>(std::ceil(std::sqrt(static_cast<double>(count))));
+	float cell = 2.0f / static_cast<float>(side);
+	for (uint32_t i = 0; i < count; i++) {
+		float x = static_cast<float>(i % side);
+		float y = static_cast<float>(i / side);
+		//cheap integer hash so neighbouring instances get visibly different tints
+		uint32_t hash = i * 2654435761u;
+		instances[i] = {
+			.offset = { -1.0f + cell * (x + 0.5f), -1.0f + cell * (y + 0.5f) },
+			.scaleRotation = { cell, static_cast<float>(i % 628) * 0.01f },
+			.color = { 0.5f + static_cast<float>((hash >> 8) & 0xff) / 510.0f,
+				   0.5f + static_cast<float>((hash >> 16) & 0xff) / 510.0f,
+				   0.5f + static_cast<float>((hash >> 24) & 0xff) / 510.0f, 1.0f },
+			.materialId = i % materialCount };
+	}
+	return instances;
+}
 
 class HelloTriangleApplication {
 public:
+	explicit HelloTriangleApplication(AppConfig config = {}) : config(config) {
+		//there is no surface to present to in headless mode so the swapchain extension is not required
+		if (config.headless) {
+			std::erase_if(deviceExtensions, [](const char* extension)
+					{ return strcmp(extension, vk::KHRSwapchainExtensionName) == 0; });
+		}
+	}
+
 	void run() {
 		initWindow();
 		initVulkan();
 		mainLoop();
 		cleanup();
 	}
+
+	//renders config.warmupFrames untimed frames followed by config.benchmarkFrames timed ones
+	FrameTimings runBenchmark() {
+		initWindow();
+		initVulkan();
+		FrameTimings timings = timeFrames();
+		cleanup();
+		return timings;
+	}
+
+	//same as runBenchmark() but repeated for each instance count without tearing the device down in between
+	std::vector<std::pair<uint32_t, FrameTimings>> runInstanceSweep(const std::vector<uint32_t>& instanceCounts) {
+		initWindow();
+		initVulkan();
+		std::vector<std::pair<uint32_t, FrameTimings>> results;
+		for (uint32_t count : instanceCounts) {
+			setInstanceCount(count);
+			results.emplace_back(count, timeFrames());
+		}
+		cleanup();
+		return results;
+	}
+
+	[[nodiscard]] uint32_t trianglesPerInstance() const { return static_cast<uint32_t>(indices.size() / 3); }
 private:
+	FrameTimings timeFrames() {
+		for (uint32_t i = 0; i < config.warmupFrames; i++) {
+			beginFrame();
+			drawFrame();
+		}
+		device.waitIdle();
+		collectFrameLatency(true);
+		framePacer->resetSamples();
+
+		FrameTimings timings;
+		timings.frameMs.reserve(config.benchmarkFrames);
+		timings.recordMs.reserve(config.benchmarkFrames);
+
+		auto start = std::chrono::steady_clock::now();
+		auto frameStart = start;
+		for (uint32_t i = 0; i < config.benchmarkFrames; i++) {
+			beginFrame();
+			if (window) {
+				glfwPollEvents();
+			}
+			drawFrame();
+			auto now = std::chrono::steady_clock::now();
+			timings.frameMs.push_back(std::chrono::duration<double, std::milli>(now - frameStart).count());
+			timings.recordMs.push_back(lastRecordMs);
+			frameStart = now;
+		}
+		device.waitIdle();
+		timings.totalSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+		collectFrameLatency(true);
+		timings.latencyMs = framePacer->samples();
+		return timings;
+	}
+
+	AppConfig config;
 	GLFWwindow* window = nullptr;
 
 	vk::raii::Context context;
@@ -70,24 +224,149 @@ private:
 
 	vk::raii::Queue graphicsQueue = nullptr;
 	vk::raii::Queue presentQueue = nullptr;
+	//these are the graphics queue again when the device has no separate family for them
+	vk::raii::Queue transferQueue = nullptr;
+	vk::raii::Queue computeQueue = nullptr;
 
 	vk::raii::SwapchainKHR swapChain = nullptr;
 	std::vector<vk::Image> swapChainImages;
 	vk::Format swapChainImageFormat = vk::Format::eUndefined;
 	vk::Extent2D swapChainExtent;
+	//what the scene is drawn at this frame, swapChainExtent unless dynamic resolution scaled it down
+	vk::Extent2D renderExtent;
 	std::vector<vk::raii::ImageView> swapChainImageViews;
+	bool framebufferResized = false;
+	//picked once by chooseAttachmentFormats(), the pipeline and secondary inheritance bake both in. The depth and
+	//multisampled color images themselves are render graph transients.
+	vk::Format depthFormat = vk::Format::eUndefined;
+	vk::SampleCountFlagBits msaaSamples = vk::SampleCountFlagBits::e1;
+
+
+	//headless mode renders into these instead of swapchain images, swapChainImages holds their raw handles
+	//so the rest of the frame code does not care which one it is drawing into
+	std::vector<vk::raii::Image> offscreenImages;
+	std::vector<vk::raii::DeviceMemory> offscreenImageMemory;
 
 	vk::raii::PipelineLayout pipelineLayout = nullptr;
-	vk::raii::Pipeline graphicsPipeline = nullptr;
+	//every graphics pipeline variant of the current shader, the frame draws with pipelineKey's
+	std::unique_ptr<PipelineStateCache> pipelineVariants;
+	PipelineKey pipelineKey;
+	//the hot reload thread reads pipelineKey, the render thread only changes it through setPipelineKey()
+	mutable std::mutex pipelineKeyMutex;
+	std::unique_ptr<PersistentPipelineCache> pipelineCache;
+	std::unique_ptr<AssetLoader> assets;	//--assets archive first, loose files in --shader-dir otherwise
+	//declared after everything buildGraphicsPipeline() reads so its thread is joined before they go away
+	std::unique_ptr<ShaderReloader> shaderReloader;
+
+	StartupTimings startupTimings;
+	bool firstFrameReported = false;
+
+	//declared after the device so it is destroyed before it, and before the buffers below so they go first
+	std::unique_ptr<GpuAllocator> allocator;
+	std::unique_ptr<StagingRing> stagingRing;
+	//upload submissions signal increasing values on their own timeline (they can land on either the transfer or graphics
+	//queue), uploadTag is the last one and doubles as the staging ring tag so stagingRing->retire() takes it directly
+	vk::raii::Semaphore uploadTimeline = nullptr;
+	uint64_t uploadTag = 0;
+	GpuBuffer vertexBuffer;
+	GpuBuffer indexBuffer;
+	GpuBuffer instanceBuffer;
+	uint32_t instanceCount = 0;
+
+	//--animate: the instances live in a SceneStore, every row of the grid hangs off its first instance and the rows
+	//sway. The whole hierarchy is recomputed each frame on sceneJobs, straight into the frame slot's mapped instance
+	//buffer (one per slot, the slot's timeline wait is what makes rewriting it safe).
+	bool animateScene = false;
+	std::unique_ptr<SceneStore> scene;
+	std::vector<std::pair<uint32_t, float>> sceneRoots;	//id and resting rotation of every row
+	JobSystem* sceneJobs = nullptr;				//the recording pool when there is one, else ownSceneJobs
+	std::unique_ptr<JobSystem> ownSceneJobs;
+	FrameArena frameArena;
+	std::vector<GpuBuffer> sceneInstanceBuffers;		//[frame slot]
+	double sceneUpdateMs = 0.0;
+	uint64_t sceneUpdates = 0;
+
+	//Textures and materials: set 0 is the bindless table every draw uses, texture 0 is a 1x1 white default that
+	//materials point at until the streamed texture is resident
+	static constexpr vk::DeviceSize TEXTURE_STAGING_SIZE = 64ull * 1024 * 1024;
+	static constexpr uint32_t MAX_BINDLESS_TEXTURES = 4096;
+	static constexpr uint32_t NO_TEXTURE = UINT32_MAX;
+	vk::raii::Sampler textureSampler = nullptr;
+	GpuImage defaultTexture;
+	vk::raii::ImageView defaultTextureView = nullptr;
+	std::unique_ptr<BindlessTable> bindless;	//after the sampler and views its descriptors point at
+	uint32_t defaultTextureIndex = 0;
+	std::unique_ptr<TextureStreamer> textureStreamer;	//only with --texture
+	uint32_t textureId = 0;
+	uint32_t streamedTextureIndex = NO_TEXTURE;	//bindless index once resident
+
+	//Set 1: camera and time for the frame, written into the uniform ring every frame and bound with a dynamic offset.
+	//Per draw data goes in push constants (DrawConstants).
+	static constexpr vk::DeviceSize UNIFORM_RING_SIZE = 64 * 1024;
+	std::unique_ptr<UniformRing> frameUniforms;
+	uint32_t frameUniformOffset = 0;	//this frame's slice, read by bindDrawState() on every recording thread
+
+	//--capture: every frame is copied into a readback slot after the draw and written out by a worker thread once
+	//the timeline says it is done
+	std::unique_ptr<FrameCapture> frameCapture;
+
+	//Replaced resources wait here until the frame timeline passes the last frame that could use them. Declared after
+	//the allocator so retired buffers are freed before it.
+	DeletionQueue deletionQueue;
+	//rebuilt every frame by buildFrameGraph(), only its transient images persist. After the deletion queue it retires into.
+	std::unique_ptr<RenderGraph> renderGraph;
+
+	//gpu driven path, null unless --gpu-culling was asked for. Everything visible goes out in one instanced indirect draw.
+	std::unique_ptr<GpuCuller> culler;
+	uint32_t lastVisibleCount = 0;
+	glm::mat4 viewProj{ 1.0f };	//no camera yet, identity keeps the culling frustum equal to the screen
+
+	//multithreaded recording, one command pool + secondary buffer per worker per frame slot so workers never
+	//share a pool (pools are externally synchronized). Pool is declared first so the buffer is freed before it.
+	struct WorkerCommandContext {
+		vk::raii::CommandPool pool = nullptr;
+		vk::raii::CommandBuffer commandBuffer = nullptr;
+	};
+	std::unique_ptr<JobSystem> jobSystem;
+	std::vector<std::vector<WorkerCommandContext>> workerContexts;	//[frame slot][worker]
 
 	vk::raii::CommandPool commandPool = nullptr;
-	vk::raii::CommandBuffer commandBuffer = nullptr;
+	vk::raii::CommandPool transferCommandPool = nullptr;
+	std::vector<vk::raii::CommandBuffer> commandBuffers;
 	uint32_t graphicsIndex = 0;
+	uint32_t transferIndex = 0;
+	uint32_t computeIndex = 0;
 
+	//each frame slot gets its own command buffer and acquire semaphore so the cpu can record
+	//frame N+1 while the gpu is still chewing on frame N
 	static constexpr int MAX_FRAMES_IN_FLIGHT = 2;
-	vk::raii::Semaphore presentCompleteSemaphore = nullptr;
-	vk::raii::Semaphore renderFinishedSemaphore = nullptr;
-	vk::raii::Fence drawFence = nullptr;
+	//two beyond the frames in flight give the capture sink a frame of slack before frames get dropped
+	static constexpr uint32_t CAPTURE_SLOTS = MAX_FRAMES_IN_FLIGHT + 2;
+	static constexpr vk::DeviceSize STAGING_RING_SIZE = 16ull * 1024 * 1024;
+	static constexpr uint64_t PRESENT_WAIT_TIMEOUT_NS = 100'000'000;
+	std::vector<vk::raii::Semaphore> presentCompleteSemaphores;
+	//render finished is indexed by swapchain image instead of frame slot since present has no fence
+	//to tell us when it is done with the semaphore, reacquiring the same image is what guarantees that
+	std::vector<vk::raii::Semaphore> renderFinishedSemaphores;
+	//Frame N's submission signals value N + 1, so the counter value is the number of frames the gpu has
+	//finished. It replaces the per slot fences and is what anything recycled per frame should key off.
+	vk::raii::Semaphore frameTimeline = nullptr;
+	uint64_t frameTimelineValue = 0;	//last value submitted
+	std::array<uint64_t, MAX_FRAMES_IN_FLIGHT> slotTimelineValues{};	//value each slot's last frame signals
+	uint32_t currentFrame = 0;
+	double lastRecordMs = 0.0;
+
+	//only created with --profile/--trace, everything checks for null so it costs nothing otherwise
+	std::unique_ptr<GpuProfiler> profiler;
+	//only with --dynamic-resolution, then the scene is drawn into its own image and blitted up to the target
+	std::unique_ptr<DynamicResolution> dynamicResolution;
+
+	//always there, it measures latency even when it does not pace
+	std::unique_ptr<FramePacer> framePacer;
+	//VK_KHR_present_id + VK_KHR_present_wait, every present carries its frame timeline value as id so the pacer
+	//can wait for a frame to actually be shown. Without it completions are taken from the frame timeline.
+	bool presentWaitEnabled = false;
+	uint64_t lastPresentId = 0;	//last id presented to the current swapchain, 0 until its first present
 
 	std::vector<const char*> deviceExtensions = {
 		vk::KHRSwapchainExtensionName,
@@ -97,59 +376,185 @@ private:
 	};
 
 	void initWindow() {
+		if (config.headless) {
+			return;
+		}
 		glfwInit();
 
 		glfwWindowHint(GLFW_CLIENT_API, GLFW_NO_API);
-		glfwWindowHint(GLFW_RESIZABLE,GLFW_FALSE);
+		glfwWindowHint(GLFW_RESIZABLE,GLFW_TRUE);
+
+		window = glfwCreateWindow(static_cast<int>(config.width), static_cast<int>(config.height), "Vulkan", nullptr, nullptr);
+		glfwSetWindowUserPointer(window, this);
+		glfwSetFramebufferSizeCallback(window, framebufferResizeCallback);
+	}
 
-		window = glfwCreateWindow(WIDTH, HEIGHT, "Vulkan", nullptr, nullptr);
+	//some platforms never report out of date on resize, so the flag is what guarantees a recreate
+	static void framebufferResizeCallback(GLFWwindow* window, int, int) {
+		auto app = static_cast<HelloTriangleApplication*>(glfwGetWindowUserPointer(window));
+		app->framebufferResized = true;
 	}
 	void initVulkan() {
 		createInstance();	
+		startupTimings.mark("instance");
 		//this should be `setupDebugMessenger();`
 		createSurface();
 		pickPhysicalDevice();
 		createLogicalDevice();
-		createSwapChain();
+		startupTimings.mark("device");
+		if (config.headless) {
+			createOffscreenTargets();
+		} else {
+			createSwapChain();
+		}
 		createImageViews();
+		chooseAttachmentFormats();
+		startupTimings.mark("swapchain");
+		createPipelineCache();
+		createAssetLoader();
+		createAllocator();
+		createBindlessTable();
+		createFrameUniforms();
 		createGraphicsPipeline();
+		startupTimings.mark("pipeline");
 		createCommandPool();
-		createCommandBuffer();
+		createGeometryBuffers();
+		createTextures();
+		createCuller();
+		createRenderGraph();
+		createCommandBuffers();
+		createWorkerCommandContexts();
+		createSceneJobs();
 		createSyncObjects();
+		createFramePacer();
+		createFrameCapture();
+		createProfiler();
+		createDynamicResolution();
+		createShaderReloader();
+	}
+
+	//Scores a device for this app, 0 means it can't run it at all (no 1.3, no graphics queue, missing extensions,
+	//no descriptor indexing or no way to present). Device type dominates, then vram, then optional features as a tie breaker.
+	uint64_t scorePhysicalDevice(const vk::raii::PhysicalDevice& candidate) const {
+		auto properties = candidate.getProperties();
+		if (properties.apiVersion < VK_API_VERSION_1_3) {
+			return 0;
+		}
+
+		auto queueFamilies = candidate.getQueueFamilyProperties();
+		bool hasGraphics = std::ranges::any_of(queueFamilies, [](vk::QueueFamilyProperties const& qfp)
+				{ return static_cast<bool>(qfp.queueFlags & vk::QueueFlagBits::eGraphics); });
+		if (!hasGraphics) {
+			return 0;
+		}
+
+		auto extensions = candidate.enumerateDeviceExtensionProperties();
+		for (auto const& extension : deviceExtensions) {
+			bool found = std::ranges::any_of(extensions, [extension](auto const& ext)
+					{ return strcmp(ext.extensionName, extension) == 0; });
+			if (!found) {
+				return 0;
+			}
+		}
+
+		auto features = candidate.getFeatures2<vk::PhysicalDeviceFeatures2, vk::PhysicalDeviceVulkan12Features>();
+		const auto& core = features.get<vk::PhysicalDeviceFeatures2>().features;
+		const auto& vulkan12 = features.get<vk::PhysicalDeviceVulkan12Features>();
+		if (!supportsBindless(vulkan12)) {
+			return 0;
+		}
+
+		if (!config.headless) {
+			bool canPresent = false;
+			for (uint32_t i = 0; i < queueFamilies.size() && !canPresent; i++) {
+				canPresent = candidate.getSurfaceSupportKHR(i, *surface);
+			}
+			if (!canPresent) {
+				return 0;
+			}
+		}
+
+		uint64_t score = 0;
+		switch (properties.deviceType) {
+			case vk::PhysicalDeviceType::eDiscreteGpu:	score += 1'000'000'000; break;
+			case vk::PhysicalDeviceType::eIntegratedGpu:	score += 100'000'000; break;
+			case vk::PhysicalDeviceType::eVirtualGpu:	score += 10'000'000; break;
+			case vk::PhysicalDeviceType::eCpu:		score += 1'000'000; break;
+			default: break;
+		}
+
+		//largest device local heap in MiB, capped at 64GiB so it can't outweigh the device type
+		auto memoryProperties = candidate.getMemoryProperties();
+		vk::DeviceSize deviceLocalMiB = 0;
+		for (uint32_t i = 0; i < memoryProperties.memoryHeapCount; i++) {
+			if (memoryProperties.memoryHeaps[i].flags & vk::MemoryHeapFlagBits::eDeviceLocal) {
+				deviceLocalMiB = std::max(deviceLocalMiB, memoryProperties.memoryHeaps[i].size >> 20);
+			}
+		}
+		score += std::min<vk::DeviceSize>(deviceLocalMiB, 64 * 1024);
+
+		//features the optional paths use
+		if (core.pipelineStatisticsQuery) score += 1000;
+
+		//a separate transfer family means uploads don't queue behind rendering
+		bool dedicatedTransfer = std::ranges::any_of(queueFamilies, [](vk::QueueFamilyProperties const& qfp)
+				{ return (qfp.queueFlags & vk::QueueFlagBits::eTransfer) && !(qfp.queueFlags & vk::QueueFlagBits::eGraphics); });
+		if (dedicatedTransfer) score += 1000;
+		return score;
+	}
+
+	//everything BindlessTable's layout and the fragment shader's material/texture indexing need
+	static bool supportsBindless(const vk::PhysicalDeviceVulkan12Features& features) {
+		return features.runtimeDescriptorArray && features.descriptorBindingPartiallyBound &&
+		       features.descriptorBindingVariableDescriptorCount && features.descriptorBindingSampledImageUpdateAfterBind &&
+		       features.descriptorBindingUpdateUnusedWhilePending && features.shaderSampledImageArrayNonUniformIndexing;
 	}
 
-	//This function picks which GPU to use if more than one is found, currently just grabs first one
-	//I should setup some form of evaluation system based on what features are needed to determine which card to use
+	//Picks the highest scoring device, --device overrides that with an enumeration index or a name substring
 	void pickPhysicalDevice(){
 		auto devices = instance.enumeratePhysicalDevices();
-	
-		const auto devIter = std::ranges::find_if(devices,
-    		[&](auto const & device) {
-        		auto queueFamilies = device.getQueueFamilyProperties();
-        		bool isSuitable = device.getProperties().apiVersion >= VK_API_VERSION_1_3;
-			const auto qfpIter = std::ranges::find_if(queueFamilies,
-            		[]( vk::QueueFamilyProperties const & qfp )
-                    		{
-                        		return (qfp.queueFlags & vk::QueueFlagBits::eGraphics) != static_cast<vk::QueueFlags>(0);
-                    		} );
-            		isSuitable = isSuitable && ( qfpIter != queueFamilies.end() );
-            		auto extensions = device.enumerateDeviceExtensionProperties( );
-            		bool found = true;
-            		for (auto const & extension : deviceExtensions) {
-                		auto extensionIter = std::ranges::find_if(extensions, [extension](auto const & ext) 
-						{return strcmp(ext.extensionName, extension) == 0;});
-                		found = found &&  extensionIter != extensions.end();
-            		}
-            		isSuitable = isSuitable && found;
-            		printf("\n");
-            		if (isSuitable) {
-               		 	physicalDevice = device;
-            		}
-            		return isSuitable;
-    		});
-    		if (devIter == devices.end()) {
-        		throw std::runtime_error("failed to find a suitable GPU!");
-    		}
+
+		std::vector<uint64_t> scores;
+		for (uint32_t i = 0; i < devices.size(); i++) {
+			scores.push_back(scorePhysicalDevice(devices[i]));
+			std::cout << "[device] " << i << ": " << devices[i].getProperties().deviceName.data()
+				  << " score=" << scores.back() << (scores.back() == 0 ? " (unsuitable)" : "") << "\n";
+		}
+
+		size_t chosen = devices.size();
+		if (!config.device.empty()) {
+			bool isIndex = std::ranges::all_of(config.device, [](char c) { return std::isdigit(static_cast<unsigned char>(c)) != 0; });
+			for (size_t i = 0; i < devices.size() && chosen == devices.size(); i++) {
+				std::string name = devices[i].getProperties().deviceName.data();
+				bool matches = isIndex ? std::to_string(i) == config.device : containsIgnoreCase(name, config.device);
+				if (matches) {
+					chosen = i;
+				}
+			}
+			if (chosen == devices.size()) {
+				throw std::runtime_error("no gpu matches --device " + config.device);
+			}
+			if (scores[chosen] == 0) {
+				throw std::runtime_error("gpu selected with --device is missing required features");
+			}
+		} else {
+			auto best = std::ranges::max_element(scores);
+			if (best == scores.end() || *best == 0) {
+				throw std::runtime_error("failed to find a suitable GPU!");
+			}
+			chosen = static_cast<size_t>(std::distance(scores.begin(), best));
+		}
+
+		physicalDevice = devices[chosen];
+		std::cout << "[device] using " << physicalDevice.getProperties().deviceName.data() << "\n";
+	}
+
+	static bool containsIgnoreCase(const std::string& haystack, const std::string& needle) {
+		auto lower = [](std::string text) {
+			std::ranges::transform(text, text.begin(), [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+			return text;
+		};
+		return lower(haystack).find(lower(needle)) != std::string::npos;
 	}
 
 	void createLogicalDevice(){
@@ -159,9 +564,10 @@ private:
 				{ return (qfp.queueFlags & vk::QueueFlagBits::eGraphics) != static_cast<vk::QueueFlags>(0); } );
 		assert(graphicsQueueFamilyProperties != queueFamilyProperties.end() && "No graphics queue family found!");
 
-		auto graphicsIndex = static_cast<uint32_t>( std::distance( queueFamilyProperties.begin(), graphicsQueueFamilyProperties ) );
+		graphicsIndex = static_cast<uint32_t>( std::distance( queueFamilyProperties.begin(), graphicsQueueFamilyProperties ) );
 
-		auto presentIndex = physicalDevice.getSurfaceSupportKHR( graphicsIndex, *surface ) 
+		//headless never presents so the graphics queue doubles as the "present" queue
+		auto presentIndex = config.headless || physicalDevice.getSurfaceSupportKHR( graphicsIndex, *surface ) 
 							? graphicsIndex 
 							: static_cast<uint32_t>( queueFamilyProperties.size() );
 
@@ -194,37 +600,114 @@ private:
 			throw std::runtime_error( "Could not find a queue for graphics or present -> terminating" );
 		}
 
-		std::vector<vk::SurfaceFormatKHR> availableFormats = physicalDevice.getSurfaceFormatsKHR( surface );
-
-		std::vector<vk::PresentModeKHR> availablePresentModes = physicalDevice.getSurfacePresentModesKHR( surface );
-
-		vk::StructureChain<vk::PhysicalDeviceFeatures2, vk::PhysicalDeviceVulkan13Features,
-			vk::PhysicalDeviceExtendedDynamicStateFeaturesEXT> featureChain = {
+		vk::StructureChain<vk::PhysicalDeviceFeatures2, vk::PhysicalDeviceVulkan12Features, vk::PhysicalDeviceVulkan13Features,
+			vk::PhysicalDeviceExtendedDynamicStateFeaturesEXT, vk::PhysicalDevicePresentIdFeaturesKHR,
+			vk::PhysicalDevicePresentWaitFeaturesKHR> featureChain = {
     				{},                                  // vk::PhysicalDeviceFeatures2 (empty for now)
+    				{.shaderSampledImageArrayNonUniformIndexing = true,	// bindless texture table
+				 .descriptorBindingSampledImageUpdateAfterBind = true,
+				 .descriptorBindingUpdateUnusedWhilePending = true,
+				 .descriptorBindingPartiallyBound = true,
+				 .descriptorBindingVariableDescriptorCount = true,
+				 .runtimeDescriptorArray = true,
+				 .timelineSemaphore = true },        // frame/upload progress tracking, more filled in below as needed
     				{.synchronization2 = true,
 				 .dynamicRendering = true },	     // Enable dynamic rendering from Vulkan 1.3 
-    				{.extendedDynamicState = true } };   // Enable extended dynamic state from the extension
+    				{.extendedDynamicState = true },     // Enable extended dynamic state from the extension
+				{.presentId = true },		     // frame pacing, unlinked below when unsupported
+				{.presentWait = true } };
+
+		//present wait is optional, latency falls back to gpu completion without it
+		presentWaitEnabled = !config.headless && supportsPresentWait();
+		if (presentWaitEnabled) {
+			deviceExtensions.push_back(vk::KHRPresentIdExtensionName);
+			deviceExtensions.push_back(vk::KHRPresentWaitExtensionName);
+		} else {
+			featureChain.unlink<vk::PhysicalDevicePresentIdFeaturesKHR>();
+			featureChain.unlink<vk::PhysicalDevicePresentWaitFeaturesKHR>();
+		}
 
-		//this arg will set the priority for the queue
-		float queuePriority = 0.0f;
-		vk::DeviceQueueCreateInfo deviceQueueCreateInfo { 
-			.queueFamilyIndex 	=  graphicsIndex,
-			.queueCount 	  	=  1,
-			.pQueuePriorities 	=  &queuePriority };
+		//pipeline statistics are optional, the profiler just skips them when the device can't do them
+		if (config.profile && physicalDevice.getFeatures().pipelineStatisticsQuery) {
+			featureChain.get<vk::PhysicalDeviceFeatures2>().features.pipelineStatisticsQuery = true;
+		}
+
+		//async families are optional, anything missing just shares the graphics queue
+		transferIndex = findQueueFamily(queueFamilyProperties, vk::QueueFlagBits::eTransfer,
+				vk::QueueFlagBits::eGraphics | vk::QueueFlagBits::eCompute);
+		if (transferIndex == queueFamilyProperties.size()) {
+			transferIndex = findQueueFamily(queueFamilyProperties, vk::QueueFlagBits::eTransfer, vk::QueueFlagBits::eGraphics);
+		}
+		computeIndex = findQueueFamily(queueFamilyProperties, vk::QueueFlagBits::eCompute, vk::QueueFlagBits::eGraphics);
+		if (transferIndex == queueFamilyProperties.size()) {
+			transferIndex = graphicsIndex;
+		}
+		if (computeIndex == queueFamilyProperties.size()) {
+			computeIndex = graphicsIndex;
+		}
+
+		//one queue per unique family, graphics gets the highest priority since it is what the frame waits on
+		std::vector<uint32_t> families = { graphicsIndex };
+		for (uint32_t family : { presentIndex, transferIndex, computeIndex }) {
+			if (std::ranges::find(families, family) == families.end()) {
+				families.push_back(family);
+			}
+		}
+		float graphicsPriority = 1.0f;
+		float asyncPriority = 0.5f;
+		std::vector<vk::DeviceQueueCreateInfo> queueCreateInfos;
+		for (uint32_t family : families) {
+			queueCreateInfos.push_back(vk::DeviceQueueCreateInfo{
+				.queueFamilyIndex 	=  family,
+				.queueCount 	  	=  1,
+				.pQueuePriorities 	=  family == graphicsIndex ? &graphicsPriority : &asyncPriority });
+		}
 
 		vk::DeviceCreateInfo deviceCreateInfo{
 			.pNext = &featureChain.get<vk::PhysicalDeviceFeatures2>(),
-			.queueCreateInfoCount = 1,
-			.pQueueCreateInfos = &deviceQueueCreateInfo,
+			.queueCreateInfoCount = static_cast<uint32_t>(queueCreateInfos.size()),
+			.pQueueCreateInfos = queueCreateInfos.data(),
 			.enabledExtensionCount = static_cast<uint32_t>(deviceExtensions.size()),
 			.ppEnabledExtensionNames = deviceExtensions.data() };
 
 		device = vk::raii::Device( physicalDevice, deviceCreateInfo );
 		graphicsQueue = vk::raii::Queue( device, graphicsIndex, 0);
 		presentQueue = vk::raii::Queue( device, presentIndex, 0 );
+		transferQueue = vk::raii::Queue( device, transferIndex, 0 );
+		computeQueue = vk::raii::Queue( device, computeIndex, 0 );
+		std::cout << "[device] queue families graphics=" << graphicsIndex << " present=" << presentIndex
+			  << " transfer=" << transferIndex << " compute=" << computeIndex << "\n";
+	}
+
+	bool supportsPresentWait() const {
+		auto extensions = physicalDevice.enumerateDeviceExtensionProperties();
+		for (const char* name : { vk::KHRPresentIdExtensionName, vk::KHRPresentWaitExtensionName }) {
+			if (std::ranges::none_of(extensions, [name](auto const& ext) { return strcmp(ext.extensionName, name) == 0; })) {
+				return false;
+			}
+		}
+		//the feature structs may only be queried once the extensions are known to exist
+		auto features = physicalDevice.getFeatures2<vk::PhysicalDeviceFeatures2, vk::PhysicalDevicePresentIdFeaturesKHR,
+			vk::PhysicalDevicePresentWaitFeaturesKHR>();
+		return features.get<vk::PhysicalDevicePresentIdFeaturesKHR>().presentId &&
+		       features.get<vk::PhysicalDevicePresentWaitFeaturesKHR>().presentWait;
+	}
+
+	//first family that has all of the wanted flags and none of the excluded ones, size() if there is none
+	static uint32_t findQueueFamily(const std::vector<vk::QueueFamilyProperties>& families, vk::QueueFlags wanted,
+			vk::QueueFlags excluded) {
+		for (uint32_t i = 0; i < families.size(); i++) {
+			if ((families[i].queueFlags & wanted) == wanted && !(families[i].queueFlags & excluded)) {
+				return i;
+			}
+		}
+		return static_cast<uint32_t>(families.size());
 	}
 
 	void createSurface(){
+		if (config.headless) {
+			return;
+		}
 		VkSurfaceKHR	_surface;
 		if(glfwCreateWindowSurface(*instance, window, nullptr, &_surface) != 0){
 			throw std::runtime_error("failed to create window surface");
@@ -265,7 +748,8 @@ private:
 
 		uint32_t glfwExtensionCount = 0;
 
-		auto glfwExtensions = glfwGetRequiredInstanceExtensions( &glfwExtensionCount );
+		//headless never initializes glfw so there are no window system extensions to ask for
+		const char** glfwExtensions = config.headless ? nullptr : glfwGetRequiredInstanceExtensions( &glfwExtensionCount );
 		auto extensionProperties = context.enumerateInstanceExtensionProperties();
 
 		//not really sure icl
@@ -313,6 +797,22 @@ private:
 		minImageCount = ( surfaceCapabilities.maxImageCount > 0 && minImageCount > surfaceCapabilities.maxImageCount ) ?
 				surfaceCapabilities.maxImageCount : minImageCount;
 
+		vk::ImageUsageFlags imageUsage = vk::ImageUsageFlagBits::eColorAttachment;
+		if (!config.capturePath.empty()) {
+			//the readback copies straight out of the swapchain image
+			if (!(surfaceCapabilities.supportedUsageFlags & vk::ImageUsageFlagBits::eTransferSrc)) {
+				throw std::runtime_error("--capture needs swapchain images that can be copied from, this surface has none");
+			}
+			imageUsage |= vk::ImageUsageFlagBits::eTransferSrc;
+		}
+		if (config.dynamicResolutionFps > 0) {
+			//the scaled scene is blitted into it
+			if (!(surfaceCapabilities.supportedUsageFlags & vk::ImageUsageFlagBits::eTransferDst)) {
+				throw std::runtime_error("--dynamic-resolution needs swapchain images that can be blitted to, this surface has none");
+			}
+			imageUsage |= vk::ImageUsageFlagBits::eTransferDst;
+		}
+
 		vk::SwapchainCreateInfoKHR swapChainCreateInfo{
 			.flags = vk::SwapchainCreateFlagsKHR(),
 			.surface = surface,
@@ -321,17 +821,126 @@ private:
 			.imageColorSpace = vk::ColorSpaceKHR::eSrgbNonlinear,
 			.imageExtent = swapChainExtent,
 			.imageArrayLayers = 1,
-			.imageUsage = vk::ImageUsageFlagBits::eColorAttachment,
+			.imageUsage = imageUsage,
 			.imageSharingMode = vk::SharingMode::eExclusive,
 			.preTransform = surfaceCapabilities.currentTransform, 
 			.compositeAlpha = vk::CompositeAlphaFlagBitsKHR::eOpaque,
 			.presentMode = chooseSwapPresentMode(physicalDevice.getSurfacePresentModesKHR( surface )),
 			.clipped = true,
-			.oldSwapchain = nullptr
+			.oldSwapchain = *swapChain	//null on first creation, lets the driver hand resources over on recreation
 		};
 
+		//Once waitForOldPresents() returns every frame up to frameTimelineValue is finished, so these go at the next
+		//collect(). The old swapchain still goes through the deletion queue since it has to outlive the creation of
+		//the new one. Views and semaphores are retired first so they are also destroyed first.
+		if (*swapChain) {
+			waitForOldPresents();
+			deletionQueue.retire(std::move(swapChainImageViews), frameTimelineValue);
+			deletionQueue.retire(std::move(renderFinishedSemaphores), frameTimelineValue);
+			deletionQueue.retire(std::move(swapChain), frameTimelineValue);
+			swapChainImageViews.clear();
+			renderFinishedSemaphores.clear();
+		}
 		swapChain = vk::raii::SwapchainKHR(device, swapChainCreateInfo );
+		lastPresentId = 0;
 		swapChainImages = swapChain.getImages();
+		std::cout << "[swapchain] " << swapChainExtent.width << "x" << swapChainExtent.height
+			  << " images=" << swapChainImages.size() << " present_mode=" << vk::to_string(swapChainCreateInfo.presentMode) << "\n";
+	}
+
+	//The frame timeline says nothing about presents, a frame can be done on the gpu while its present still waits on
+	//its renderFinished semaphore and reads the old swapchain. With present_wait, the last frame having been presented
+	//covers every earlier present (ids only grow) and every frame they waited on, and only costs until that present.
+	//Without it, or when it can't be waited on (the present failed, the swapchain is out of date, the window is
+	//hidden), the fallback is the present queue going idle, which drains the frames in flight with it. Present fences
+	//(VK_EXT_swapchain_maintenance1) would avoid that but aren't used here.
+	void waitForOldPresents() {
+		if (presentWaitEnabled && lastPresentId != 0 && lastPresentId == frameTimelineValue) {
+			try {
+				if (swapChain.waitForPresent(lastPresentId, PRESENT_WAIT_TIMEOUT_NS) != vk::Result::eTimeout) {
+					return;
+				}
+			} catch (const vk::OutOfDateKHRError&) {
+				//falls back to the idle below
+			}
+		}
+		presentQueue.waitIdle();
+	}
+
+	//Called when acquire/present report out of date or suboptimal, or the window was resized. Waits for the window
+	//to be non-zero sized and for the presents to the old swapchain to finish (see waitForOldPresents()).
+	void recreateSwapChain() {
+		int width = 0, height = 0;
+		glfwGetFramebufferSize(window, &width, &height);
+		while (width == 0 || height == 0) {
+			//minimized, there is nothing to present to until it comes back
+			glfwWaitEvents();
+			glfwGetFramebufferSize(window, &width, &height);
+		}
+		framebufferResized = false;
+		//presents to the old swapchain can't be waited for anymore
+		framePacer->discardPending();
+
+		vk::Format previousFormat = swapChainImageFormat;
+		createSwapChain();
+		createImageViews();
+		createRenderFinishedSemaphores();
+		if (swapChainImageFormat != previousFormat) {
+			//just another pipeline variant, the first lookup builds it. Secondaries inherit the format every frame.
+			PipelineKey key = pipelineKey;
+			key.colorFormat = swapChainImageFormat;
+			setPipelineKey(key);
+			if (frameCapture && !FrameCapture::supports(swapChainImageFormat)) {
+				throw std::runtime_error("--capture does not support the " + vk::to_string(swapChainImageFormat) + " surface format");
+			}
+			if (dynamicResolution) {
+				requireLinearBlit(swapChainImageFormat);
+			}
+		}
+	}
+
+	//Headless stand-in for createSwapChain(), one device-local image per frame slot so waiting on the slot's
+	//timeline value also protects its image
+	void createOffscreenTargets(){
+		swapChainImageFormat = vk::Format::eR8G8B8A8Unorm;
+		swapChainExtent = vk::Extent2D{ config.width, config.height };
+
+		offscreenImages.clear();
+		offscreenImageMemory.clear();
+		swapChainImages.clear();
+
+		vk::ImageCreateInfo imageInfo{
+			.imageType = vk::ImageType::e2D,
+			.format = swapChainImageFormat,
+			.extent = { swapChainExtent.width, swapChainExtent.height, 1 },
+			.mipLevels = 1,
+			.arrayLayers = 1,
+			.samples = vk::SampleCountFlagBits::e1,
+			.tiling = vk::ImageTiling::eOptimal,
+			.usage = vk::ImageUsageFlagBits::eColorAttachment | vk::ImageUsageFlagBits::eTransferSrc | vk::ImageUsageFlagBits::eTransferDst,
+			.sharingMode = vk::SharingMode::eExclusive,
+			.initialLayout = vk::ImageLayout::eUndefined };
+
+		for (uint32_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
+			auto& image = offscreenImages.emplace_back(device, imageInfo);
+			vk::MemoryRequirements memRequirements = image.getMemoryRequirements();
+			vk::MemoryAllocateInfo allocInfo{
+				.allocationSize = memRequirements.size,
+				.memoryTypeIndex = findMemoryType(memRequirements.memoryTypeBits, vk::MemoryPropertyFlagBits::eDeviceLocal) };
+			auto& memory = offscreenImageMemory.emplace_back(device, allocInfo);
+			image.bindMemory(*memory, 0);
+			swapChainImages.push_back(*image);
+		}
+	}
+
+	uint32_t findMemoryType(uint32_t typeFilter, vk::MemoryPropertyFlags properties) {
+		vk::PhysicalDeviceMemoryProperties memProperties = physicalDevice.getMemoryProperties();
+		for (uint32_t i = 0; i < memProperties.memoryTypeCount; i++) {
+			if ((typeFilter & (1u << i)) && (memProperties.memoryTypes[i].propertyFlags & properties) == properties) {
+				return i;
+			}
+		}
+		throw std::runtime_error("failed to find suitable memory type!");
 	}
 
 	void createImageViews(){
@@ -348,18 +957,99 @@ private:
 		}
 	}
 
+	//Depth format with optimal tiling attachment support, and the highest sample count up to --msaa that both color
+	//and depth attachments can use
+	void chooseAttachmentFormats() {
+		for (vk::Format format : { vk::Format::eD32Sfloat, vk::Format::eD32SfloatS8Uint, vk::Format::eD24UnormS8Uint }) {
+			if (physicalDevice.getFormatProperties(format).optimalTilingFeatures & vk::FormatFeatureFlagBits::eDepthStencilAttachment) {
+				depthFormat = format;
+				break;
+			}
+		}
+		if (depthFormat == vk::Format::eUndefined) {
+			throw std::runtime_error("no supported depth attachment format");
+		}
+
+		const vk::PhysicalDeviceLimits& limits = physicalDevice.getProperties().limits;
+		vk::SampleCountFlags supported = limits.framebufferColorSampleCounts & limits.framebufferDepthSampleCounts;
+		msaaSamples = vk::SampleCountFlagBits::e1;
+		for (uint32_t samples = 2; samples <= config.msaaSamples; samples *= 2) {
+			if (supported & static_cast<vk::SampleCountFlagBits>(samples)) {
+				msaaSamples = static_cast<vk::SampleCountFlagBits>(samples);
+			}
+		}
+		std::cout << "[attachments] depth " << vk::to_string(depthFormat) << ", "
+			  << static_cast<uint32_t>(msaaSamples) << "x msaa\n";
+	}
+
+	static vk::ImageAspectFlags depthAspect(vk::Format format) {
+		return format == vk::Format::eD32Sfloat ? vk::ImageAspectFlags(vk::ImageAspectFlagBits::eDepth)
+			: vk::ImageAspectFlagBits::eDepth | vk::ImageAspectFlagBits::eStencil;
+	}
+
 	void createGraphicsPipeline() {
-		vk::raii::ShaderModule shaderModule = createShaderModule(readFile("../shaders/slang.spv"));
+		std::array setLayouts = { bindless->layout(), frameUniforms->layout() };
+		vk::PushConstantRange pushConstantRange{
+			.stageFlags = vk::ShaderStageFlagBits::eVertex,
+			.offset = 0,
+			.size = sizeof(DrawConstants) };
+		vk::PipelineLayoutCreateInfo pipelineLayoutInfo{
+			.setLayoutCount = static_cast<uint32_t>(setLayouts.size()),
+			.pSetLayouts = setLayouts.data(),
+			.pushConstantRangeCount = 1,
+			.pPushConstantRanges = &pushConstantRange };
+
+		pipelineLayout = vk::raii::PipelineLayout( device, pipelineLayoutInfo );
+
+		setPipelineKey(PipelineKey{
+			.colorFormat = swapChainImageFormat,
+			.depthFormat = depthFormat,
+			.samples = msaaSamples,
+			.topology = vk::PrimitiveTopology::eTriangleList,
+			.cullMode = vk::CullModeFlagBits::eNone, //was originally eBack, but wasnt working
+			.blend = false,
+			//without --texture every material samples the 1x1 white default, so leave the sample out entirely
+			.textured = !config.texturePath.empty(),
+			.spin = config.spinDegrees != 0 });
+
+		auto pipelineStart = std::chrono::steady_clock::now();
+		Asset shader = assets->load("slang.spv");
+		pipelineVariants = createPipelineVariants(spirvWords(shader.bytes));
+		//built here rather than by the first frame's lookup
+		(void)pipelineVariants->get(pipelineKey);
+		startupTimings.pipelineMs += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - pipelineStart).count();
+	}
+
+	//One cache per version of the shader, the module lives as long as the build function that uses it
+	[[nodiscard]] std::unique_ptr<PipelineStateCache> createPipelineVariants(std::span<const uint32_t> spirv) const {
+		auto shaderModule = std::make_shared<vk::raii::ShaderModule>(createShaderModule(spirv));
+		return std::make_unique<PipelineStateCache>([this, shaderModule](const PipelineKey& key) {
+			return buildGraphicsPipeline(*shaderModule, key);
+		});
+	}
+
+	//Only reads state that is fixed after startup, so the hot reload thread can call it while frames are being recorded.
+	//Formats and samples come from the key since swapchain recreation rewrites them on the render thread.
+	[[nodiscard]] vk::raii::Pipeline buildGraphicsPipeline(const vk::raii::ShaderModule& shaderModule, const PipelineKey& key) const {
+		ShaderSpecialization constants(key);
+		auto mapEntries = ShaderSpecialization::mapEntries();
+		vk::SpecializationInfo specialization{
+			.mapEntryCount = static_cast<uint32_t>(mapEntries.size()),
+			.pMapEntries = mapEntries.data(),
+			.dataSize = sizeof(constants),
+			.pData = &constants };
 
 		vk::PipelineShaderStageCreateInfo vertShaderStageInfo{
 			.stage = vk::ShaderStageFlagBits::eVertex,
 			.module = shaderModule, 
-			.pName = "vertMain" };
+			.pName = "vertMain",
+			.pSpecializationInfo = &specialization };
 
 		vk::PipelineShaderStageCreateInfo fragShaderStageInfo{
 			.stage = vk::ShaderStageFlagBits::eFragment,
 			.module = shaderModule,
-			.pName = "fragMain" };
+			.pName = "fragMain",
+			.pSpecializationInfo = &specialization };
 
 		vk::PipelineShaderStageCreateInfo shaderStages[] = {vertShaderStageInfo, fragShaderStageInfo};
 
@@ -372,9 +1062,17 @@ private:
 			.pDynamicStates = dynamicStates.data() 
 		};
 
-		vk::PipelineVertexInputStateCreateInfo vertexInputInfo;
+		std::array bindingDescriptions = { Vertex::getBindingDescription(), InstanceData::getBindingDescription() };
+		std::vector<vk::VertexInputAttributeDescription> attributeDescriptions;
+		std::ranges::copy(Vertex::getAttributeDescriptions(), std::back_inserter(attributeDescriptions));
+		std::ranges::copy(InstanceData::getAttributeDescriptions(), std::back_inserter(attributeDescriptions));
+		vk::PipelineVertexInputStateCreateInfo vertexInputInfo{
+			.vertexBindingDescriptionCount = static_cast<uint32_t>(bindingDescriptions.size()),
+			.pVertexBindingDescriptions = bindingDescriptions.data(),
+			.vertexAttributeDescriptionCount = static_cast<uint32_t>(attributeDescriptions.size()),
+			.pVertexAttributeDescriptions = attributeDescriptions.data() };
 		vk::PipelineInputAssemblyStateCreateInfo inputAssembly{
-			.topology = vk::PrimitiveTopology::eTriangleList };
+			.topology = key.topology };
 
 		//vk::Viewport{ 0.0f, 0.0f, static_cast<float>(swapChainExtent.width), static_cast<float>(swapChainExtent.height), 0.0f, 1.0f };
 		vk::PipelineViewportStateCreateInfo viewportState{
@@ -385,25 +1083,32 @@ private:
 			.depthClampEnable = vk::False, 
 			.rasterizerDiscardEnable = vk::False,
 			.polygonMode = vk::PolygonMode::eFill,
-			.cullMode = vk::CullModeFlagBits::eNone, //was originally eBack, but wasnt working
+			.cullMode = key.cullMode,
 			.frontFace = vk::FrontFace::eClockwise,
 			.depthBiasEnable = vk::False,
 			.depthBiasSlopeFactor = 1.0f,
 			.lineWidth = 1.0f };
 
 		vk::PipelineMultisampleStateCreateInfo multisampling{
-			.rasterizationSamples = vk::SampleCountFlagBits::e1,
+			.rasterizationSamples = key.samples,
 			.sampleShadingEnable = vk::False };
+
+		//everything is drawn at z = 0, less or equal keeps the later instance on top like before depth testing
+		vk::PipelineDepthStencilStateCreateInfo depthStencil{
+			.depthTestEnable = vk::True,
+			.depthWriteEnable = vk::True,
+			.depthCompareOp = vk::CompareOp::eLessOrEqual,
+			.depthBoundsTestEnable = vk::False,
+			.stencilTestEnable = vk::False };
 		
 		vk::PipelineColorBlendAttachmentState colorBlendAttachment{
-			.blendEnable = vk::False, //was true 
-			/*
+			.blendEnable = key.blend ? vk::True : vk::False,
 			.srcColorBlendFactor = vk::BlendFactor::eSrcAlpha,
 			.dstColorBlendFactor = vk::BlendFactor::eOneMinusSrcAlpha,
 			.colorBlendOp = vk::BlendOp::eAdd,
 			.srcAlphaBlendFactor = vk::BlendFactor::eOne,
 			.dstAlphaBlendFactor = vk::BlendFactor::eZero,
-			.alphaBlendOp = vk::BlendOp::eAdd,*/
+			.alphaBlendOp = vk::BlendOp::eAdd,
 			.colorWriteMask = vk::ColorComponentFlagBits::eR |
 					  vk::ColorComponentFlagBits::eG |
  					  vk::ColorComponentFlagBits::eB |
@@ -416,15 +1121,10 @@ private:
 			.attachmentCount = 1, 
 			.pAttachments =  &colorBlendAttachment };
 
-		vk::PipelineLayoutCreateInfo pipelineLayoutInfo{
-			.setLayoutCount = 0,
-			.pushConstantRangeCount = 0 };
-
-		pipelineLayout = vk::raii::PipelineLayout( device, pipelineLayoutInfo );
-
 		vk::PipelineRenderingCreateInfo pipelineRenderingCreateInfo{
 			.colorAttachmentCount = 1,
-			.pColorAttachmentFormats = &swapChainImageFormat
+			.pColorAttachmentFormats = &key.colorFormat,
+			.depthAttachmentFormat = key.depthFormat
 		};
 
 		vk::GraphicsPipelineCreateInfo pipelineInfo{
@@ -436,13 +1136,136 @@ private:
 			.pViewportState = &viewportState,
 			.pRasterizationState = &rasterizer,
 			.pMultisampleState = &multisampling,
+			.pDepthStencilState = &depthStencil,
 			.pColorBlendState = &colorBlending,
 			.pDynamicState = &dynamicState,
 			.layout = pipelineLayout,
 			.renderPass = nullptr
 		};
 
-		graphicsPipeline = vk::raii::Pipeline( device, nullptr, pipelineInfo );
+		return vk::raii::Pipeline( device, pipelineCache->get(), pipelineInfo );
+	}
+
+	void createShaderReloader() {
+		if (!config.hotReload) {
+			return;
+		}
+		shaderReloader = std::make_unique<ShaderReloader>(config.shaderDir,
+			ReloadableShader{ .source = "shader.slang", .output = "slang.spv", .entryPoints = { "vertMain", "fragMain" } },
+			[this](std::span<const uint32_t> spirv) {
+				//the variant in use right now is built here on the reload thread, others on their first lookup
+				PipelineKey key;
+				{
+					std::lock_guard lock(pipelineKeyMutex);
+					key = pipelineKey;
+				}
+				auto variants = createPipelineVariants(spirv);
+				(void)variants->get(key);
+				return variants;
+			});
+	}
+
+	void setPipelineKey(const PipelineKey& key) {
+		std::lock_guard lock(pipelineKeyMutex);
+		pipelineKey = key;
+	}
+
+	//The table is sized to what the device allows for update-after-bind samplers, up to MAX_BINDLESS_TEXTURES
+	void createBindlessTable() {
+		if (config.materialCount == 0) {
+			throw std::runtime_error("material count must be at least 1");
+		}
+		textureSampler = vk::raii::Sampler(device, vk::SamplerCreateInfo{
+			.magFilter = vk::Filter::eLinear,
+			.minFilter = vk::Filter::eLinear,
+			.mipmapMode = vk::SamplerMipmapMode::eLinear,
+			.addressModeU = vk::SamplerAddressMode::eRepeat,
+			.addressModeV = vk::SamplerAddressMode::eRepeat,
+			.addressModeW = vk::SamplerAddressMode::eRepeat,
+			.maxLod = vk::LodClampNone });
+
+		auto properties = physicalDevice.getProperties2<vk::PhysicalDeviceProperties2, vk::PhysicalDeviceVulkan12Properties>();
+		const auto& limits = properties.get<vk::PhysicalDeviceVulkan12Properties>();
+		uint32_t textureCapacity = std::min({ MAX_BINDLESS_TEXTURES,
+			limits.maxPerStageDescriptorUpdateAfterBindSamplers, limits.maxPerStageDescriptorUpdateAfterBindSampledImages,
+			limits.maxDescriptorSetUpdateAfterBindSamplers, limits.maxDescriptorSetUpdateAfterBindSampledImages });
+		bindless = std::make_unique<BindlessTable>(device, *allocator, *textureSampler, textureCapacity, config.materialCount);
+	}
+
+	void createFrameUniforms() {
+		vk::DeviceSize alignment = physicalDevice.getProperties().limits.minUniformBufferOffsetAlignment;
+		frameUniforms = std::make_unique<UniformRing>(device, *allocator, UNIFORM_RING_SIZE, alignment,
+			static_cast<uint32_t>(sizeof(FrameUniforms)), vk::ShaderStageFlagBits::eVertex);
+	}
+
+	//The default texture, the materials and (with --texture) the streamer plus its first request
+	void createTextures() {
+		//1x1 white so the shader output is unchanged until a real texture is resident
+		defaultTexture = GpuImage(*allocator, device, vk::ImageCreateInfo{
+			.imageType = vk::ImageType::e2D,
+			.format = TextureStreamer::FORMAT,
+			.extent = { 1, 1, 1 },
+			.mipLevels = 1,
+			.arrayLayers = 1,
+			.samples = vk::SampleCountFlagBits::e1,
+			.tiling = vk::ImageTiling::eOptimal,
+			.usage = vk::ImageUsageFlagBits::eTransferDst | vk::ImageUsageFlagBits::eSampled,
+			.sharingMode = vk::SharingMode::eExclusive,
+			.initialLayout = vk::ImageLayout::eUndefined }, vk::MemoryPropertyFlagBits::eDeviceLocal);
+		vk::ImageSubresourceRange range{ vk::ImageAspectFlagBits::eColor, 0, 1, 0, 1 };
+		immediateSubmit(graphicsQueue, commandPool, [&](const vk::raii::CommandBuffer& commandBuffer) {
+			vk::ImageMemoryBarrier2 toTransfer{
+				.srcStageMask = vk::PipelineStageFlagBits2::eNone,
+				.dstStageMask = vk::PipelineStageFlagBits2::eClear,
+				.dstAccessMask = vk::AccessFlagBits2::eTransferWrite,
+				.oldLayout = vk::ImageLayout::eUndefined,
+				.newLayout = vk::ImageLayout::eTransferDstOptimal,
+				.image = defaultTexture.handle(),
+				.subresourceRange = range };
+			commandBuffer.pipelineBarrier2(vk::DependencyInfo{ .imageMemoryBarrierCount = 1, .pImageMemoryBarriers = &toTransfer });
+			commandBuffer.clearColorImage(defaultTexture.handle(), vk::ImageLayout::eTransferDstOptimal,
+				vk::ClearColorValue(1.0f, 1.0f, 1.0f, 1.0f), range);
+			vk::ImageMemoryBarrier2 toShader{
+				.srcStageMask = vk::PipelineStageFlagBits2::eClear,
+				.srcAccessMask = vk::AccessFlagBits2::eTransferWrite,
+				.dstStageMask = vk::PipelineStageFlagBits2::eFragmentShader,
+				.dstAccessMask = vk::AccessFlagBits2::eShaderSampledRead,
+				.oldLayout = vk::ImageLayout::eTransferDstOptimal,
+				.newLayout = vk::ImageLayout::eShaderReadOnlyOptimal,
+				.image = defaultTexture.handle(),
+				.subresourceRange = range };
+			commandBuffer.pipelineBarrier2(vk::DependencyInfo{ .imageMemoryBarrierCount = 1, .pImageMemoryBarriers = &toShader });
+		});
+		defaultTextureView = vk::raii::ImageView(device, vk::ImageViewCreateInfo{
+			.image = defaultTexture.handle(),
+			.viewType = vk::ImageViewType::e2D,
+			.format = TextureStreamer::FORMAT,
+			.subresourceRange = range });
+
+		defaultTextureIndex = bindless->addTexture(*defaultTextureView);
+
+		//material 0 leaves the instance colors alone, the rest get a tint each so they can be told apart
+		for (uint32_t i = 0; i < config.materialCount; i++) {
+			uint32_t hash = i * 2246822519u;
+			glm::vec4 tint = i == 0 ? glm::vec4(1.0f) : glm::vec4(0.25f + static_cast<float>((hash >> 8) & 0xff) / 340.0f,
+				0.25f + static_cast<float>((hash >> 16) & 0xff) / 340.0f, 0.25f + static_cast<float>((hash >> 24) & 0xff) / 340.0f, 1.0f);
+			bindless->addMaterial(MaterialData{ .baseColor = tint, .albedoTexture = defaultTextureIndex, .padding = {} });
+		}
+
+		if (!config.texturePath.empty()) {
+			textureStreamer = std::make_unique<TextureStreamer>(device, *allocator, transferQueue, transferIndex, graphicsIndex,
+									    TEXTURE_STAGING_SIZE);
+			textureId = textureStreamer->request(config.texturePath);
+		}
+	}
+
+	void createAssetLoader() {
+		assets = std::make_unique<AssetLoader>(config.shaderDir, config.assetArchive);
+	}
+
+	//with --no-pipeline-cache the path is empty and this is just an in-memory cache that never touches disk
+	void createPipelineCache() {
+		pipelineCache = std::make_unique<PersistentPipelineCache>(device, physicalDevice, config.pipelineCachePath);
 	}
 
 	void createCommandPool(){
@@ -452,143 +1275,781 @@ private:
 		};
 
 		commandPool = vk::raii::CommandPool(device, poolInfo);
+		transferCommandPool = vk::raii::CommandPool(device, vk::CommandPoolCreateInfo{
+			.flags = vk::CommandPoolCreateFlagBits::eTransient,
+			.queueFamilyIndex = transferIndex });
+	}
+
+	//only set up when more than one recording thread was asked for, otherwise everything stays on the primary
+	void createWorkerCommandContexts() {
+		if (config.recordThreads == 1) {
+			return;
+		}
+		jobSystem = std::make_unique<JobSystem>(config.recordThreads);
+
+		workerContexts.clear();
+		workerContexts.resize(MAX_FRAMES_IN_FLIGHT);
+		for (auto& slotContexts : workerContexts) {
+			for (uint32_t worker = 0; worker < jobSystem->workerCount(); worker++) {
+				WorkerCommandContext& context = slotContexts.emplace_back();
+				//no eResetCommandBuffer, the whole pool is reset at once which is cheaper
+				context.pool = vk::raii::CommandPool(device, vk::CommandPoolCreateInfo{
+					.flags = vk::CommandPoolCreateFlagBits::eTransient,
+					.queueFamilyIndex = graphicsIndex });
+				vk::CommandBufferAllocateInfo allocInfo{
+					.commandPool = context.pool,
+					.level = vk::CommandBufferLevel::eSecondary,
+					.commandBufferCount = 1 };
+				context.commandBuffer = std::move(vk::raii::CommandBuffers(device, allocInfo).front());
+			}
+		}
+	}
+
+	void createAllocator() {
+		allocator = std::make_unique<GpuAllocator>(device, physicalDevice);
+		stagingRing = std::make_unique<StagingRing>(*allocator, device, STAGING_RING_SIZE);
+		uploadTimeline = createTimelineSemaphore();
+		uploadTag = 0;
+	}
+
+	//device local buffer filled through the staging ring, usage gets eTransferDst added automatically.
+	//Copies run on the transfer queue, when that is a different family ownership is handed over to graphics after the last chunk.
+	GpuBuffer createDeviceLocalBuffer(const void* data, vk::DeviceSize size, vk::BufferUsageFlags usage) {
+		GpuBuffer buffer(*allocator, device, size, usage | vk::BufferUsageFlagBits::eTransferDst,
+				 vk::MemoryPropertyFlagBits::eDeviceLocal);
+		bool transferOwnership = transferIndex != graphicsIndex;
+		vk::BufferMemoryBarrier2 ownershipBarrier{
+			.srcQueueFamilyIndex = transferIndex,
+			.dstQueueFamilyIndex = graphicsIndex,
+			.buffer = buffer.handle(),
+			.offset = 0,
+			.size = vk::WholeSize };
+
+		//big uploads get split into ring sized chunks, each chunk is its own submission
+		vk::DeviceSize chunkSize = stagingRing->capacity() / 2;
+		for (vk::DeviceSize copied = 0; copied < size; copied += chunkSize) {
+			vk::DeviceSize bytes = std::min(chunkSize, size - copied);
+			//tagged with the upload timeline value the copy's submission is about to signal
+			auto span = stagingRing->allocate(bytes, 16, uploadTag + 1);
+			if (!span) {
+				throw std::runtime_error("staging ring exhausted");
+			}
+			memcpy(span->data, static_cast<const char*>(data) + copied, bytes);
+
+			bool lastChunk = copied + bytes == size;
+			immediateSubmit(transferQueue, transferCommandPool, [&](const vk::raii::CommandBuffer& commandBuffer) {
+				commandBuffer.copyBuffer(span->buffer, buffer.handle(), vk::BufferCopy{ span->offset, copied, bytes });
+				if (transferOwnership && lastChunk) {
+					//release half, dst stage/access are ignored for a release
+					vk::BufferMemoryBarrier2 release = ownershipBarrier;
+					release.srcStageMask = vk::PipelineStageFlagBits2::eTransfer;
+					release.srcAccessMask = vk::AccessFlagBits2::eTransferWrite;
+					commandBuffer.pipelineBarrier2(vk::DependencyInfo{ .bufferMemoryBarrierCount = 1, .pBufferMemoryBarriers = &release });
+				}
+			});
+			stagingRing->retire(uploadTag);
+		}
+
+		if (transferOwnership) {
+			//acquire half, src stage/access are ignored. The timeline wait above already ordered it after the release.
+			immediateSubmit(graphicsQueue, commandPool, [&](const vk::raii::CommandBuffer& commandBuffer) {
+				vk::BufferMemoryBarrier2 acquire = ownershipBarrier;
+				acquire.dstStageMask = vk::PipelineStageFlagBits2::eVertexAttributeInput | vk::PipelineStageFlagBits2::eIndexInput |
+						       vk::PipelineStageFlagBits2::eComputeShader;
+				acquire.dstAccessMask = vk::AccessFlagBits2::eVertexAttributeRead | vk::AccessFlagBits2::eIndexRead |
+							vk::AccessFlagBits2::eShaderStorageRead;
+				commandBuffer.pipelineBarrier2(vk::DependencyInfo{ .bufferMemoryBarrierCount = 1, .pBufferMemoryBarriers = &acquire });
+			});
+		}
+		return buffer;
+	}
+
+	//one-off command buffer for setup work, signals the next upload timeline value and blocks until the gpu reaches it
+	void immediateSubmit(const vk::raii::Queue& queue, const vk::raii::CommandPool& pool,
+			const std::function<void(const vk::raii::CommandBuffer&)>& record) {
+		vk::CommandBufferAllocateInfo allocInfo{
+			.commandPool = pool,
+			.level = vk::CommandBufferLevel::ePrimary,
+			.commandBufferCount = 1 };
+		vk::raii::CommandBuffer commandBuffer = std::move(vk::raii::CommandBuffers(device, allocInfo).front());
+
+		commandBuffer.begin(vk::CommandBufferBeginInfo{ .flags = vk::CommandBufferUsageFlagBits::eOneTimeSubmit });
+		record(commandBuffer);
+		commandBuffer.end();
+
+		vk::CommandBufferSubmitInfo commandBufferInfo{ .commandBuffer = commandBuffer };
+		vk::SemaphoreSubmitInfo signalInfo{
+			.semaphore = uploadTimeline,
+			.value = ++uploadTag,
+			.stageMask = vk::PipelineStageFlagBits2::eAllCommands };
+		queue.submit2(vk::SubmitInfo2{
+			.commandBufferInfoCount = 1,
+			.pCommandBufferInfos = &commandBufferInfo,
+			.signalSemaphoreInfoCount = 1,
+			.pSignalSemaphoreInfos = &signalInfo });
+		waitForTimeline(uploadTimeline, uploadTag);
+	}
+
+	void createGeometryBuffers() {
+		animateScene = config.animateScene;
+		if (animateScene && config.gpuCulling) {
+			//the cull pass reads one fixed instance buffer
+			std::cerr << "--animate rewrites the instances every frame, which --gpu-culling can't follow yet, drawing them static\n";
+			animateScene = false;
+		}
+		vertexBuffer = createDeviceLocalBuffer(vertices.data(), sizeof(vertices[0]) * vertices.size(), vk::BufferUsageFlagBits::eVertexBuffer);
+		indexBuffer = createDeviceLocalBuffer(indices.data(), sizeof(indices[0]) * indices.size(), vk::BufferUsageFlagBits::eIndexBuffer);
+		setInstanceCount(config.instanceCount);
+	}
+
+	//Rebuilds the instance buffer. The old one is retired rather than destroyed so in flight frames keep drawing from it,
+	//only the culler needs all submitted frames done first since it rewrites a descriptor set they may be using.
+	void setInstanceCount(uint32_t count) {
+		if (count == 0) {
+			throw std::runtime_error("instance count must be at least 1");
+		}
+		if (culler) {
+			waitForTimeline(frameTimeline, frameTimelineValue);
+		}
+		std::vector<InstanceData> instances = generateInstances(count, config.materialCount);
+		instanceCount = count;
+		if (animateScene) {
+			buildScene(instances);
+			return;
+		}
+		GpuBuffer newInstanceBuffer = createDeviceLocalBuffer(instances.data(), sizeof(InstanceData) * instances.size(),
+				vk::BufferUsageFlagBits::eVertexBuffer | vk::BufferUsageFlagBits::eStorageBuffer);
+		deletionQueue.retire(std::move(instanceBuffer), frameTimelineValue);
+		instanceBuffer = std::move(newInstanceBuffer);
+		if (culler) {
+			culler->setObjects(instanceBuffer, instanceCount);
+		}
+	}
+
+	//Rows of the instance grid become two level hierarchies: the first instance of a row is the root, the others are
+	//its children with their grid placement expressed relative to it
+	void buildScene(const std::vector<InstanceData>& instances) {
+		scene = std::make_unique<SceneStore>();
+		sceneRoots.clear();
+		auto side = static_cast<uint32_t>(std::ceil(std::sqrt(static_cast<double>(instances.size()))));
+		uint32_t root = 0;
+		for (uint32_t i = 0; i < instances.size(); i++) {
+			const InstanceData& instance = instances[i];
+			SceneObjectDesc desc{
+				.offset = { instance.offset.x, instance.offset.y },
+				.rotation = instance.scaleRotation.y,
+				.scale = instance.scaleRotation.x,
+				.color = { instance.color.r, instance.color.g, instance.color.b, instance.color.a },
+				.materialId = instance.materialId };
+			if (i % side == 0) {
+				root = scene->add(desc);
+				sceneRoots.emplace_back(root, desc.rotation);
+				continue;
+			}
+			const InstanceData& parent = instances[root];
+			float c = std::cos(-parent.scaleRotation.y), s = std::sin(-parent.scaleRotation.y);
+			glm::vec2 relative = (instance.offset - parent.offset) / parent.scaleRotation.x;
+			desc.parent = root;
+			desc.offset[0] = c * relative.x - s * relative.y;
+			desc.offset[1] = s * relative.x + c * relative.y;
+			desc.rotation -= parent.scaleRotation.y;
+			desc.scale /= parent.scaleRotation.x;
+			scene->add(desc);
+		}
+
+		//in flight frames still draw from the old ones
+		deletionQueue.retire(std::move(sceneInstanceBuffers), frameTimelineValue);
+		sceneInstanceBuffers.clear();
+		for (uint32_t slot = 0; slot < MAX_FRAMES_IN_FLIGHT; slot++) {
+			sceneInstanceBuffers.emplace_back(*allocator, device, sizeof(PackedInstance) * instances.size(),
+				vk::BufferUsageFlagBits::eVertexBuffer | vk::BufferUsageFlagBits::eStorageBuffer,
+				vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent,
+				vk::MemoryPropertyFlagBits::eDeviceLocal);
+		}
+	}
+
+	//The scene update and the recording never run at the same time, so they share the recording pool instead of
+	//putting a second pool's threads on the same cores
+	void createSceneJobs() {
+		if (!animateScene) {
+			return;
+		}
+		if (jobSystem) {
+			sceneJobs = jobSystem.get();
+			return;
+		}
+		ownSceneJobs = std::make_unique<JobSystem>(0);
+		sceneJobs = ownSceneJobs.get();
+	}
+
+	//Render thread, after the slot's previous frame is done with its instance buffer
+	void updateScene() {
+		auto start = std::chrono::steady_clock::now();
+		float time = std::chrono::duration<float>(start - startupTimings.start).count();
+		for (size_t row = 0; row < sceneRoots.size(); row++) {
+			auto [id, rotation] = sceneRoots[row];
+			scene->setLocalRotation(id, rotation + 0.1f * std::sin(time + static_cast<float>(row) * 0.3f));
+		}
+		frameArena.reset();
+		scene->update(sceneJobs, frameArena, static_cast<PackedInstance*>(sceneInstanceBuffers[currentFrame].mapped()),
+			meshBoundingRadius());
+		sceneUpdateMs += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+		sceneUpdates++;
+	}
+
+	void createCuller() {
+		if (!config.gpuCulling) {
+			return;
+		}
+		culler = std::make_unique<GpuCuller>(device, *allocator, pipelineCache->get(), spirvWords(assets->load("cull.spv").bytes), MAX_FRAMES_IN_FLIGHT);
+		culler->setObjects(instanceBuffer, instanceCount);
+	}
+
+	void createRenderGraph() {
+		renderGraph = std::make_unique<RenderGraph>(device, *allocator, deletionQueue);
+	}
+
+	//radius of the mesh around its origin, scaled per instance by the cull shader
+	static float meshBoundingRadius() {
+		float radius = 0.0f;
+		for (const auto& vertex : vertices) {
+			radius = std::max(radius, glm::length(vertex.pos));
+		}
+		return radius;
 	}
 
-	void createCommandBuffer(){
+	void createCommandBuffers(){
+		commandBuffers.clear();
 		vk::CommandBufferAllocateInfo allocInfo{
 			.commandPool = commandPool,
 			.level = vk::CommandBufferLevel::ePrimary,
-			.commandBufferCount = 1
+			.commandBufferCount = MAX_FRAMES_IN_FLIGHT
 		};
 
-		commandBuffer = std::move(vk::raii::CommandBuffers(device, allocInfo).front());
+		commandBuffers = vk::raii::CommandBuffers(device, allocInfo);
 	}
 
 	void recordCommandBuffer(uint32_t imageIndex) {
+		auto& commandBuffer = commandBuffers[currentFrame];
 		commandBuffer.begin( {} );
 
-		transition_image_layout(
-			imageIndex,
-			vk::ImageLayout::eUndefined,
-			vk::ImageLayout::eColorAttachmentOptimal,
-			{},
-			vk::AccessFlagBits2::eColorAttachmentWrite,
-			vk::PipelineStageFlagBits2::eTopOfPipe,
-			vk::PipelineStageFlagBits2::eColorAttachmentOutput);
+		//the frame scope is closed by hand below since it has to end before commandBuffer.end()
+		uint32_t frameScope = 0;
+		if (profiler) {
+			profiler->beginFrame(commandBuffer, currentFrame);
+			frameScope = profiler->beginScope(commandBuffer, "frame");
+		}
+		if (dynamicResolution) {
+			dynamicResolution->beginFrame(commandBuffer, currentFrame);
+		}
+		renderExtent = dynamicResolution ? dynamicResolution->renderExtent(swapChainExtent) : swapChainExtent;
+
+		//host coherent and only read by this submission, so nothing to flush or synchronize
+		frameUniformOffset = frameUniforms->push(FrameUniforms{
+			.viewProj = viewProj,
+			.time = std::chrono::duration<float>(std::chrono::steady_clock::now() - startupTimings.start).count(),
+			.padding = {} }, frameTimelineValue + 1);
+
+		buildFrameGraph(imageIndex);
+		renderGraph->execute(commandBuffer, frameTimelineValue);
+
+		if (profiler) {
+			profiler->endScope(commandBuffer, frameScope);
+		}
+		if (dynamicResolution) {
+			dynamicResolution->endFrame(commandBuffer);
+		}
+		commandBuffer.end();
+	}
+
+	//The frame as render graph passes, the graph works out every barrier between them. The swapchain image comes in
+	//undefined (after the acquire wait at color attachment output) and leaves ready to present, or to be copied out
+	//in headless mode.
+	void buildFrameGraph(uint32_t imageIndex) {
+		RenderGraph& graph = *renderGraph;
+		graph.reset();
+		RenderGraph::ResourceId target = graph.importImage("target", swapChainImages[imageIndex], *swapChainImageViews[imageIndex],
+			vk::ImageAspectFlagBits::eColor,
+			ResourceState{ .stage = vk::PipelineStageFlagBits2::eColorAttachmentOutput, .layout = vk::ImageLayout::eUndefined },
+			config.headless ? ResourceUse::TransferSrc : ResourceUse::Present);
+
+		//mips for textures whose transfer finished. A newly resident texture gets a fresh bindless index (nothing in
+		//flight can be reading it) and the materials switch over to it through the table update below.
+		if (textureStreamer) {
+			graph.addPass("textures", [this](const vk::raii::CommandBuffer& commandBuffer) {
+				ProfileScope textureScope(profiler.get(), commandBuffer, "textures");
+				textureStreamer->recordGraphicsWork(commandBuffer, frameTimelineValue + 1);
+				if (streamedTextureIndex == NO_TEXTURE && textureStreamer->isResident(textureId)) {
+					streamedTextureIndex = bindless->addTexture(textureStreamer->view(textureId));
+					for (uint32_t id = 0; id < bindless->materialCount(); id++) {
+						MaterialData material = bindless->material(id);
+						material.albedoTexture = streamedTextureIndex;
+						bindless->setMaterial(id, material);
+					}
+				}
+			}).sideEffects();
+		}
+		graph.addPass("materials", [this](const vk::raii::CommandBuffer& commandBuffer) {
+			bindless->recordUpdates(commandBuffer);
+		}).sideEffects();
+
+		std::optional<RenderGraph::ResourceId> drawCommand;
+		std::optional<RenderGraph::ResourceId> visibleInstances;
+		if (culler) {
+			drawCommand = graph.importBuffer("draw command", culler->drawCommand());
+			visibleInstances = graph.importBuffer("visible instances", culler->visibleInstances());
+			graph.addPass("cull", [this](const vk::raii::CommandBuffer& commandBuffer) {
+				ProfileScope cullScope(profiler.get(), commandBuffer, "cull", true);
+				culler->record(commandBuffer, currentFrame, viewProj, static_cast<uint32_t>(indices.size()), meshBoundingRadius());
+			}).use(*drawCommand, ResourceUse::ComputeStorageWrite).use(*visibleInstances, ResourceUse::ComputeStorageWrite);
+		}
+
+		//depth and the multisampled color only live inside the draw's rendering block, so they never need memory
+		//where the device can keep them in tile memory. With msaa the swapchain image is only the resolve target.
+		RenderGraph::ResourceId depth = graph.createImage("depth", TransientImageDesc{
+			.format = depthFormat,
+			.extent = swapChainExtent,
+			.samples = msaaSamples,
+			.aspect = depthAspect(depthFormat),
+			.lazy = true });
+		//with dynamic resolution the scene gets its own full sized image, only the top left renderExtent of it is drawn
+		//and then blitted up to the whole target
+		RenderGraph::ResourceId sceneColor = target;
+		if (dynamicResolution) {
+			sceneColor = graph.createImage("scene color", TransientImageDesc{
+				.format = swapChainImageFormat,
+				.extent = swapChainExtent });
+		}
+		RenderGraph::ResourceId color = sceneColor;
+		if (msaaSamples != vk::SampleCountFlagBits::e1) {
+			color = graph.createImage("msaa color", TransientImageDesc{
+				.format = swapChainImageFormat,
+				.extent = swapChainExtent,
+				.samples = msaaSamples,
+				.aspect = vk::ImageAspectFlagBits::eColor,
+				.lazy = true });
+		}
+
+		auto draw = graph.addPass("draw", [this, sceneColor, color, depth](const vk::raii::CommandBuffer& commandBuffer) {
+			recordDrawPass(commandBuffer, renderGraph->view(color), color != sceneColor ? renderGraph->view(sceneColor) : nullptr,
+				renderGraph->view(depth));
+		}).use(color, ResourceUse::ColorAttachment).use(depth, ResourceUse::DepthAttachment);
+		if (color != sceneColor) {
+			//the resolve is a color attachment write too
+			draw.use(sceneColor, ResourceUse::ColorAttachment);
+		}
+		if (culler) {
+			draw.use(*drawCommand, ResourceUse::IndirectRead).use(*visibleInstances, ResourceUse::VertexRead);
+			//after the draw so the draw's barrier on the command also covers this copy
+			graph.addPass("cull readback", [this](const vk::raii::CommandBuffer& commandBuffer) {
+				culler->recordReadback(commandBuffer, currentFrame);
+			}).use(*drawCommand, ResourceUse::TransferRead).sideEffects();
+		}
+
+		if (sceneColor != target) {
+			graph.addPass("upscale", [this, sceneColor, target](const vk::raii::CommandBuffer& commandBuffer) {
+				ProfileScope upscaleScope(profiler.get(), commandBuffer, "upscale");
+				recordUpscale(commandBuffer, renderGraph->image(sceneColor), renderGraph->image(target));
+			}).use(sceneColor, ResourceUse::TransferSrc).use(target, ResourceUse::TransferDst);
+		}
 
+		//no free slot means the sink is behind, the frame just isn't captured
+		if (frameCapture) {
+			if (auto slot = frameCapture->begin(swapChainExtent, swapChainImageFormat, frameTimelineValue + 1)) {
+				RenderGraph::ResourceId readback = graph.importBuffer("capture", frameCapture->buffer(*slot));
+				graph.addPass("capture", [this, target, slot = *slot](const vk::raii::CommandBuffer& commandBuffer) {
+					frameCapture->record(commandBuffer, slot, renderGraph->image(target));
+				}).use(target, ResourceUse::TransferSrc).use(readback, ResourceUse::TransferWrite).sideEffects();
+			}
+		}
+	}
+
+	//Bilinear blit of the drawn part of the scene image over the whole target
+	void recordUpscale(const vk::raii::CommandBuffer& commandBuffer, vk::Image scene, vk::Image target) {
+		vk::ImageBlit2 region{
+			.srcSubresource = { vk::ImageAspectFlagBits::eColor, 0, 0, 1 },
+			.srcOffsets = std::array{ vk::Offset3D{ 0, 0, 0 },
+				vk::Offset3D{ static_cast<int32_t>(renderExtent.width), static_cast<int32_t>(renderExtent.height), 1 } },
+			.dstSubresource = { vk::ImageAspectFlagBits::eColor, 0, 0, 1 },
+			.dstOffsets = std::array{ vk::Offset3D{ 0, 0, 0 },
+				vk::Offset3D{ static_cast<int32_t>(swapChainExtent.width), static_cast<int32_t>(swapChainExtent.height), 1 } } };
+		commandBuffer.blitImage2(vk::BlitImageInfo2{
+			.srcImage = scene,
+			.srcImageLayout = vk::ImageLayout::eTransferSrcOptimal,
+			.dstImage = target,
+			.dstImageLayout = vk::ImageLayout::eTransferDstOptimal,
+			.regionCount = 1,
+			.pRegions = &region,
+			.filter = vk::Filter::eLinear });
+	}
+
+	//resolveTarget is null without msaa, then color is the target itself and gets stored. Otherwise only the resolve
+	//reaches memory, the multisampled color and the depth are cleared on load and never written back.
+	void recordDrawPass(const vk::raii::CommandBuffer& commandBuffer, vk::ImageView color, vk::ImageView resolveTarget,
+			vk::ImageView depth)
+	{
 		vk::ClearValue clearColor = vk::ClearColorValue(0.0f, 0.0f, 0.0f, 1.0f);
 		vk::RenderingAttachmentInfo attachmentInfo = {
-			.imageView = swapChainImageViews[imageIndex],
+			.imageView = color,
 			.imageLayout = vk::ImageLayout::eColorAttachmentOptimal,
+			.resolveMode = resolveTarget ? vk::ResolveModeFlagBits::eAverage : vk::ResolveModeFlagBits::eNone,
+			.resolveImageView = resolveTarget,
+			.resolveImageLayout = vk::ImageLayout::eColorAttachmentOptimal,
 			.loadOp = vk::AttachmentLoadOp::eClear,
-			.storeOp = vk::AttachmentStoreOp::eStore,
+			.storeOp = resolveTarget ? vk::AttachmentStoreOp::eDontCare : vk::AttachmentStoreOp::eStore,
 			.clearValue = clearColor
 		};
+		vk::RenderingAttachmentInfo depthAttachmentInfo = {
+			.imageView = depth,
+			.imageLayout = vk::ImageLayout::eDepthStencilAttachmentOptimal,
+			.loadOp = vk::AttachmentLoadOp::eClear,
+			.storeOp = vk::AttachmentStoreOp::eDontCare,
+			.clearValue = vk::ClearDepthStencilValue{ .depth = 1.0f, .stencil = 0 }
+		};
+
+		//the gpu driven path is a single indirect draw, nothing worth spreading over threads
+		bool useSecondaries = jobSystem && !culler;
 
 		vk::RenderingInfo renderingInfo = {
-			.renderArea = { .offset = {0, 0}, .extent = swapChainExtent },
+			.flags = useSecondaries ? vk::RenderingFlagBits::eContentsSecondaryCommandBuffers : vk::RenderingFlags{},
+			.renderArea = { .offset = {0, 0}, .extent = renderExtent },
 			.layerCount = 1,
 			.colorAttachmentCount = 1,
-			.pColorAttachments = &attachmentInfo
+			.pColorAttachments = &attachmentInfo,
+			.pDepthAttachment = &depthAttachmentInfo
 		};
 
+		//statistics query wraps the whole rendering block since it can't start outside and end inside it.
+		//secondaries would have to inherit it (inheritedQueries) so it is skipped for them
+		ProfileScope drawScope(profiler.get(), commandBuffer, "draw", !useSecondaries);
 		commandBuffer.beginRendering(renderingInfo);
 
-		commandBuffer.bindPipeline(vk::PipelineBindPoint::eGraphics, graphicsPipeline);
-		commandBuffer.setViewport(0, vk::Viewport(0.0f, 0.0f, static_cast<float>(swapChainExtent.width), 
-						static_cast<float>(swapChainExtent.height), 0.0f, 1.0f));
-		commandBuffer.setScissor(0, vk::Rect2D(vk::Offset2D(0, 0), swapChainExtent));
-		commandBuffer.draw(3, 1, 0, 0);
+		if (useSecondaries) {
+			commandBuffer.executeCommands(recordSecondaryCommandBuffers());
+		} else {
+			bindDrawState(commandBuffer);
+			if (culler) {
+				pushDrawConstants(commandBuffer, 0);
+				culler->draw(commandBuffer);
+			} else {
+				recordDraws(commandBuffer, 0, drawCallCount());
+			}
+		}
 		commandBuffer.endRendering();
+	}
 
-		transition_image_layout(
-			imageIndex,
-			vk::ImageLayout::eColorAttachmentOptimal,
-			vk::ImageLayout::ePresentSrcKHR,
-			vk::AccessFlagBits2::eColorAttachmentWrite,
-			{},
-			vk::PipelineStageFlagBits2::eColorAttachmentOutput,
-			vk::PipelineStageFlagBits2::eBottomOfPipe
-		);
+	//everything a draw needs bound, secondaries inherit none of this so each one calls it too
+	void bindDrawState(const vk::raii::CommandBuffer& commandBuffer) {
+		commandBuffer.bindPipeline(vk::PipelineBindPoint::eGraphics, pipelineVariants->get(pipelineKey));
+		bindless->bind(commandBuffer, pipelineLayout, 0);
+		frameUniforms->bind(commandBuffer, vk::PipelineBindPoint::eGraphics, pipelineLayout, 1, frameUniformOffset);
+		commandBuffer.setViewport(0, vk::Viewport(0.0f, 0.0f, static_cast<float>(renderExtent.width), 
+						static_cast<float>(renderExtent.height), 0.0f, 1.0f));
+		commandBuffer.setScissor(0, vk::Rect2D(vk::Offset2D(0, 0), renderExtent));
+		vk::Buffer instances = culler ? culler->visibleInstances()
+				     : animateScene ? sceneInstanceBuffers[currentFrame].handle() : instanceBuffer.handle();
+		commandBuffer.bindVertexBuffers(0, { vertexBuffer.handle(), instances }, { 0, 0 });
+		commandBuffer.bindIndexBuffer(indexBuffer.handle(), 0, vk::IndexType::eUint16);
+	}
 
-		commandBuffer.end();
+	//instances get split evenly over --draw-calls draws, the default of one draws them all at once
+	uint32_t drawCallCount() const {
+		return std::clamp(config.drawCalls, 1u, instanceCount);
 	}
 
-	void transition_image_layout(
-		uint32_t imageIndex,
-    		vk::ImageLayout oldLayout,
-    		vk::ImageLayout newLayout,
-    		vk::AccessFlags2 srcAccessMask,
-    		vk::AccessFlags2 dstAccessMask,
-    		vk::PipelineStageFlags2 srcStageMask,
-   		vk::PipelineStageFlags2 dstStageMask) 
-	{
-		vk::ImageMemoryBarrier2 barrier = {
-        		.srcStageMask = srcStageMask,
-        		.srcAccessMask = srcAccessMask,
-        		.dstStageMask = dstStageMask,
-        		.dstAccessMask = dstAccessMask,
-        		.oldLayout = oldLayout,
-       	 		.newLayout = newLayout,
-        		.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
-        		.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
-        		.image = swapChainImages[imageIndex],
-        		.subresourceRange = {
-            			.aspectMask = vk::ImageAspectFlagBits::eColor,
-            			.baseMipLevel = 0,
-            			.levelCount = 1,
-            			.baseArrayLayer = 0,
-            			.layerCount = 1
-        		}
-    		};
+	void recordDraws(const vk::raii::CommandBuffer& commandBuffer, uint32_t firstDraw, uint32_t lastDraw) {
+		uint32_t draws = drawCallCount();
+		for (uint32_t draw = firstDraw; draw < lastDraw; draw++) {
+			auto firstInstance = static_cast<uint32_t>(static_cast<uint64_t>(instanceCount) * draw / draws);
+			auto endInstance = static_cast<uint32_t>(static_cast<uint64_t>(instanceCount) * (draw + 1) / draws);
+			pushDrawConstants(commandBuffer, draw);
+			commandBuffer.drawIndexed(static_cast<uint32_t>(indices.size()), endInstance - firstInstance, 0, 0, firstInstance);
+		}
+	}
 
-    		vk::DependencyInfo dependencyInfo = {
-        		.dependencyFlags = {},
-        		.imageMemoryBarrierCount = 1,
-        		.pImageMemoryBarriers = &barrier
-    		};
+	//draws alternate their spin direction so --spin with --draw-calls shows which instances went into which draw
+	void pushDrawConstants(const vk::raii::CommandBuffer& commandBuffer, uint32_t draw) {
+		float spin = glm::radians(static_cast<float>(config.spinDegrees)) * (draw % 2 == 0 ? 1.0f : -1.0f);
+		commandBuffer.pushConstants<DrawConstants>(pipelineLayout, vk::ShaderStageFlagBits::eVertex, 0, DrawConstants{ .spin = spin });
+	}
+
+	//Each worker resets its own pool for this frame slot and records its share of the draws into a secondary
+	//buffer, returned in worker order so the frame comes out the same as the single threaded path
+	std::vector<vk::CommandBuffer> recordSecondaryCommandBuffers() {
+		auto& contexts = workerContexts[currentFrame];
+		uint32_t used = jobSystem->parallelFor(drawCallCount(), [&](uint32_t worker, uint32_t firstDraw, uint32_t lastDraw) {
+			WorkerCommandContext& context = contexts[worker];
+			context.pool.reset();
+
+			vk::CommandBufferInheritanceRenderingInfo renderingInheritance{
+				.colorAttachmentCount = 1,
+				.pColorAttachmentFormats = &swapChainImageFormat,
+				.depthAttachmentFormat = depthFormat,
+				.rasterizationSamples = msaaSamples };
+			vk::CommandBufferInheritanceInfo inheritance{ .pNext = &renderingInheritance };
+			context.commandBuffer.begin(vk::CommandBufferBeginInfo{
+				.flags = vk::CommandBufferUsageFlagBits::eRenderPassContinue | vk::CommandBufferUsageFlagBits::eOneTimeSubmit,
+				.pInheritanceInfo = &inheritance });
+
+			bindDrawState(context.commandBuffer);
+			recordDraws(context.commandBuffer, firstDraw, lastDraw);
+			context.commandBuffer.end();
+		});
+
+		std::vector<vk::CommandBuffer> secondaries;
+		for (uint32_t worker = 0; worker < used; worker++) {
+			secondaries.push_back(*contexts[worker].commandBuffer);
+		}
+		return secondaries;
+	}
+
+	void createProfiler() {
+		if (!config.profile) {
+			return;
+		}
+		bool statistics = physicalDevice.getFeatures().pipelineStatisticsQuery;
+		profiler = std::make_unique<GpuProfiler>(device, physicalDevice, graphicsIndex, MAX_FRAMES_IN_FLIGHT, statistics);
+		if (!config.tracePath.empty()) {
+			profiler->enableTrace();
+		}
+	}
+
+	void createFramePacer() {
+		framePacer = std::make_unique<FramePacer>(config.targetFps, config.lowLatency);
+		if (framePacer->pacing()) {
+			std::cout << "[pacing] target_fps=" << config.targetFps << " low_latency=" << config.lowLatency
+				  << " present_wait=" << presentWaitEnabled << "\n";
+		}
+	}
+
+	//the upscale blits between two images of the target's format
+	void requireLinearBlit(vk::Format format) const {
+		vk::FormatFeatureFlags needed = vk::FormatFeatureFlagBits::eBlitSrc | vk::FormatFeatureFlagBits::eBlitDst |
+						vk::FormatFeatureFlagBits::eSampledImageFilterLinear;
+		if ((physicalDevice.getFormatProperties(format).optimalTilingFeatures & needed) != needed) {
+			throw std::runtime_error("--dynamic-resolution can't blit " + vk::to_string(format) + " images with linear filtering");
+		}
+	}
+
+	void createDynamicResolution() {
+		if (config.dynamicResolutionFps == 0) {
+			return;
+		}
+		requireLinearBlit(swapChainImageFormat);
+		double budgetMs = 1000.0 / config.dynamicResolutionFps;
+		dynamicResolution = std::make_unique<DynamicResolution>(device, physicalDevice, graphicsIndex, MAX_FRAMES_IN_FLIGHT,
+			budgetMs, static_cast<float>(config.minResolutionPercent) / 100.0f);
+		std::cout << "[dynres] gpu_budget_ms=" << budgetMs << " min_scale=" << config.minResolutionPercent / 100.0 << "\n";
+	}
+
+	void createFrameCapture() {
+		if (config.capturePath.empty()) {
+			return;
+		}
+		if (!FrameCapture::supports(swapChainImageFormat)) {
+			throw std::runtime_error("--capture does not support the " + vk::to_string(swapChainImageFormat) + " surface format");
+		}
+		frameCapture = std::make_unique<FrameCapture>(device, *allocator, CAPTURE_SLOTS,
+			config.captureRaw ? CaptureSinks::raw(config.capturePath) : CaptureSinks::png(config.capturePath));
+		std::cout << "[capture] writing " << (config.captureRaw ? "raw" : "png") << " frames to " << config.capturePath << "\n";
+	}
 
-    		commandBuffer.pipelineBarrier2(dependencyInfo);
+	//Runs before input is polled for the next frame. Hands the pacer every frame that has been presented (or finished
+	//on the gpu) since the last call, then sleeps until the pacer wants the frame to start. Low latency mode waits
+	//for the previous frame to be completely done first, which is what keeps frames from queueing up.
+	void beginFrame() {
+		collectFrameLatency(framePacer->lowLatency());
+		framePacer->waitForStart(frameTimelineValue + 1);
+	}
+
+	//frame ids are frame timeline values, which are also the present ids
+	void collectFrameLatency(bool wait) {
+		uint64_t submitted = frameTimelineValue;
+		if (submitted == 0) {
+			return;
+		}
+		if (presentWaitEnabled) {
+			try {
+				if (wait) {
+					//nothing was presented to a freshly recreated swapchain yet, an id from the old one would never
+					//come back. Bounded, a frame that is never shown (minimized, occluded) must not stall the loop.
+					if (lastPresentId != 0 &&
+					    swapChain.waitForPresent(lastPresentId, PRESENT_WAIT_TIMEOUT_NS) != vk::Result::eTimeout) {
+						framePacer->completed(lastPresentId, FramePacer::Clock::now());
+					}
+					return;
+				}
+				for (auto frame = framePacer->oldestPending(); frame && *frame <= lastPresentId; frame = framePacer->oldestPending()) {
+					if (swapChain.waitForPresent(*frame, 0) == vk::Result::eTimeout) {
+						break;
+					}
+					framePacer->completed(*frame, FramePacer::Clock::now());
+				}
+			} catch (const vk::OutOfDateKHRError&) {
+				//the next acquire or present recreates the swapchain
+				framePacer->discardPending();
+			}
+			return;
+		}
+		if (wait) {
+			waitForTimeline(frameTimeline, submitted);
+			framePacer->completed(submitted, FramePacer::Clock::now());
+			return;
+		}
+		uint64_t finished = frameTimeline.getCounterValue();
+		if (auto oldest = framePacer->oldestPending(); oldest && *oldest <= finished) {
+			framePacer->completed(finished, FramePacer::Clock::now());
+		}
 	}
 
 	void createSyncObjects() {
-		presentCompleteSemaphore = vk::raii::Semaphore(device, vk::SemaphoreCreateInfo());
-		renderFinishedSemaphore = vk::raii::Semaphore(device, vk::SemaphoreCreateInfo());
-		drawFence = vk::raii::Fence(device, {.flags = vk::FenceCreateFlagBits::eSignaled});
+		presentCompleteSemaphores.clear();
+		renderFinishedSemaphores.clear();
+
+		for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
+			presentCompleteSemaphores.emplace_back(device, vk::SemaphoreCreateInfo());
+		}
+		createRenderFinishedSemaphores();
+		//starts at 0 like slotTimelineValues, so the first wait on each slot falls straight through
+		frameTimeline = createTimelineSemaphore();
+		frameTimelineValue = 0;
+		slotTimelineValues.fill(0);
+	}
+
+	[[nodiscard]] vk::raii::Semaphore createTimelineSemaphore() const {
+		vk::SemaphoreTypeCreateInfo typeInfo{ .semaphoreType = vk::SemaphoreType::eTimeline, .initialValue = 0 };
+		return vk::raii::Semaphore(device, vk::SemaphoreCreateInfo{ .pNext = &typeInfo });
+	}
+
+	void waitForTimeline(const vk::raii::Semaphore& timeline, uint64_t value) const {
+		vk::SemaphoreWaitInfo waitInfo{ .semaphoreCount = 1, .pSemaphores = &*timeline, .pValues = &value };
+		while ( vk::Result::eTimeout == device.waitSemaphores( waitInfo, UINT64_MAX ) );
+	}
+
+	void createRenderFinishedSemaphores() {
+		renderFinishedSemaphores.clear();
+		for (size_t i = 0; i < swapChainImages.size(); i++) {
+			renderFinishedSemaphores.emplace_back(device, vk::SemaphoreCreateInfo());
+		}
 	}
 
 	void drawFrame(){
-		presentQueue.waitIdle();
-		auto [result, imageIndex] = swapChain.acquireNextImage( UINT64_MAX, *presentCompleteSemaphore, nullptr );
+		//only wait for the gpu to finish the last frame that used this slot, not the whole queue
+		waitForTimeline(frameTimeline, slotTimelineValues[currentFrame]);
+		if (culler) {
+			lastVisibleCount = culler->visibleCount(currentFrame);
+		}
+		uint64_t completedValue = frameTimeline.getCounterValue();
+		deletionQueue.collect(completedValue);
+		frameUniforms->retire(completedValue);
+		if (frameCapture) {
+			frameCapture->collect(completedValue);
+		}
+		//frame boundary, nothing recorded from here on can reference the old pipeline
+		if (shaderReloader) {
+			if (auto reloaded = shaderReloader->takeReady()) {
+				deletionQueue.retire(std::move(pipelineVariants), frameTimelineValue);
+				pipelineVariants = std::move(*reloaded);
+			}
+		}
+		if (animateScene) {
+			updateScene();
+		}
+		//never blocks, hands decoded textures to the transfer queue
+		if (textureStreamer) {
+			textureStreamer->update(completedValue);
+		}
+
+		//headless images are tied 1:1 to frame slots so there is nothing to acquire
+		uint32_t imageIndex = currentFrame;
+		if (!config.headless) {
+			//out of date throws, nothing was acquired or signaled so the slot is simply tried again next call
+			try {
+				auto [result, acquiredIndex] = swapChain.acquireNextImage( UINT64_MAX, *presentCompleteSemaphores[currentFrame], nullptr );
+				imageIndex = acquiredIndex;
+			} catch (const vk::OutOfDateKHRError&) {
+				recreateSwapChain();
+				return;
+			}
+		}
+
+		commandBuffers[currentFrame].reset();
+
+		auto recordStart = std::chrono::steady_clock::now();
 		recordCommandBuffer(imageIndex);
-		device.resetFences( *drawFence );
-		vk::PipelineStageFlags waitDestinationStageMask( vk::PipelineStageFlagBits::eColorAttachmentOutput );
-		const vk::SubmitInfo submitInfo{
-			.waitSemaphoreCount = 1,
-			.pWaitSemaphores = &*presentCompleteSemaphore,
-			.pWaitDstStageMask = &waitDestinationStageMask,
-			.commandBufferCount = 1,
-			.pCommandBuffers = &*commandBuffer,
-			.signalSemaphoreCount = 1,
-			.pSignalSemaphores = &*renderFinishedSemaphore };
-		graphicsQueue.submit(submitInfo, *drawFence);
-
-		while ( vk::Result::eTimeout == device.waitForFences( *drawFence, vk::True, UINT64_MAX ) );
-
-		const vk::PresentInfoKHR presentInfoKHR{
-			.waitSemaphoreCount = 1,
-			.pWaitSemaphores = &*renderFinishedSemaphore,
-			.swapchainCount = 1,
-			.pSwapchains = &*swapChain,
-			.pImageIndices = &imageIndex };
-
-		result = presentQueue.presentKHR(presentInfoKHR);
-	}
-
-	[[nodiscard]] vk::raii::ShaderModule createShaderModule(const std::vector<char>& code) const {
+		lastRecordMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - recordStart).count();
+
+		//present still needs binary semaphores, the timeline signal is what the cpu side waits on
+		uint64_t signalValue = ++frameTimelineValue;
+		std::vector<vk::SemaphoreSubmitInfo> waitInfos;
+		if (!config.headless) {
+			waitInfos.push_back(vk::SemaphoreSubmitInfo{
+				.semaphore = presentCompleteSemaphores[currentFrame],
+				.stageMask = vk::PipelineStageFlagBits2::eColorAttachmentOutput });
+		}
+		if (textureStreamer) {
+			//already reached on the host, this only orders the mip blits/acquire after the transfer queue's copies
+			waitInfos.push_back(vk::SemaphoreSubmitInfo{
+				.semaphore = textureStreamer->timeline(),
+				.value = textureStreamer->graphicsWaitValue(),
+				.stageMask = vk::PipelineStageFlagBits2::eAllTransfer });
+		}
+		std::array<vk::SemaphoreSubmitInfo, 2> signalInfos = {
+			vk::SemaphoreSubmitInfo{
+				.semaphore = frameTimeline,
+				.value = signalValue,
+				.stageMask = vk::PipelineStageFlagBits2::eAllCommands },
+			vk::SemaphoreSubmitInfo{
+				.semaphore = config.headless ? vk::Semaphore{} : *renderFinishedSemaphores[imageIndex],
+				.stageMask = vk::PipelineStageFlagBits2::eAllCommands } };
+		vk::CommandBufferSubmitInfo commandBufferInfo{ .commandBuffer = commandBuffers[currentFrame] };
+		const vk::SubmitInfo2 submitInfo{
+			.waitSemaphoreInfoCount = static_cast<uint32_t>(waitInfos.size()),
+			.pWaitSemaphoreInfos = waitInfos.data(),
+			.commandBufferInfoCount = 1,
+			.pCommandBufferInfos = &commandBufferInfo,
+			.signalSemaphoreInfoCount = config.headless ? 1u : 2u,
+			.pSignalSemaphoreInfos = signalInfos.data() };
+		graphicsQueue.submit2(submitInfo);
+		slotTimelineValues[currentFrame] = signalValue;
+
+		if (!config.headless) {
+			vk::PresentIdKHR presentId{ .swapchainCount = 1, .pPresentIds = &signalValue };
+			const vk::PresentInfoKHR presentInfoKHR{
+				.pNext = presentWaitEnabled ? &presentId : nullptr,
+				.waitSemaphoreCount = 1,
+				.pWaitSemaphores = &*renderFinishedSemaphores[imageIndex],
+				.swapchainCount = 1,
+				.pSwapchains = &*swapChain,
+				.pImageIndices = &imageIndex };
+
+			//suboptimal still presented, so it only needs a recreate before the next acquire
+			bool outOfDate = false;
+			try {
+				outOfDate = presentQueue.presentKHR(presentInfoKHR) == vk::Result::eSuboptimalKHR;
+				lastPresentId = signalValue;
+			} catch (const vk::OutOfDateKHRError&) {
+				outOfDate = true;
+			}
+			if (outOfDate || framebufferResized) {
+				recreateSwapChain();
+			}
+		}
+
+		if (!firstFrameReported) {
+			startupTimings.mark("first_frame");
+			startupTimings.report(std::cout, pipelineCache->describe());
+			firstFrameReported = true;
+		}
+
+		currentFrame = (currentFrame + 1) % MAX_FRAMES_IN_FLIGHT;
+	}
+
+	//takes words straight out of the mapped file, no copy and no unaligned reinterpret
+	[[nodiscard]] vk::raii::ShaderModule createShaderModule(std::span<const uint32_t> code) const {
 		vk::ShaderModuleCreateInfo createInfo{
-			.codeSize = code.size()*sizeof(char), 
-			.pCode = reinterpret_cast<const uint32_t*>(code.data())	};
+			.codeSize = code.size_bytes(), 
+			.pCode = code.data() };
 		
 		vk::raii::ShaderModule shaderModule{ device, createInfo };
 		return shaderModule;
@@ -603,10 +2064,18 @@ private:
 		return availableFormats[0];
 	}
 
+	//first mode of the policy's preference list the surface supports, fifo is guaranteed to exist
 	vk::PresentModeKHR chooseSwapPresentMode(const std::vector<vk::PresentModeKHR>& availablePresentModes) {
-		for (const auto& availablePresentMode : availablePresentModes) {
-			if (availablePresentMode == vk::PresentModeKHR::eMailbox) {
-				return availablePresentMode;
+		std::vector<vk::PresentModeKHR> preferred;
+		switch (config.presentMode) {
+			case PresentPolicy::Fifo:		preferred = { vk::PresentModeKHR::eFifo }; break;
+			case PresentPolicy::FifoRelaxed:	preferred = { vk::PresentModeKHR::eFifoRelaxed }; break;
+			case PresentPolicy::Mailbox:		preferred = { vk::PresentModeKHR::eMailbox }; break;
+			case PresentPolicy::Immediate:		preferred = { vk::PresentModeKHR::eImmediate, vk::PresentModeKHR::eMailbox }; break;
+		}
+		for (vk::PresentModeKHR mode : preferred) {
+			if (std::ranges::find(availablePresentModes, mode) != availablePresentModes.end()) {
+				return mode;
 			}
 		}
 		return vk::PresentModeKHR::eFifo;
@@ -626,17 +2095,85 @@ private:
 	}
 
 	void mainLoop(){
-		while(!glfwWindowShouldClose(window)) {
-			glfwPollEvents();
-			drawFrame();
+		if (config.headless) {
+			//no window to close, so just render the requested number of frames
+			for (uint32_t i = 0; i < std::max(1u, config.benchmarkFrames); i++) {
+				beginFrame();
+				drawFrame();
+			}
+		} else {
+			while(!glfwWindowShouldClose(window)) {
+				beginFrame();
+				glfwPollEvents();
+				drawFrame();
+			}
 		}
 		device.waitIdle();
+		collectFrameLatency(true);
 	}
 
 	void cleanup() {
-		glfwDestroyWindow(window);
+		//stop background pipeline builds before anything they use is saved or torn down
+		shaderReloader.reset();
+		if (config.profile) {
+			deletionQueue.report(std::cout);
+		}
+		deletionQueue.flush();
+		if (textureStreamer) {
+			//the device is idle, account the textures made resident by the last frames
+			textureStreamer->collect(frameTimeline.getCounterValue());
+			textureStreamer->statistics().report(std::cout);
+		}
+		if (pipelineCache) {
+			pipelineCache->save();
+		}
+		if (frameCapture) {
+			//the device is idle, so every captured frame is done and only has to get through the sink
+			frameCapture->collect(frameTimeline.getCounterValue());
+			frameCapture->finish();
+			frameCapture->statistics().report(std::cout);
+		}
+		if (scene && config.profile && sceneUpdates > 0) {
+			double averageMs = sceneUpdateMs / static_cast<double>(sceneUpdates);
+			std::cout << "[scene] objects=" << scene->size() << " levels=" << scene->levelCount()
+				  << " threads=" << sceneJobs->workerCount() << " simd=" << (SceneStore::simdAvailable() ? "avx2" : "scalar")
+				  << " update_ms=" << averageMs << " ns_per_object=" << averageMs * 1e6 / scene->size() << "\n";
+		}
+		if (pipelineVariants && config.profile) {
+			pipelineVariants->statistics().report(std::cout);
+		}
+		if (allocator && config.profile) {
+			allocator->stats().report(std::cout);
+		}
+		if (renderGraph && config.profile) {
+			renderGraph->statistics().report(std::cout);
+		}
+		if (framePacer && (framePacer->pacing() || config.profile)) {
+			framePacer->report(std::cout, presentWaitEnabled ? "present" : "gpu");
+		}
+		if (dynamicResolution) {
+			dynamicResolution->statistics().report(std::cout);
+		}
+		if (culler) {
+			std::cout << "[cull] submitted=" << culler->submittedCount() << " visible=" << lastVisibleCount << "\n";
+		}
 
-		glfwTerminate();
+		if (profiler) {
+			//normally idle already, the last frames' queries have to be finished to be read
+			device.waitIdle();
+			profiler->collectAll();
+			profiler->printSummary(std::cout);
+			if (!config.tracePath.empty()) {
+				profiler->writeChromeTrace(config.tracePath);
+			}
+		}
+
+		if (window) {
+			glfwDestroyWindow(window);
+			window = nullptr;
+
+			glfwTerminate();
+		}
 	}
 };
 
@@ -0,0 +1,140 @@
+#pragma once
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+//Tiny fork/join pool. parallelFor() splits a range into one contiguous chunk per worker, runs chunk 0 on the
+//calling thread and the rest on persistent worker threads, and returns once every chunk is done.
+//The worker index handed to the callback is stable, so callers can keep per-worker state (command pools,
+//scratch arenas) indexed by it without any locking.
+class JobSystem {
+public:
+	using ChunkFn = std::function<void(uint32_t worker, uint32_t begin, uint32_t end)>;
+
+	//threadCount includes the calling thread, 0 means one per hardware thread
+	explicit JobSystem(uint32_t threadCount) {
+		if (threadCount == 0) {
+			threadCount = std::max(1u, std::thread::hardware_concurrency());
+		}
+		workers = threadCount;
+		for (uint32_t worker = 1; worker < workers; worker++) {
+			threads.emplace_back([this, worker] { workerLoop(worker); });
+		}
+	}
+
+	~JobSystem() {
+		{
+			std::lock_guard lock(mutex);
+			stopping = true;
+		}
+		wake.notify_all();
+		for (auto& thread : threads) {
+			thread.join();
+		}
+	}
+
+	JobSystem(const JobSystem&) = delete;
+	JobSystem& operator=(const JobSystem&) = delete;
+
+	[[nodiscard]] uint32_t workerCount() const { return workers; }
+
+	//Returns how many chunks (and therefore workers 0..n-1) were used. Rethrows the first exception any chunk threw.
+	uint32_t parallelFor(uint32_t count, const ChunkFn& fn) {
+		uint32_t chunks = std::min(count, workers);
+		if (chunks <= 1) {
+			if (count > 0) {
+				fn(0, 0, count);
+			}
+			return chunks;
+		}
+
+		{
+			std::lock_guard lock(mutex);
+			job = &fn;
+			jobCount = count;
+			jobChunks = chunks;
+			pending = chunks - 1;
+			error = nullptr;
+			generation++;
+		}
+		wake.notify_all();
+
+		std::exception_ptr callerError;
+		try {
+			runChunk(0);
+		} catch (...) {
+			callerError = std::current_exception();
+		}
+
+		std::unique_lock lock(mutex);
+		done.wait(lock, [this] { return pending == 0; });
+		job = nullptr;
+		if (callerError) {
+			std::rethrow_exception(callerError);
+		}
+		if (error) {
+			std::rethrow_exception(error);
+		}
+		return chunks;
+	}
+
+private:
+	uint32_t workers = 1;
+	std::vector<std::thread> threads;
+
+	std::mutex mutex;
+	std::condition_variable wake;
+	std::condition_variable done;
+	bool stopping = false;
+	uint64_t generation = 0;
+
+	//only written under the mutex before generation is bumped, so workers that saw the new generation can read them freely
+	const ChunkFn* job = nullptr;
+	uint32_t jobCount = 0;
+	uint32_t jobChunks = 0;
+	uint32_t pending = 0;
+	std::exception_ptr error;
+
+	void runChunk(uint32_t worker) {
+		uint32_t begin = static_cast<uint32_t>(static_cast<uint64_t>(jobCount) * worker / jobChunks);
+		uint32_t end = static_cast<uint32_t>(static_cast<uint64_t>(jobCount) * (worker + 1) / jobChunks);
+		(*job)(worker, begin, end);
+	}
+
+	void workerLoop(uint32_t worker) {
+		uint64_t seenGeneration = 0;
+		while (true) {
+			std::unique_lock lock(mutex);
+			wake.wait(lock, [&] { return stopping || generation != seenGeneration; });
+			if (stopping) {
+				return;
+			}
+			seenGeneration = generation;
+			if (worker >= jobChunks) {
+				continue;
+			}
+			lock.unlock();
+
+			std::exception_ptr chunkError;
+			try {
+				runChunk(worker);
+			} catch (...) {
+				chunkError = std::current_exception();
+			}
+
+			lock.lock();
+			if (chunkError && !error) {
+				error = chunkError;
+			}
+			if (--pending == 0) {
+				done.notify_one();
+			}
+		}
+	}
+};
@@ -0,0 +1,782 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cerrno>
+#include <charconv>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <numeric>
+#include <ostream>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "CookedMesh.hpp"
+
+//Uncompressed vertex as imported, 32 bytes
+struct MeshVertex {
+	float position[3];
+	float normal[3];
+	float uv[2];
+};
+
+struct ImportedMesh {
+	std::vector<MeshVertex> vertices;
+	std::vector<uint32_t> indices;		//triangle list
+};
+
+struct CookStats {
+	uint32_t vertices = 0;
+	uint32_t triangles = 0;
+	double acmrBefore = 0.0;	//average cache miss ratio (misses per triangle) of the imported order
+	double acmrAfter = 0.0;		//and of the cooked one, both with a FIFO_CACHE_SIZE fifo
+	uint32_t overdrawClusters = 0;
+	uint32_t meshlets = 0;
+	uint64_t bytesBefore = 0;	//float vertices and 32 bit indices
+	uint64_t bytesAfter = 0;	//the whole .mesh file
+
+	void report(std::ostream& out, const std::string& name) const {
+		out << std::fixed << std::setprecision(3)
+		    << "[assetcook] " << name
+		    << " vertices=" << vertices
+		    << " triangles=" << triangles
+		    << " acmr_before=" << acmrBefore
+		    << " acmr_after=" << acmrAfter
+		    << " clusters=" << overdrawClusters
+		    << " meshlets=" << meshlets
+		    << " bytes_before=" << bytesBefore
+		    << " bytes_after=" << bytesAfter << "\n";
+	}
+};
+
+//Offline geometry pipeline behind assetcook: imports a mesh, reorders it for the post transform vertex cache,
+//then for overdraw, then for vertex fetch, quantizes the vertices, splits it into meshlets and writes a CookedMesh.
+class MeshCooker {
+public:
+	static constexpr uint32_t FIFO_CACHE_SIZE = 16;		//what acmr() simulates, a conservative hardware cache
+	static constexpr uint32_t OPTIMIZE_CACHE_SIZE = 32;	//what optimizeVertexCache() scores against
+
+	//Wavefront obj: v/vt/vn/f, polygons are fanned into triangles. Normals are generated when the file has none,
+	//v is flipped since obj puts the uv origin at the bottom.
+	static ImportedMesh importObj(std::string_view text) {
+		std::vector<std::array<float, 3>> positions;
+		std::vector<std::array<float, 3>> normals;
+		std::vector<std::array<float, 2>> uvs;
+		ImportedMesh mesh;
+		std::vector<bool> hasNormal;
+		//(position, uv, normal) index triples already turned into a vertex
+		std::unordered_map<uint64_t, uint32_t> vertexOf;
+
+		size_t lineNumber = 0;
+		while (!text.empty()) {
+			size_t end = text.find('\n');
+			std::string_view line = text.substr(0, end);
+			text.remove_prefix(end == std::string_view::npos ? text.size() : end + 1);
+			lineNumber++;
+
+			std::string_view keyword = nextToken(line);
+			if (keyword == "v") {
+				positions.push_back({ parseFloat(line, lineNumber), parseFloat(line, lineNumber), parseFloat(line, lineNumber) });
+			} else if (keyword == "vn") {
+				normals.push_back({ parseFloat(line, lineNumber), parseFloat(line, lineNumber), parseFloat(line, lineNumber) });
+			} else if (keyword == "vt") {
+				float u = parseFloat(line, lineNumber);
+				float v = parseFloat(line, lineNumber);
+				uvs.push_back({ u, 1.0f - v });
+			} else if (keyword == "f") {
+				std::vector<uint32_t> polygon;
+				for (std::string_view corner = nextToken(line); !corner.empty(); corner = nextToken(line)) {
+					std::array<int64_t, 3> ref = { 0, 0, 0 };	//position, uv, normal, 0 = absent
+					for (size_t part = 0; part < 3 && !corner.empty(); part++) {
+						size_t slash = corner.find('/');
+						std::string_view number = corner.substr(0, slash);
+						if (!number.empty()) {
+							ref[part] = resolveIndex(parseInt(number, lineNumber), part == 0 ? positions.size() :
+								part == 1 ? uvs.size() : normals.size(), lineNumber);
+						}
+						corner.remove_prefix(slash == std::string_view::npos ? corner.size() : slash + 1);
+					}
+					if (ref[0] == 0) {
+						throw std::runtime_error("obj line " + std::to_string(lineNumber) + ": face corner without a position");
+					}
+					if (ref[0] >= (1 << 22) || ref[1] >= (1 << 21) || ref[2] >= (1 << 21)) {
+						throw std::runtime_error("obj has too many elements to index");
+					}
+					uint64_t key = uint64_t(ref[0]) | uint64_t(ref[1]) << 22 | uint64_t(ref[2]) << 43;
+					auto [it, inserted] = vertexOf.try_emplace(key, static_cast<uint32_t>(mesh.vertices.size()));
+					if (inserted) {
+						MeshVertex vertex{};
+						std::ranges::copy(positions[ref[0] - 1], vertex.position);
+						if (ref[1]) {
+							std::ranges::copy(uvs[ref[1] - 1], vertex.uv);
+						}
+						if (ref[2]) {
+							std::ranges::copy(normals[ref[2] - 1], vertex.normal);
+						}
+						mesh.vertices.push_back(vertex);
+						hasNormal.push_back(ref[2] != 0);
+					}
+					polygon.push_back(it->second);
+				}
+				for (size_t i = 2; i < polygon.size(); i++) {
+					mesh.indices.insert(mesh.indices.end(), { polygon[0], polygon[i - 1], polygon[i] });
+				}
+			}
+			//groups, materials, smoothing groups and comments don't change the geometry
+		}
+		if (mesh.indices.empty()) {
+			throw std::runtime_error("obj has no faces");
+		}
+		generateMissingNormals(mesh, hasNormal);
+		return mesh;
+	}
+
+	//Runs the whole pipeline and writes outputPath
+	static CookStats cook(const ImportedMesh& mesh, const std::string& outputPath) {
+		CookStats stats;
+		auto vertexCount = static_cast<uint32_t>(mesh.vertices.size());
+		stats.triangles = static_cast<uint32_t>(mesh.indices.size() / 3);
+		stats.acmrBefore = acmr(mesh.indices, vertexCount);
+		stats.bytesBefore = mesh.vertices.size() * sizeof(MeshVertex) + mesh.indices.size() * sizeof(uint32_t);
+
+		std::vector<uint32_t> indices = optimizeVertexCache(mesh.indices, vertexCount);
+		indices = optimizeOverdraw(indices, mesh.vertices, stats.overdrawClusters);
+		std::vector<MeshVertex> vertices = optimizeVertexFetch(indices, mesh.vertices);
+		stats.vertices = static_cast<uint32_t>(vertices.size());
+		stats.acmrAfter = acmr(indices, stats.vertices);
+
+		MeshletData meshlets = buildMeshlets(indices, vertices);
+		stats.meshlets = static_cast<uint32_t>(meshlets.meshlets.size());
+		stats.bytesAfter = write(outputPath, vertices, indices, meshlets);
+		return stats;
+	}
+
+	//Post transform cache misses per triangle with a fifo cache, 0.5 is the ideal for a regular grid and 3 the worst
+	static double acmr(const std::vector<uint32_t>& indices, uint32_t vertexCount, uint32_t cacheSize = FIFO_CACHE_SIZE) {
+		if (indices.empty()) {
+			return 0.0;
+		}
+		//a vertex is cached while fewer than cacheSize misses happened since it was loaded
+		std::vector<uint64_t> loadedAt(vertexCount, 0);
+		uint64_t misses = 0;
+		for (uint32_t index : indices) {
+			if (loadedAt[index] == 0 || misses + 1 - loadedAt[index] > cacheSize) {
+				misses++;
+				loadedAt[index] = misses;
+			}
+		}
+		return static_cast<double>(misses) / static_cast<double>(indices.size() / 3);
+	}
+
+	//Tom Forsyth's "linear-speed vertex cache optimisation": greedily emit the triangle whose vertices score highest,
+	//where a vertex scores for being recently used (in the simulated lru cache) and for having few triangles left
+	static std::vector<uint32_t> optimizeVertexCache(const std::vector<uint32_t>& indices, uint32_t vertexCount) {
+		const size_t triangleCount = indices.size() / 3;
+
+		//triangles of every vertex, the first remaining[v] entries of its range are the ones not emitted yet
+		std::vector<uint32_t> remaining(vertexCount, 0);
+		for (uint32_t index : indices) {
+			remaining[index]++;
+		}
+		std::vector<uint32_t> firstTriangle(vertexCount + 1, 0);
+		std::inclusive_scan(remaining.begin(), remaining.end(), firstTriangle.begin() + 1);
+		std::vector<uint32_t> vertexTriangles(indices.size());
+		{
+			std::vector<uint32_t> fill(firstTriangle.begin(), firstTriangle.end() - 1);
+			for (size_t i = 0; i < indices.size(); i++) {
+				vertexTriangles[fill[indices[i]]++] = static_cast<uint32_t>(i / 3);
+			}
+		}
+
+		std::vector<int32_t> cachePosition(vertexCount, -1);
+		auto vertexScore = [&](uint32_t vertex) {
+			if (remaining[vertex] == 0) {
+				return -1.0f;
+			}
+			float score = 0.0f;
+			int32_t position = cachePosition[vertex];
+			if (position >= 0) {
+				//the last triangle's vertices get a fixed score so its neighbours aren't preferred over each other
+				score = position < 3 ? 0.75f : std::pow(1.0f - static_cast<float>(position - 3) / (OPTIMIZE_CACHE_SIZE - 3), 1.5f);
+			}
+			return score + 2.0f / std::sqrt(static_cast<float>(remaining[vertex]));
+		};
+		std::vector<float> scores(vertexCount);
+		for (uint32_t v = 0; v < vertexCount; v++) {
+			scores[v] = vertexScore(v);
+		}
+		std::vector<float> triangleScores(triangleCount);
+		for (size_t t = 0; t < triangleCount; t++) {
+			triangleScores[t] = scores[indices[t * 3]] + scores[indices[t * 3 + 1]] + scores[indices[t * 3 + 2]];
+		}
+
+		std::vector<bool> emitted(triangleCount, false);
+		std::vector<uint32_t> output;
+		output.reserve(indices.size());
+		std::vector<uint32_t> cache;
+		std::vector<uint32_t> nextCache;
+		size_t cursor = 0;
+		int64_t best = triangleCount > 0 ? std::distance(triangleScores.begin(), std::ranges::max_element(triangleScores)) : -1;
+
+		while (output.size() < triangleCount * 3) {
+			if (best < 0) {
+				//dead end, nothing in the cache touches a remaining triangle
+				while (emitted[cursor]) {
+					cursor++;
+				}
+				best = static_cast<int64_t>(cursor);
+			}
+			auto triangle = static_cast<size_t>(best);
+			emitted[triangle] = true;
+			for (size_t corner = 0; corner < 3; corner++) {
+				uint32_t vertex = indices[triangle * 3 + corner];
+				output.push_back(vertex);
+				auto begin = vertexTriangles.begin() + firstTriangle[vertex];
+				auto live = std::find(begin, begin + remaining[vertex], static_cast<uint32_t>(triangle));
+				std::iter_swap(live, begin + remaining[vertex] - 1);
+				remaining[vertex]--;
+			}
+
+			//most recent first, the emitted triangle's vertices move to the front
+			nextCache.assign(indices.begin() + static_cast<std::ptrdiff_t>(triangle * 3),
+					 indices.begin() + static_cast<std::ptrdiff_t>(triangle * 3 + 3));
+			for (uint32_t vertex : cache) {
+				if (std::ranges::find(nextCache, vertex) == nextCache.end()) {
+					nextCache.push_back(vertex);
+				}
+			}
+			for (size_t i = 0; i < nextCache.size(); i++) {
+				cachePosition[nextCache[i]] = i < OPTIMIZE_CACHE_SIZE ? static_cast<int32_t>(i) : -1;
+			}
+			//vertices pushed out of the cache still need their score lowered
+			for (uint32_t vertex : nextCache) {
+				scores[vertex] = vertexScore(vertex);
+			}
+			if (nextCache.size() > OPTIMIZE_CACHE_SIZE) {
+				nextCache.resize(OPTIMIZE_CACHE_SIZE);
+			}
+
+			best = -1;
+			float bestScore = -1.0f;
+			//only triangles touching a vertex whose score changed can change score
+			auto rescore = [&](uint32_t vertex) {
+				for (uint32_t i = 0; i < remaining[vertex]; i++) {
+					uint32_t t = vertexTriangles[firstTriangle[vertex] + i];
+					triangleScores[t] = scores[indices[t * 3]] + scores[indices[t * 3 + 1]] + scores[indices[t * 3 + 2]];
+					if (triangleScores[t] > bestScore) {
+						bestScore = triangleScores[t];
+						best = t;
+					}
+				}
+			};
+			for (uint32_t vertex : cache) {
+				if (cachePosition[vertex] < 0) {
+					rescore(vertex);
+				}
+			}
+			for (uint32_t vertex : nextCache) {
+				rescore(vertex);
+			}
+			std::swap(cache, nextCache);
+		}
+		return output;
+	}
+
+	//Sander et al. "Fast triangle reordering for vertex locality and reduced overdraw": cut the cache optimized order
+	//into clusters, then draw the clusters facing out from the mesh center first so they occlude what comes after.
+	//Each cluster is simulated with a cold cache (it may end up anywhere) and closed as soon as it has
+	//MIN_CLUSTER_TRIANGLES and its own acmr is within OVERDRAW_LAMBDA of the whole mesh's, which bounds what the cuts
+	//cost. A triangle missing on all three vertices is a free cut, the cache was cold there anyway.
+	static std::vector<uint32_t> optimizeOverdraw(const std::vector<uint32_t>& indices, const std::vector<MeshVertex>& vertices,
+			uint32_t& clusterCount)
+	{
+		constexpr size_t MIN_CLUSTER_TRIANGLES = 16;
+		constexpr double OVERDRAW_LAMBDA = 1.05;
+		const size_t triangleCount = indices.size() / 3;
+		const double threshold = acmr(indices, static_cast<uint32_t>(vertices.size())) * OVERDRAW_LAMBDA;
+
+		std::vector<size_t> clusterStarts = { 0 };
+		std::vector<uint64_t> loadedAt(vertices.size(), 0);
+		uint64_t misses = 0;
+		uint64_t clusterFirstMiss = 1;		//anything loaded before this is treated as not cached
+		for (size_t t = 0; t < triangleCount; t++) {
+			uint32_t triangleMisses = 0;
+			for (size_t corner = 0; corner < 3; corner++) {
+				uint32_t index = indices[t * 3 + corner];
+				if (loadedAt[index] < clusterFirstMiss || misses + 1 - loadedAt[index] > FIFO_CACHE_SIZE) {
+					misses++;
+					loadedAt[index] = misses;
+					triangleMisses++;
+				}
+			}
+			size_t clusterTriangles = t - clusterStarts.back() + 1;
+			if (triangleMisses == 3 && clusterTriangles > MIN_CLUSTER_TRIANGLES) {
+				//cold anyway, t starts the next cluster
+				clusterStarts.push_back(t);
+				clusterFirstMiss = misses - 2;
+			} else if (clusterTriangles >= MIN_CLUSTER_TRIANGLES && t + 1 < triangleCount &&
+			           static_cast<double>(misses + 1 - clusterFirstMiss) <= threshold * static_cast<double>(clusterTriangles)) {
+				clusterStarts.push_back(t + 1);
+				clusterFirstMiss = misses + 1;
+			}
+		}
+		clusterStarts.push_back(triangleCount);
+		clusterCount = static_cast<uint32_t>(clusterStarts.size() - 1);
+
+		std::array<double, 3> meshCenter = { 0.0, 0.0, 0.0 };
+		for (const MeshVertex& vertex : vertices) {
+			for (size_t axis = 0; axis < 3; axis++) {
+				meshCenter[axis] += vertex.position[axis] / static_cast<double>(vertices.size());
+			}
+		}
+
+		//area weighted centroid and normal of each cluster
+		std::vector<double> sortKey(clusterCount);
+		for (uint32_t c = 0; c < clusterCount; c++) {
+			std::array<double, 3> centroid = { 0.0, 0.0, 0.0 };
+			std::array<double, 3> normal = { 0.0, 0.0, 0.0 };
+			double area = 0.0;
+			for (size_t t = clusterStarts[c]; t < clusterStarts[c + 1]; t++) {
+				const float* a = vertices[indices[t * 3]].position;
+				const float* b = vertices[indices[t * 3 + 1]].position;
+				const float* e = vertices[indices[t * 3 + 2]].position;
+				std::array<double, 3> cross = triangleNormal(a, b, e);
+				double triangleArea = std::sqrt(cross[0] * cross[0] + cross[1] * cross[1] + cross[2] * cross[2]);
+				for (size_t axis = 0; axis < 3; axis++) {
+					centroid[axis] += (a[axis] + b[axis] + e[axis]) / 3.0 * triangleArea;
+					normal[axis] += cross[axis];
+				}
+				area += triangleArea;
+			}
+			double length = std::sqrt(normal[0] * normal[0] + normal[1] * normal[1] + normal[2] * normal[2]);
+			double key = 0.0;
+			if (area > 0.0 && length > 0.0) {
+				for (size_t axis = 0; axis < 3; axis++) {
+					key += (centroid[axis] / area - meshCenter[axis]) * normal[axis] / length;
+				}
+			}
+			sortKey[c] = key;
+		}
+
+		std::vector<uint32_t> order(clusterCount);
+		std::iota(order.begin(), order.end(), 0u);
+		std::ranges::stable_sort(order, [&](uint32_t a, uint32_t b) { return sortKey[a] > sortKey[b]; });
+
+		std::vector<uint32_t> output;
+		output.reserve(indices.size());
+		for (uint32_t c : order) {
+			output.insert(output.end(), indices.begin() + static_cast<std::ptrdiff_t>(clusterStarts[c] * 3),
+				indices.begin() + static_cast<std::ptrdiff_t>(clusterStarts[c + 1] * 3));
+		}
+		return output;
+	}
+
+	//Renumbers vertices in the order the index buffer first uses them (dropping unused ones), so vertex fetches walk
+	//memory forwards instead of jumping around
+	static std::vector<MeshVertex> optimizeVertexFetch(std::vector<uint32_t>& indices, const std::vector<MeshVertex>& vertices) {
+		std::vector<uint32_t> remap(vertices.size(), UINT32_MAX);
+		std::vector<MeshVertex> output;
+		output.reserve(vertices.size());
+		for (uint32_t& index : indices) {
+			if (remap[index] == UINT32_MAX) {
+				remap[index] = static_cast<uint32_t>(output.size());
+				output.push_back(vertices[index]);
+			}
+			index = remap[index];
+		}
+		return output;
+	}
+
+	struct MeshletData {
+		std::vector<Meshlet> meshlets;
+		std::vector<uint32_t> vertices;
+		std::vector<uint8_t> triangles;
+	};
+
+	//Greedy in index order (which the passes above already made local): a meshlet is closed once the next
+	//triangle would take it past MAX_VERTICES or MAX_TRIANGLES
+	static MeshletData buildMeshlets(const std::vector<uint32_t>& indices, const std::vector<MeshVertex>& vertices) {
+		MeshletData data;
+		std::vector<uint8_t> localIndex(vertices.size(), UINT8_MAX);
+		Meshlet current{};
+
+		auto finish = [&]() {
+			if (current.triangleCount == 0) {
+				return;
+			}
+			computeBounds(current, data, vertices);
+			for (uint32_t i = 0; i < current.vertexCount; i++) {
+				localIndex[data.vertices[current.vertexOffset + i]] = UINT8_MAX;
+			}
+			data.meshlets.push_back(current);
+			current = Meshlet{};
+			current.vertexOffset = static_cast<uint32_t>(data.vertices.size());
+			current.triangleOffset = static_cast<uint32_t>(data.triangles.size() / 3);
+		};
+
+		for (size_t t = 0; t < indices.size() / 3; t++) {
+			uint32_t newVertices = 0;
+			for (size_t corner = 0; corner < 3; corner++) {
+				newVertices += localIndex[indices[t * 3 + corner]] == UINT8_MAX ? 1 : 0;
+			}
+			if (current.vertexCount + newVertices > Meshlet::MAX_VERTICES || current.triangleCount + 1 > Meshlet::MAX_TRIANGLES) {
+				finish();
+			}
+			for (size_t corner = 0; corner < 3; corner++) {
+				uint32_t vertex = indices[t * 3 + corner];
+				if (localIndex[vertex] == UINT8_MAX) {
+					localIndex[vertex] = static_cast<uint8_t>(current.vertexCount++);
+					data.vertices.push_back(vertex);
+				}
+				data.triangles.push_back(localIndex[vertex]);
+			}
+			current.triangleCount++;
+		}
+		finish();
+		return data;
+	}
+
+	static uint16_t floatToHalf(float value) {
+		uint32_t bits = std::bit_cast<uint32_t>(value);
+		uint32_t sign = (bits >> 16) & 0x8000u;
+		int32_t exponent = static_cast<int32_t>((bits >> 23) & 0xffu) - 127 + 15;
+		uint32_t mantissa = bits & 0x7fffffu;
+		if (exponent >= 31) {
+			//overflow to infinity, nan stays nan
+			bool nan = ((bits >> 23) & 0xffu) == 0xffu && mantissa != 0;
+			return static_cast<uint16_t>(sign | 0x7c00u | (nan ? 0x200u : 0u));
+		}
+		if (exponent <= 0) {
+			if (exponent < -10) {
+				return static_cast<uint16_t>(sign);
+			}
+			//subnormal, shift the implicit bit in and round to nearest even
+			mantissa |= 0x800000u;
+			uint32_t shift = static_cast<uint32_t>(14 - exponent);
+			uint32_t half = mantissa >> shift;
+			uint32_t rest = mantissa & ((1u << shift) - 1);
+			uint32_t halfway = 1u << (shift - 1);
+			if (rest > halfway || (rest == halfway && (half & 1u))) {
+				half++;
+			}
+			return static_cast<uint16_t>(sign | half);
+		}
+		uint32_t half = sign | static_cast<uint32_t>(exponent) << 10 | mantissa >> 13;
+		uint32_t rest = mantissa & 0x1fffu;
+		if (rest > 0x1000u || (rest == 0x1000u && (half & 1u))) {
+			half++;	//may carry into the exponent, which is still the right rounding
+		}
+		return static_cast<uint16_t>(half);
+	}
+
+	static int8_t toSnorm8(float value) {
+		return static_cast<int8_t>(std::lround(std::clamp(value, -1.0f, 1.0f) * 127.0f));
+	}
+
+	static int16_t toSnorm16(float value) {
+		return static_cast<int16_t>(std::lround(std::clamp(value, -1.0f, 1.0f) * 32767.0f));
+	}
+
+	//Octahedral normal: project onto the octahedron |x| + |y| + |z| = 1 and fold the lower half over the upper one
+	static std::array<int8_t, 2> encodeOctahedral(const float normal[3]) {
+		float length = std::abs(normal[0]) + std::abs(normal[1]) + std::abs(normal[2]);
+		if (length == 0.0f) {
+			return { 0, 0 };
+		}
+		float x = normal[0] / length;
+		float y = normal[1] / length;
+		if (normal[2] < 0.0f) {
+			float foldedX = (1.0f - std::abs(y)) * (x >= 0.0f ? 1.0f : -1.0f);
+			float foldedY = (1.0f - std::abs(x)) * (y >= 0.0f ? 1.0f : -1.0f);
+			x = foldedX;
+			y = foldedY;
+		}
+		return { toSnorm8(x), toSnorm8(y) };
+	}
+
+private:
+	static std::string_view nextToken(std::string_view& line) {
+		size_t begin = line.find_first_not_of(" \t\r");
+		if (begin == std::string_view::npos) {
+			line = {};
+			return {};
+		}
+		size_t end = line.find_first_of(" \t\r", begin);
+		std::string_view token = line.substr(begin, end == std::string_view::npos ? std::string_view::npos : end - begin);
+		line.remove_prefix(end == std::string_view::npos ? line.size() : end);
+		return token;
+	}
+
+	static float parseFloat(std::string_view& line, size_t lineNumber) {
+		std::string_view token = nextToken(line);
+		float value = 0.0f;
+		auto [end, error] = std::from_chars(token.data(), token.data() + token.size(), value);
+		if (token.empty() || error != std::errc() || end != token.data() + token.size()) {
+			throw std::runtime_error("obj line " + std::to_string(lineNumber) + ": expected a number");
+		}
+		return value;
+	}
+
+	static int64_t parseInt(std::string_view token, size_t lineNumber) {
+		int64_t value = 0;
+		auto [end, error] = std::from_chars(token.data(), token.data() + token.size(), value);
+		if (error != std::errc() || end != token.data() + token.size()) {
+			throw std::runtime_error("obj line " + std::to_string(lineNumber) + ": expected an index");
+		}
+		return value;
+	}
+
+	//obj indices are 1 based, negative ones count back from the newest element
+	static int64_t resolveIndex(int64_t index, size_t count, size_t lineNumber) {
+		int64_t resolved = index < 0 ? static_cast<int64_t>(count) + index + 1 : index;
+		if (resolved < 1 || resolved > static_cast<int64_t>(count)) {
+			throw std::runtime_error("obj line " + std::to_string(lineNumber) + ": index out of range");
+		}
+		return resolved;
+	}
+
+	//unnormalized, its length is twice the triangle's area
+	static std::array<double, 3> triangleNormal(const float* a, const float* b, const float* c) {
+		std::array<double, 3> u = { b[0] - a[0], b[1] - a[1], b[2] - a[2] };
+		std::array<double, 3> v = { c[0] - a[0], c[1] - a[1], c[2] - a[2] };
+		return { u[1] * v[2] - u[2] * v[1], u[2] * v[0] - u[0] * v[2], u[0] * v[1] - u[1] * v[0] };
+	}
+
+	//Area weighted face normals for the vertices the obj gave none, averaged over vertices sharing a position so
+	//vertices split at uv seams still get the same normal
+	static void generateMissingNormals(ImportedMesh& mesh, const std::vector<bool>& hasNormal) {
+		if (std::ranges::all_of(hasNormal, [](bool has) { return has; })) {
+			return;
+		}
+		//positions sorted so equal ones are adjacent, each run of them is one group
+		std::vector<uint32_t> order(mesh.vertices.size());
+		std::iota(order.begin(), order.end(), 0u);
+		auto positionLess = [&mesh](uint32_t a, uint32_t b) {
+			const float* pa = mesh.vertices[a].position;
+			const float* pb = mesh.vertices[b].position;
+			return std::lexicographical_compare(pa, pa + 3, pb, pb + 3);
+		};
+		std::ranges::sort(order, positionLess);
+		std::vector<uint32_t> groupOf(mesh.vertices.size());
+		uint32_t groupCount = 0;
+		for (size_t i = 0; i < order.size(); i++) {
+			if (i > 0 && positionLess(order[i - 1], order[i])) {
+				groupCount++;
+			}
+			groupOf[order[i]] = groupCount;
+		}
+		groupCount++;
+
+		std::vector<std::array<double, 3>> accumulated(groupCount, { 0.0, 0.0, 0.0 });
+		for (size_t t = 0; t < mesh.indices.size() / 3; t++) {
+			const uint32_t* triangle = &mesh.indices[t * 3];
+			std::array<double, 3> normal = triangleNormal(mesh.vertices[triangle[0]].position,
+				mesh.vertices[triangle[1]].position, mesh.vertices[triangle[2]].position);
+			for (size_t corner = 0; corner < 3; corner++) {
+				for (size_t axis = 0; axis < 3; axis++) {
+					accumulated[groupOf[triangle[corner]]][axis] += normal[axis];
+				}
+			}
+		}
+		for (size_t v = 0; v < mesh.vertices.size(); v++) {
+			if (hasNormal[v]) {
+				continue;
+			}
+			const auto& n = accumulated[groupOf[v]];
+			double length = std::sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+			for (size_t axis = 0; axis < 3; axis++) {
+				mesh.vertices[v].normal[axis] = length > 0.0 ? static_cast<float>(n[axis] / length) : 0.0f;
+			}
+		}
+	}
+
+	//Bounding sphere around the aabb center, normal cone from the average triangle normal. The cone is built around
+	//the axis as it is stored (snorm8), so quantizing it can't make the test wrong:
+	//- the cutoff is the sine of the widest angle between a triangle normal and the axis, scaled by the stored axis'
+	//  length, so a viewer passing the test in Meshlet's comment sees every normal at more than 90 degrees
+	//- the apex sits on the axis behind every triangle's plane, so that viewer is also behind every triangle
+	//Cones wider than a hemisphere can't reject anything.
+	static void computeBounds(Meshlet& meshlet, const MeshletData& data, const std::vector<MeshVertex>& vertices) {
+		std::array<float, 3> low = { INFINITY, INFINITY, INFINITY };
+		std::array<float, 3> high = { -INFINITY, -INFINITY, -INFINITY };
+		for (uint32_t i = 0; i < meshlet.vertexCount; i++) {
+			const float* position = vertices[data.vertices[meshlet.vertexOffset + i]].position;
+			for (size_t axis = 0; axis < 3; axis++) {
+				low[axis] = std::min(low[axis], position[axis]);
+				high[axis] = std::max(high[axis], position[axis]);
+			}
+		}
+		float radius = 0.0f;
+		for (size_t axis = 0; axis < 3; axis++) {
+			meshlet.center[axis] = (low[axis] + high[axis]) * 0.5f;
+		}
+		for (uint32_t i = 0; i < meshlet.vertexCount; i++) {
+			const float* position = vertices[data.vertices[meshlet.vertexOffset + i]].position;
+			float dx = position[0] - meshlet.center[0], dy = position[1] - meshlet.center[1], dz = position[2] - meshlet.center[2];
+			radius = std::max(radius, std::sqrt(dx * dx + dy * dy + dz * dz));
+		}
+		meshlet.radius = radius;
+
+		//unit normals and a corner of every non degenerate triangle
+		std::vector<std::array<double, 3>> normals;
+		std::vector<const float*> corners;
+		std::array<double, 3> sum = { 0.0, 0.0, 0.0 };
+		for (uint32_t t = 0; t < meshlet.triangleCount; t++) {
+			const uint8_t* local = &data.triangles[(meshlet.triangleOffset + t) * 3];
+			const float* corner = vertices[data.vertices[meshlet.vertexOffset + local[0]]].position;
+			std::array<double, 3> normal = triangleNormal(corner,
+				vertices[data.vertices[meshlet.vertexOffset + local[1]]].position,
+				vertices[data.vertices[meshlet.vertexOffset + local[2]]].position);
+			double length = std::sqrt(normal[0] * normal[0] + normal[1] * normal[1] + normal[2] * normal[2]);
+			if (length == 0.0) {
+				continue;
+			}
+			for (size_t i = 0; i < 3; i++) {
+				normal[i] /= length;
+				sum[i] += normal[i];
+			}
+			normals.push_back(normal);
+			corners.push_back(corner);
+		}
+		double sumLength = std::sqrt(sum[0] * sum[0] + sum[1] * sum[1] + sum[2] * sum[2]);
+		std::array<double, 3> axis = { 0.0, 0.0, 0.0 };
+		double storedLength = 0.0;
+		if (sumLength > 0.0) {
+			for (size_t i = 0; i < 3; i++) {
+				meshlet.coneAxis[i] = toSnorm8(static_cast<float>(sum[i] / sumLength));
+				axis[i] = meshlet.coneAxis[i] / 127.0;
+			}
+			storedLength = std::sqrt(axis[0] * axis[0] + axis[1] * axis[1] + axis[2] * axis[2]);
+		} else {
+			std::fill(std::begin(meshlet.coneAxis), std::end(meshlet.coneAxis), int8_t(0));
+		}
+		std::copy(std::begin(meshlet.center), std::end(meshlet.center), std::begin(meshlet.coneApex));
+
+		double minDot = 1.0;
+		if (storedLength > 0.0) {
+			for (auto& value : axis) {
+				value /= storedLength;
+			}
+			for (const auto& normal : normals) {
+				minDot = std::min(minDot, normal[0] * axis[0] + normal[1] * axis[1] + normal[2] * axis[2]);
+			}
+		}
+		if (storedLength == 0.0 || minDot <= 0.0) {
+			meshlet.coneCutoff = 127;
+			return;
+		}
+
+		//furthest point along -axis where some triangle's plane crosses it, at or behind all of them from there
+		double apexDistance = -INFINITY;
+		for (size_t t = 0; t < normals.size(); t++) {
+			const auto& normal = normals[t];
+			double centerToPlane = (meshlet.center[0] - corners[t][0]) * normal[0] + (meshlet.center[1] - corners[t][1]) * normal[1] +
+					       (meshlet.center[2] - corners[t][2]) * normal[2];
+			double facing = normal[0] * axis[0] + normal[1] * axis[1] + normal[2] * axis[2];
+			apexDistance = std::max(apexDistance, centerToPlane / facing);
+		}
+		//a sliver further back so rounding the apex to float can't put it in front of a plane
+		apexDistance += 1e-4 * radius;
+		for (size_t i = 0; i < 3; i++) {
+			meshlet.coneApex[i] = static_cast<float>(meshlet.center[i] - axis[i] * apexDistance);
+		}
+		//rounded up, plus a step for float error in the apex and the test
+		double cutoff = std::sqrt(1.0 - minDot * minDot) * storedLength;
+		meshlet.coneCutoff = static_cast<int8_t>(std::min(127.0, std::ceil(cutoff * 127.0) + 1.0));
+	}
+
+	static uint64_t write(const std::string& outputPath, const std::vector<MeshVertex>& vertices,
+			const std::vector<uint32_t>& indices, const MeshletData& meshlets)
+	{
+		CookedMeshHeader header{};
+		std::memcpy(header.magic, "HTMS", 4);
+		header.version = CookedMesh::VERSION;
+		header.vertexCount = static_cast<uint32_t>(vertices.size());
+		header.indexCount = static_cast<uint32_t>(indices.size());
+		header.indexSize = vertices.size() <= UINT16_MAX ? 2 : 4;
+		header.meshletCount = static_cast<uint32_t>(meshlets.meshlets.size());
+		header.meshletVertexCount = static_cast<uint32_t>(meshlets.vertices.size());
+		header.meshletTriangleCount = static_cast<uint32_t>(meshlets.triangles.size() / 3);
+
+		//snorm16 covers [-1, 1], so store the bounds' center and half extent per axis
+		for (size_t axis = 0; axis < 3; axis++) {
+			float low = INFINITY, high = -INFINITY;
+			for (const MeshVertex& vertex : vertices) {
+				low = std::min(low, vertex.position[axis]);
+				high = std::max(high, vertex.position[axis]);
+			}
+			header.positionOffset[axis] = (low + high) * 0.5f;
+			header.positionScale[axis] = high > low ? (high - low) * 0.5f : 1.0f;
+		}
+
+		std::vector<CookedVertex> cooked(vertices.size());
+		for (size_t v = 0; v < vertices.size(); v++) {
+			for (size_t axis = 0; axis < 3; axis++) {
+				cooked[v].position[axis] = toSnorm16((vertices[v].position[axis] - header.positionOffset[axis]) / header.positionScale[axis]);
+			}
+			cooked[v].position[3] = INT16_MAX;
+			auto normal = encodeOctahedral(vertices[v].normal);
+			cooked[v].normal[0] = normal[0];
+			cooked[v].normal[1] = normal[1];
+			cooked[v].uv[0] = floatToHalf(vertices[v].uv[0]);
+			cooked[v].uv[1] = floatToHalf(vertices[v].uv[1]);
+		}
+
+		std::vector<uint16_t> shortIndices;
+		if (header.indexSize == 2) {
+			shortIndices.assign(indices.begin(), indices.end());
+		}
+
+		uint64_t cursor = sizeof(CookedMeshHeader);
+		auto place = [&](uint64_t size) {
+			uint64_t offset = (cursor + CookedMesh::SECTION_ALIGNMENT - 1) / CookedMesh::SECTION_ALIGNMENT * CookedMesh::SECTION_ALIGNMENT;
+			cursor = offset + size;
+			return offset;
+		};
+		header.vertexOffset = place(cooked.size() * sizeof(CookedVertex));
+		header.indexOffset = place(uint64_t(indices.size()) * header.indexSize);
+		header.meshletOffset = place(meshlets.meshlets.size() * sizeof(Meshlet));
+		header.meshletVertexOffset = place(meshlets.vertices.size() * sizeof(uint32_t));
+		header.meshletTriangleOffset = place(meshlets.triangles.size());
+
+		std::string tempPath = outputPath + ".tmp";
+		{
+			std::ofstream out(tempPath, std::ios::binary | std::ios::trunc);
+			if (!out.is_open()) {
+				throw std::runtime_error("failed to create " + tempPath);
+			}
+			auto section = [&](uint64_t offset, const void* data, uint64_t size) {
+				static const char padding[CookedMesh::SECTION_ALIGNMENT] = {};
+				out.write(padding, static_cast<std::streamsize>(offset - static_cast<uint64_t>(out.tellp())));
+				out.write(static_cast<const char*>(data), static_cast<std::streamsize>(size));
+			};
+			out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+			section(header.vertexOffset, cooked.data(), cooked.size() * sizeof(CookedVertex));
+			if (header.indexSize == 2) {
+				section(header.indexOffset, shortIndices.data(), shortIndices.size() * sizeof(uint16_t));
+			} else {
+				section(header.indexOffset, indices.data(), indices.size() * sizeof(uint32_t));
+			}
+			section(header.meshletOffset, meshlets.meshlets.data(), meshlets.meshlets.size() * sizeof(Meshlet));
+			section(header.meshletVertexOffset, meshlets.vertices.data(), meshlets.vertices.size() * sizeof(uint32_t));
+			section(header.meshletTriangleOffset, meshlets.triangles.data(), meshlets.triangles.size());
+			if (!out) {
+				throw std::runtime_error("failed to write " + tempPath);
+			}
+		}
+		if (std::rename(tempPath.c_str(), outputPath.c_str()) != 0) {
+			std::string reason = std::strerror(errno);
+			std::remove(tempPath.c_str());
+			throw std::runtime_error("failed to replace " + outputPath + ": " + reason);
+		}
+		return cursor;
+	}
+};
@@ -0,0 +1,181 @@
+#pragma once
+
+#include <vulkan/vulkan_raii.hpp>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+//On-disk VkPipelineCache that is loaded at startup and written back at shutdown.
+//
+//The file is our own header followed by the blob from vkGetPipelineCacheData. Our header carries the
+//driver version (which the Vulkan cache header does not) plus a checksum, and the Vulkan header inside
+//the blob is checked too. Anything that doesn't match this exact device/driver is thrown away and the
+//pipelines are just built cold.
+class PersistentPipelineCache {
+public:
+	PersistentPipelineCache(const vk::raii::Device& device, const vk::raii::PhysicalDevice& physicalDevice, std::string path)
+		: path(std::move(path)), properties(physicalDevice.getProperties())
+	{
+		std::vector<uint8_t> initialData = load();
+
+		vk::PipelineCacheCreateInfo createInfo{
+			.initialDataSize = initialData.size(),
+			.pInitialData = initialData.data() };
+		try {
+			cache = vk::raii::PipelineCache(device, createInfo);
+		} catch (const vk::SystemError& e) {
+			//driver still refused the blob, start over with an empty cache
+			status = std::string("cold (driver rejected cache: ") + e.what() + ")";
+			initialData.clear();
+			cache = vk::raii::PipelineCache(device, vk::PipelineCacheCreateInfo{});
+		}
+		warm = !initialData.empty();
+	}
+
+	[[nodiscard]] const vk::raii::PipelineCache& get() const { return cache; }
+	[[nodiscard]] bool isWarm() const { return warm; }
+	[[nodiscard]] const std::string& describe() const { return status; }
+
+	//Writes to a temp file first and renames it over the old one so a crash mid-write can't leave a
+	//truncated cache behind
+	void save() const {
+		if (path.empty()) {
+			return;
+		}
+		std::vector<uint8_t> data = cache.getData();
+
+		FileHeader header = makeHeader();
+		header.dataSize = data.size();
+		header.checksum = fnv1a(data.data(), data.size());
+
+		std::string tempPath = path + ".tmp";
+		{
+			std::ofstream file(tempPath, std::ios::binary | std::ios::trunc);
+			if (!file.is_open()) {
+				std::cerr << "failed to write pipeline cache: " << tempPath << "\n";
+				return;
+			}
+			file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+			file.write(reinterpret_cast<const char*>(data.data()), static_cast<std::streamsize>(data.size()));
+			if (!file.good()) {
+				std::cerr << "failed to write pipeline cache: " << tempPath << "\n";
+				return;
+			}
+		}
+		if (std::rename(tempPath.c_str(), path.c_str()) != 0) {
+			std::cerr << "failed to replace pipeline cache: " << path << "\n";
+			std::remove(tempPath.c_str());
+		}
+	}
+
+private:
+	static constexpr uint32_t MAGIC = 0x43505448;	//"HTPC"
+	static constexpr uint32_t FILE_VERSION = 1;
+
+	struct FileHeader {
+		uint32_t magic;
+		uint32_t fileVersion;
+		uint32_t vendorID;
+		uint32_t deviceID;
+		uint32_t driverVersion;
+		uint8_t pipelineCacheUUID[VK_UUID_SIZE];
+		uint64_t dataSize;
+		uint64_t checksum;
+	};
+
+	std::string path;
+	vk::PhysicalDeviceProperties properties;
+	vk::raii::PipelineCache cache = nullptr;
+	bool warm = false;
+	std::string status = "cold (no cache file)";
+
+	static uint64_t fnv1a(const uint8_t* data, size_t size) {
+		uint64_t hash = 0xcbf29ce484222325ull;
+		for (size_t i = 0; i < size; i++) {
+			hash ^= data[i];
+			hash *= 0x100000001b3ull;
+		}
+		return hash;
+	}
+
+	FileHeader makeHeader() const {
+		FileHeader header{};
+		header.magic = MAGIC;
+		header.fileVersion = FILE_VERSION;
+		header.vendorID = properties.vendorID;
+		header.deviceID = properties.deviceID;
+		header.driverVersion = properties.driverVersion;
+		std::memcpy(header.pipelineCacheUUID, properties.pipelineCacheUUID.data(), VK_UUID_SIZE);
+		return header;
+	}
+
+	//returns an empty vector (cold start) and sets status for anything that doesn't check out
+	std::vector<uint8_t> load() {
+		if (path.empty()) {
+			status = "cold (cache disabled)";
+			return {};
+		}
+		std::ifstream file(path, std::ios::ate | std::ios::binary);
+		if (!file.is_open()) {
+			return {};
+		}
+		auto fileSize = static_cast<size_t>(file.tellg());
+		file.seekg(0, std::ios::beg);
+
+		FileHeader header{};
+		if (fileSize < sizeof(header) || !file.read(reinterpret_cast<char*>(&header), sizeof(header))) {
+			status = "cold (truncated cache file)";
+			return {};
+		}
+
+		FileHeader expected = makeHeader();
+		if (header.magic != expected.magic || header.fileVersion != expected.fileVersion) {
+			status = "cold (not a pipeline cache file)";
+			return {};
+		}
+		if (header.vendorID != expected.vendorID || header.deviceID != expected.deviceID ||
+		    header.driverVersion != expected.driverVersion ||
+		    std::memcmp(header.pipelineCacheUUID, expected.pipelineCacheUUID, VK_UUID_SIZE) != 0) {
+			status = "cold (cache from a different device or driver)";
+			return {};
+		}
+		if (header.dataSize != fileSize - sizeof(header)) {
+			status = "cold (cache size mismatch)";
+			return {};
+		}
+
+		std::vector<uint8_t> data(header.dataSize);
+		if (!file.read(reinterpret_cast<char*>(data.data()), static_cast<std::streamsize>(data.size())) ||
+		    fnv1a(data.data(), data.size()) != header.checksum) {
+			status = "cold (corrupt cache data)";
+			return {};
+		}
+		if (!validateVulkanHeader(data)) {
+			status = "cold (vulkan cache header mismatch)";
+			return {};
+		}
+
+		status = "warm";
+		return data;
+	}
+
+	//VkPipelineCacheHeaderVersionOne: headerSize, headerVersion, vendorID, deviceID, pipelineCacheUUID
+	bool validateVulkanHeader(const std::vector<uint8_t>& data) const {
+		constexpr size_t VERSION_ONE_SIZE = 16 + VK_UUID_SIZE;
+		if (data.size() < VERSION_ONE_SIZE) {
+			return false;
+		}
+		uint32_t fields[4];
+		std::memcpy(fields, data.data(), sizeof(fields));
+		uint32_t headerSize = fields[0], headerVersion = fields[1], vendorID = fields[2], deviceID = fields[3];
+
+		return headerSize >= VERSION_ONE_SIZE && headerSize <= data.size() &&
+		       headerVersion == static_cast<uint32_t>(vk::PipelineCacheHeaderVersion::eOne) &&
+		       vendorID == properties.vendorID && deviceID == properties.deviceID &&
+		       std::memcmp(data.data() + 16, properties.pipelineCacheUUID.data(), VK_UUID_SIZE) == 0;
+	}
+};
@@ -0,0 +1,158 @@
+#pragma once
+
+#include <vulkan/vulkan_raii.hpp>
+#include <atomic>
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <iomanip>
+#include <mutex>
+#include <ostream>
+#include <shared_mutex>
+#include <unordered_map>
+
+//Everything a graphics pipeline variant is built from besides the shader and the layout. The last three fields
+//are specialization constants, so the shader is compiled per variant with the unused paths folded away.
+struct PipelineKey {
+	vk::Format colorFormat = vk::Format::eUndefined;
+	vk::Format depthFormat = vk::Format::eUndefined;
+	vk::SampleCountFlagBits samples = vk::SampleCountFlagBits::e1;
+	vk::PrimitiveTopology topology = vk::PrimitiveTopology::eTriangleList;
+	vk::CullModeFlags cullMode = vk::CullModeFlagBits::eNone;
+	bool blend = false;		//alpha blending, also makes the fragment shader output alpha
+	bool textured = true;		//sample the material's albedo texture
+	bool spin = true;		//animate the instance rotation by time * push constant spin
+
+	bool operator==(const PipelineKey&) const = default;
+
+	//FNV-1a over the field values one at a time, so padding never gets hashed and a key hashes the same in every
+	//run and build (it could name an on-disk variant just as well)
+	[[nodiscard]] uint64_t hash() const {
+		uint64_t hash = 0xcbf29ce484222325ull;
+		auto mix = [&hash](uint64_t value) {
+			for (int byte = 0; byte < 8; byte++) {
+				hash ^= (value >> (byte * 8)) & 0xff;
+				hash *= 0x100000001b3ull;
+			}
+		};
+		mix(static_cast<uint64_t>(colorFormat));
+		mix(static_cast<uint64_t>(depthFormat));
+		mix(static_cast<uint64_t>(samples));
+		mix(static_cast<uint64_t>(topology));
+		mix(static_cast<VkCullModeFlags>(cullMode));
+		mix(uint64_t(blend) | uint64_t(textured) << 1 | uint64_t(spin) << 2);
+		return hash;
+	}
+};
+
+struct PipelineKeyHash {
+	size_t operator()(const PipelineKey& key) const { return static_cast<size_t>(key.hash()); }
+};
+
+//Specialization constant data, matches the [vk::constant_id] constants in shaders/shader.slang. SPIR-V bools are
+//read as 4 byte VkBool32.
+struct ShaderSpecialization {
+	vk::Bool32 textured;
+	vk::Bool32 spin;
+	vk::Bool32 blend;
+
+	explicit ShaderSpecialization(const PipelineKey& key) : textured(key.textured), spin(key.spin), blend(key.blend) {}
+
+	static std::array<vk::SpecializationMapEntry, 3> mapEntries() {
+		return {
+			vk::SpecializationMapEntry{ .constantID = 0, .offset = offsetof(ShaderSpecialization, textured), .size = sizeof(vk::Bool32) },
+			vk::SpecializationMapEntry{ .constantID = 1, .offset = offsetof(ShaderSpecialization, spin), .size = sizeof(vk::Bool32) },
+			vk::SpecializationMapEntry{ .constantID = 2, .offset = offsetof(ShaderSpecialization, blend), .size = sizeof(vk::Bool32) } };
+	}
+};
+
+struct PipelineStateStats {
+	size_t variants = 0;
+	uint64_t hits = 0;
+	uint64_t misses = 0;		//lookups that built their pipeline, equals variants unless builds failed
+	double buildMs = 0.0;
+
+	void report(std::ostream& out) const {
+		uint64_t lookups = hits + misses;
+		out << std::fixed << std::setprecision(3)
+		    << "[pipeline-state] variants=" << variants
+		    << " hits=" << hits
+		    << " misses=" << misses
+		    << " hit_rate=" << (lookups > 0 ? static_cast<double>(hits) / static_cast<double>(lookups) : 0.0)
+		    << " build_ms=" << buildMs << "\n";
+	}
+};
+
+//In-memory map from PipelineKey to the pipeline built for it, each variant is built the first time it is asked
+//for and never again. The build function owns the shader, so a new shader version means a new cache (that is
+//what the hot reload hands over). Compiled code is still shared with the on-disk VkPipelineCache underneath.
+//
+//get() is thread safe. Lookups of built variants only take a shared lock. The first caller of a new key builds
+//it under that key's own mutex, callers racing it for the same key wait for that build instead of starting
+//another one, and every other key stays available meanwhile. A build that throws throws to its caller and the
+//next get() of the key tries again.
+class PipelineStateCache {
+public:
+	using BuildFn = std::function<vk::raii::Pipeline(const PipelineKey& key)>;
+
+	explicit PipelineStateCache(BuildFn build) : build(std::move(build)) {}
+
+	PipelineStateCache(const PipelineStateCache&) = delete;
+	PipelineStateCache& operator=(const PipelineStateCache&) = delete;
+
+	[[nodiscard]] vk::Pipeline get(const PipelineKey& key) {
+		Entry& entry = find(key);
+		if (!entry.ready.load(std::memory_order_acquire)) {
+			std::lock_guard lock(entry.buildMutex);
+			if (!entry.ready.load(std::memory_order_relaxed)) {
+				auto start = std::chrono::steady_clock::now();
+				entry.pipeline = build(key);
+				buildNs += std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+				entry.ready.store(true, std::memory_order_release);
+				misses.fetch_add(1, std::memory_order_relaxed);
+				return *entry.pipeline;
+			}
+		}
+		hits.fetch_add(1, std::memory_order_relaxed);
+		return *entry.pipeline;
+	}
+
+	[[nodiscard]] PipelineStateStats statistics() const {
+		std::shared_lock lock(mapMutex);
+		return PipelineStateStats{
+			.variants = entries.size(),
+			.hits = hits.load(std::memory_order_relaxed),
+			.misses = misses.load(std::memory_order_relaxed),
+			.buildMs = static_cast<double>(buildNs.load(std::memory_order_relaxed)) / 1e6 };
+	}
+
+private:
+	struct Entry {
+		std::mutex buildMutex;
+		std::atomic<bool> ready = false;
+		vk::raii::Pipeline pipeline = nullptr;
+	};
+
+	BuildFn build;
+	mutable std::shared_mutex mapMutex;
+	//unordered_map never moves its nodes, so an Entry& stays valid while other keys are added
+	std::unordered_map<PipelineKey, Entry, PipelineKeyHash> entries;
+
+	std::atomic<uint64_t> hits = 0;
+	std::atomic<uint64_t> misses = 0;
+	std::atomic<int64_t> buildNs = 0;
+
+	Entry& find(const PipelineKey& key) {
+		{
+			std::shared_lock lock(mapMutex);
+			auto it = entries.find(key);
+			if (it != entries.end()) {
+				return it->second;
+			}
+		}
+		std::unique_lock lock(mapMutex);
+		return entries.try_emplace(key).first->second;
+	}
+};
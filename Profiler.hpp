@@ -0,0 +1,334 @@
+#pragma once
+
+#include <vulkan/vulkan_raii.hpp>
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <fstream>
+#include <iomanip>
+#include <ostream>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+//Fixed window average so a single hitch shows up and then ages out instead of skewing things forever
+class RollingAverage {
+public:
+	static constexpr size_t WINDOW = 64;
+
+	void add(double sample) {
+		sum += sample - samples[next];
+		samples[next] = sample;
+		next = (next + 1) % WINDOW;
+		count = std::min(count + 1, WINDOW);
+	}
+
+	[[nodiscard]] double average() const { return count ? sum / static_cast<double>(count) : 0.0; }
+
+private:
+	std::array<double, WINDOW> samples{};
+	size_t next = 0;
+	size_t count = 0;
+	double sum = 0.0;
+};
+
+//Named gpu/cpu timing scopes built on timestamp and pipeline statistics queries.
+//Each frame slot owns its own range of queries, results are read back when the slot comes around again
+//(after its previous frame has been waited on) so reading them never stalls the frame.
+class GpuProfiler {
+public:
+	static constexpr uint32_t MAX_SCOPES = 32;
+
+	//order matches the bit order of the flags below, which is the order the values come back in
+	static constexpr std::array<const char*, 7> STATISTIC_NAMES = {
+		"ia_vertices", "ia_primitives", "vs_invocations", "clip_invocations",
+		"clip_primitives", "fs_invocations", "cs_invocations" };
+
+	GpuProfiler(const vk::raii::Device& device, const vk::raii::PhysicalDevice& physicalDevice,
+			uint32_t queueFamilyIndex, uint32_t framesInFlight, bool pipelineStatistics)
+		: slots(framesInFlight), statisticsEnabled(pipelineStatistics)
+	{
+		auto queueFamilies = physicalDevice.getQueueFamilyProperties();
+		uint32_t validBits = queueFamilies[queueFamilyIndex].timestampValidBits;
+		if (validBits == 0) {
+			throw std::runtime_error("queue family does not support timestamp queries");
+		}
+		timestampMask = validBits >= 64 ? ~0ull : ((1ull << validBits) - 1);
+		timestampPeriodNs = physicalDevice.getProperties().limits.timestampPeriod;
+
+		vk::QueryPoolCreateInfo timestampPoolInfo{
+			.queryType = vk::QueryType::eTimestamp,
+			.queryCount = framesInFlight * MAX_SCOPES * 2 };
+		timestampPool = vk::raii::QueryPool(device, timestampPoolInfo);
+
+		if (statisticsEnabled) {
+			vk::QueryPoolCreateInfo statisticsPoolInfo{
+				.queryType = vk::QueryType::ePipelineStatistics,
+				.queryCount = framesInFlight * MAX_SCOPES,
+				.pipelineStatistics = vk::QueryPipelineStatisticFlagBits::eInputAssemblyVertices |
+						      vk::QueryPipelineStatisticFlagBits::eInputAssemblyPrimitives |
+						      vk::QueryPipelineStatisticFlagBits::eVertexShaderInvocations |
+						      vk::QueryPipelineStatisticFlagBits::eClippingInvocations |
+						      vk::QueryPipelineStatisticFlagBits::eClippingPrimitives |
+						      vk::QueryPipelineStatisticFlagBits::eFragmentShaderInvocations |
+						      vk::QueryPipelineStatisticFlagBits::eComputeShaderInvocations };
+			statisticsPool = vk::raii::QueryPool(device, statisticsPoolInfo);
+		}
+
+		cpuEpoch = std::chrono::steady_clock::now();
+	}
+
+	//Call right after commandBuffer.begin(), once the slot's previous frame has been waited on.
+	//Collects whatever this slot recorded last time around and resets its queries.
+	void beginFrame(const vk::raii::CommandBuffer& commandBuffer, uint32_t frameSlot) {
+		currentSlot = frameSlot;
+		collect(currentSlot);
+
+		FrameSlot& slot = slots[currentSlot];
+		slot.scopes.clear();
+		slot.statisticsCount = 0;
+		statisticsActive = false;
+
+		commandBuffer.resetQueryPool(*timestampPool, firstTimestamp(currentSlot), MAX_SCOPES * 2);
+		if (statisticsEnabled) {
+			commandBuffer.resetQueryPool(*statisticsPool, currentSlot * MAX_SCOPES, MAX_SCOPES);
+		}
+	}
+
+	//Returns a handle to pass to endScope(). Pipeline statistics queries can't nest and can't straddle
+	//a beginRendering/endRendering boundary, so only ask for them on scopes that respect that.
+	uint32_t beginScope(const vk::raii::CommandBuffer& commandBuffer, const char* name, bool withStatistics = false) {
+		FrameSlot& slot = slots[currentSlot];
+		if (slot.scopes.size() >= MAX_SCOPES) {
+			return NO_SCOPE;
+		}
+
+		auto index = static_cast<uint32_t>(slot.scopes.size());
+		Scope& scope = slot.scopes.emplace_back();
+		scope.statsIndex = indexOf(name);
+		scope.cpuStart = std::chrono::steady_clock::now();
+
+		commandBuffer.writeTimestamp2(vk::PipelineStageFlagBits2::eTopOfPipe, *timestampPool, firstTimestamp(currentSlot) + index * 2);
+
+		if (withStatistics && statisticsEnabled && !statisticsActive) {
+			scope.statisticsQuery = static_cast<int32_t>(slot.statisticsCount++);
+			commandBuffer.beginQuery(*statisticsPool, currentSlot * MAX_SCOPES + static_cast<uint32_t>(scope.statisticsQuery), {});
+			statisticsActive = true;
+		}
+		return index;
+	}
+
+	void endScope(const vk::raii::CommandBuffer& commandBuffer, uint32_t index) {
+		if (index == NO_SCOPE) {
+			return;
+		}
+		Scope& scope = slots[currentSlot].scopes[index];
+		if (scope.statisticsQuery >= 0) {
+			commandBuffer.endQuery(*statisticsPool, currentSlot * MAX_SCOPES + static_cast<uint32_t>(scope.statisticsQuery));
+			statisticsActive = false;
+		}
+		commandBuffer.writeTimestamp2(vk::PipelineStageFlagBits2::eBottomOfPipe, *timestampPool, firstTimestamp(currentSlot) + index * 2 + 1);
+
+		scope.cpuMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - scope.cpuStart).count();
+	}
+
+	//Keep every resolved scope around as a chrome://tracing / Perfetto event, capped so long runs don't grow forever
+	void enableTrace(size_t maxEvents = 200000) {
+		traceEnabled = true;
+		maxTraceEvents = maxEvents;
+		traceEvents.reserve(std::min<size_t>(maxEvents, 4096));
+	}
+
+	//Reads the results every slot still holds, oldest frame first. Frames are otherwise only read when their slot
+	//comes around again, so call this once the device is idle before printSummary()/writeChromeTrace() or the last
+	//frames in flight are missing from both.
+	void collectAll() {
+		for (uint32_t i = 1; i <= slots.size(); i++) {
+			auto slot = static_cast<uint32_t>((currentSlot + i) % slots.size());
+			collect(slot);
+			slots[slot].scopes.clear();
+			slots[slot].statisticsCount = 0;
+		}
+	}
+
+	//Rolling gpu time for a scope, 0 if it has not resolved yet
+	[[nodiscard]] double gpuMs(const std::string& name) const {
+		auto it = scopeIndices.find(name);
+		return it == scopeIndices.end() ? 0.0 : scopeStats[it->second].gpuMs.average();
+	}
+
+	void printSummary(std::ostream& out) const {
+		out << std::fixed << std::setprecision(3);
+		for (const auto& stats : scopeStats) {
+			out << "[profile] " << stats.name
+			    << " gpu_ms=" << stats.gpuMs.average()
+			    << " cpu_ms=" << stats.cpuMs.average();
+			if (stats.hasStatistics) {
+				for (size_t i = 0; i < STATISTIC_NAMES.size(); i++) {
+					out << " " << STATISTIC_NAMES[i] << "=" << stats.statistics[i];
+				}
+			}
+			out << "\n";
+		}
+	}
+
+	//Chrome trace event format, load it in chrome://tracing or ui.perfetto.dev.
+	//The gpu track is in its own clock domain starting at the first resolved timestamp, it is not
+	//calibrated against the cpu track.
+	void writeChromeTrace(const std::string& path) const {
+		std::ofstream file(path);
+		if (!file.is_open()) {
+			throw std::runtime_error("failed to open trace file: " + path);
+		}
+		file << std::fixed << std::setprecision(3) << "{\"traceEvents\":[\n";
+		for (size_t i = 0; i < traceEvents.size(); i++) {
+			const TraceEvent& event = traceEvents[i];
+			file << "{\"name\":\"" << scopeStats[event.statsIndex].name << "\",\"ph\":\"X\",\"pid\":1"
+			     << ",\"tid\":\"" << (event.gpu ? "gpu" : "cpu") << "\""
+			     << ",\"ts\":" << event.startUs << ",\"dur\":" << event.durationUs << "}"
+			     << (i + 1 < traceEvents.size() ? ",\n" : "\n");
+		}
+		file << "]}\n";
+	}
+
+private:
+	static constexpr uint32_t NO_SCOPE = ~0u;
+
+	struct Scope {
+		size_t statsIndex = 0;
+		int32_t statisticsQuery = -1;
+		std::chrono::steady_clock::time_point cpuStart;
+		double cpuMs = 0.0;
+	};
+
+	struct FrameSlot {
+		std::vector<Scope> scopes;
+		uint32_t statisticsCount = 0;
+	};
+
+	struct ScopeStats {
+		std::string name;
+		RollingAverage gpuMs;
+		RollingAverage cpuMs;
+		bool hasStatistics = false;
+		std::array<uint64_t, STATISTIC_NAMES.size()> statistics{};
+	};
+
+	struct TraceEvent {
+		size_t statsIndex;
+		bool gpu;
+		double startUs;
+		double durationUs;
+	};
+
+	vk::raii::QueryPool timestampPool = nullptr;
+	vk::raii::QueryPool statisticsPool = nullptr;
+	std::vector<FrameSlot> slots;
+	uint32_t currentSlot = 0;
+	bool statisticsEnabled = false;
+	bool statisticsActive = false;
+	uint64_t timestampMask = ~0ull;
+	float timestampPeriodNs = 1.0f;
+
+	std::vector<ScopeStats> scopeStats;
+	std::unordered_map<std::string, size_t> scopeIndices;
+
+	bool traceEnabled = false;
+	size_t maxTraceEvents = 0;
+	std::vector<TraceEvent> traceEvents;
+	std::chrono::steady_clock::time_point cpuEpoch;
+	uint64_t gpuEpoch = 0;
+	bool gpuEpochSet = false;
+
+	static uint32_t firstTimestamp(uint32_t slot) { return slot * MAX_SCOPES * 2; }
+
+	size_t indexOf(const char* name) {
+		auto [it, inserted] = scopeIndices.try_emplace(name, scopeStats.size());
+		if (inserted) {
+			scopeStats.push_back({ .name = name });
+		}
+		return it->second;
+	}
+
+	void collect(uint32_t slotIndex) {
+		const FrameSlot& slot = slots[slotIndex];
+		if (slot.scopes.empty()) {
+			return;
+		}
+		auto queryCount = static_cast<uint32_t>(slot.scopes.size() * 2);
+		//no eWait, if something is somehow still in flight we just drop this frame's numbers
+		auto [timestampResult, timestamps] = timestampPool.getResults<uint64_t>(
+			firstTimestamp(slotIndex), queryCount, queryCount * sizeof(uint64_t), sizeof(uint64_t),
+			vk::QueryResultFlagBits::e64);
+		if (timestampResult != vk::Result::eSuccess) {
+			return;
+		}
+
+		std::vector<uint64_t> statistics;
+		if (slot.statisticsCount > 0) {
+			constexpr size_t stride = STATISTIC_NAMES.size() * sizeof(uint64_t);
+			auto [statisticsResult, values] = statisticsPool.getResults<uint64_t>(
+				slotIndex * MAX_SCOPES, slot.statisticsCount, slot.statisticsCount * stride, stride,
+				vk::QueryResultFlagBits::e64);
+			if (statisticsResult == vk::Result::eSuccess) {
+				statistics = std::move(values);
+			}
+		}
+
+		if (!gpuEpochSet) {
+			gpuEpoch = timestamps[0] & timestampMask;
+			gpuEpochSet = true;
+		}
+
+		for (size_t i = 0; i < slot.scopes.size(); i++) {
+			const Scope& scope = slot.scopes[i];
+			ScopeStats& stats = scopeStats[scope.statsIndex];
+
+			uint64_t begin = timestamps[i * 2] & timestampMask;
+			uint64_t end = timestamps[i * 2 + 1] & timestampMask;
+			double gpuMs = static_cast<double>(end - begin) * timestampPeriodNs / 1e6;
+			stats.gpuMs.add(gpuMs);
+			stats.cpuMs.add(scope.cpuMs);
+
+			if (scope.statisticsQuery >= 0 && !statistics.empty()) {
+				stats.hasStatistics = true;
+				for (size_t s = 0; s < STATISTIC_NAMES.size(); s++) {
+					stats.statistics[s] = statistics[static_cast<size_t>(scope.statisticsQuery) * STATISTIC_NAMES.size() + s];
+				}
+			}
+
+			if (traceEnabled && traceEvents.size() + 2 <= maxTraceEvents) {
+				double gpuStartUs = static_cast<double>(begin - gpuEpoch) * timestampPeriodNs / 1e3;
+				traceEvents.push_back({ scope.statsIndex, true, gpuStartUs, gpuMs * 1e3 });
+				double cpuStartUs = std::chrono::duration<double, std::micro>(scope.cpuStart - cpuEpoch).count();
+				traceEvents.push_back({ scope.statsIndex, false, cpuStartUs, scope.cpuMs * 1e3 });
+			}
+		}
+	}
+};
+
+//RAII helper so early returns can't leave a scope open
+class ProfileScope {
+public:
+	ProfileScope(GpuProfiler* profiler, const vk::raii::CommandBuffer& commandBuffer, const char* name, bool withStatistics = false)
+		: profiler(profiler), commandBuffer(commandBuffer)
+	{
+		if (profiler) {
+			index = profiler->beginScope(commandBuffer, name, withStatistics);
+		}
+	}
+	~ProfileScope() {
+		if (profiler) {
+			profiler->endScope(commandBuffer, index);
+		}
+	}
+	ProfileScope(const ProfileScope&) = delete;
+	ProfileScope& operator=(const ProfileScope&) = delete;
+
+private:
+	GpuProfiler* profiler;
+	const vk::raii::CommandBuffer& commandBuffer;
+	uint32_t index = 0;
+};
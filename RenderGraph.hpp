@@ -0,0 +1,635 @@
+#pragma once
+
+#include <vulkan/vulkan_raii.hpp>
+#include <algorithm>
+#include <cstdint>
+#include <functional>
+#include <iomanip>
+#include <iterator>
+#include <memory>
+#include <optional>
+#include <ostream>
+#include <stdexcept>
+#include <vector>
+
+#include "DeletionQueue.hpp"
+#include "GpuAllocator.hpp"
+
+//How a pass touches a resource, each one is a fixed (stage, access, layout) state, see stateOf()
+enum class ResourceUse {
+	//images
+	ColorAttachment,	//also covers being an msaa resolve target
+	DepthAttachment,
+	FragmentSampled,
+	TransferSrc,
+	TransferDst,
+	Present,		//only as an imported image's final use
+	//buffers
+	ComputeStorageRead,
+	ComputeStorageWrite,
+	IndirectRead,
+	VertexRead,		//vertex or instance buffer
+	TransferRead,
+	TransferWrite
+};
+
+struct ResourceState {
+	vk::PipelineStageFlags2 stage = {};
+	vk::AccessFlags2 access = {};
+	vk::ImageLayout layout = vk::ImageLayout::eUndefined;
+	bool write = false;
+};
+
+//Description of an image the graph owns. It only lives for the frame (contents start undefined every time), which is
+//what lets images with disjoint lifetimes share memory.
+struct TransientImageDesc {
+	vk::Format format = vk::Format::eUndefined;
+	vk::Extent2D extent;
+	vk::SampleCountFlagBits samples = vk::SampleCountFlagBits::e1;
+	vk::ImageAspectFlags aspect = vk::ImageAspectFlagBits::eColor;
+	//Attachment only images whose contents never leave the rendering block (loaded with clear, stored with don't
+	//care). They get transient attachment usage and lazily allocated memory where the device has it, so tilers can
+	//keep them in tile memory and never back them at all.
+	bool lazy = false;
+
+	bool operator==(const TransientImageDesc&) const = default;
+};
+
+struct RenderGraphStats {
+	uint64_t frames = 0;
+	uint64_t passes = 0;
+	uint64_t culledPasses = 0;
+	uint64_t barrierBatches = 0;	//pipelineBarrier2 calls
+	uint64_t imageBarriers = 0;
+	uint64_t memoryBarriers = 0;
+	uint64_t transientBytes = 0;	//memory actually backing the current transients
+	uint64_t unaliasedBytes = 0;	//what they would need with one allocation each
+	uint64_t lazyBytes = 0;		//part of transientBytes that landed in lazily allocated memory
+
+	void report(std::ostream& out) const {
+		double perFrame = frames > 0 ? 1.0 / static_cast<double>(frames) : 0.0;
+		out << std::fixed << std::setprecision(2)
+		    << "[graph] frames=" << frames
+		    << " passes_per_frame=" << static_cast<double>(passes) * perFrame
+		    << " culled_per_frame=" << static_cast<double>(culledPasses) * perFrame
+		    << " barrier_batches_per_frame=" << static_cast<double>(barrierBatches) * perFrame
+		    << " image_barriers_per_frame=" << static_cast<double>(imageBarriers) * perFrame
+		    << " memory_barriers_per_frame=" << static_cast<double>(memoryBarriers) * perFrame
+		    << " transient_kib=" << transientBytes / 1024
+		    << " unaliased_kib=" << unaliasedBytes / 1024
+		    << " lazy_kib=" << lazyBytes / 1024 << "\n";
+	}
+};
+
+//Per frame render graph. The frame is described as passes that declare which resources they use and how, then
+//execute() records them in order and works out the synchronization in between:
+//
+// - passes whose results nothing reads get culled, unless they are marked as having side effects
+// - every barrier needed before a pass goes into a single pipelineBarrier2, buffers share one global memory barrier
+// - a write is made visible to all the reads that follow it in one barrier, placed before the first of them
+// - layouts are only transitioned when a use actually needs a different one
+// - transient images with disjoint lifetimes are bound to the same memory
+//
+//Rebuilt from scratch every frame (reset(), import/create, addPass(), execute()), only the physical transient images
+//are kept between frames and rebuilt when their descriptions or lifetimes change. Passes that record their own
+//internal barriers (culling, texture mips) are fine, the graph only handles what crosses pass boundaries.
+class RenderGraph {
+public:
+	using ResourceId = uint32_t;
+	using ExecuteFn = std::function<void(const vk::raii::CommandBuffer&)>;
+
+	class PassBuilder {
+	public:
+		PassBuilder& use(ResourceId resource, ResourceUse how) {
+			graph.passes[pass].uses.push_back({ resource, how });
+			return *this;
+		}
+		//never culled, for passes whose output leaves the graph some other way (readbacks, uploads)
+		PassBuilder& sideEffects() {
+			graph.passes[pass].sideEffects = true;
+			return *this;
+		}
+
+	private:
+		friend class RenderGraph;
+		PassBuilder(RenderGraph& graph, uint32_t pass) : graph(graph), pass(pass) {}
+		RenderGraph& graph;
+		uint32_t pass;
+	};
+
+	RenderGraph(const vk::raii::Device& device, GpuAllocator& allocator, DeletionQueue& deletionQueue)
+		: device(device), allocator(allocator), deletionQueue(deletionQueue) {}
+
+	RenderGraph(const RenderGraph&) = delete;
+	RenderGraph& operator=(const RenderGraph&) = delete;
+
+	static ResourceState stateOf(ResourceUse use) {
+		using Stage = vk::PipelineStageFlagBits2;
+		using Access = vk::AccessFlagBits2;
+		using Layout = vk::ImageLayout;
+		switch (use) {
+			case ResourceUse::ColorAttachment:
+				return { Stage::eColorAttachmentOutput, Access::eColorAttachmentRead | Access::eColorAttachmentWrite,
+					 Layout::eColorAttachmentOptimal, true };
+			case ResourceUse::DepthAttachment:
+				return { Stage::eEarlyFragmentTests | Stage::eLateFragmentTests,
+					 Access::eDepthStencilAttachmentRead | Access::eDepthStencilAttachmentWrite,
+					 Layout::eDepthStencilAttachmentOptimal, true };
+			case ResourceUse::FragmentSampled:	return { Stage::eFragmentShader, Access::eShaderSampledRead, Layout::eShaderReadOnlyOptimal };
+			case ResourceUse::TransferSrc:		return { Stage::eTransfer, Access::eTransferRead, Layout::eTransferSrcOptimal };
+			case ResourceUse::TransferDst:		return { Stage::eTransfer, Access::eTransferWrite, Layout::eTransferDstOptimal, true };
+			case ResourceUse::Present:		return { Stage::eBottomOfPipe, {}, Layout::ePresentSrcKHR };
+			case ResourceUse::ComputeStorageRead:	return { Stage::eComputeShader, Access::eShaderStorageRead };
+			case ResourceUse::ComputeStorageWrite:	return { Stage::eComputeShader, Access::eShaderStorageWrite, Layout::eUndefined, true };
+			case ResourceUse::IndirectRead:		return { Stage::eDrawIndirect, Access::eIndirectCommandRead };
+			case ResourceUse::VertexRead:		return { Stage::eVertexAttributeInput, Access::eVertexAttributeRead };
+			case ResourceUse::TransferRead:		return { Stage::eTransfer, Access::eTransferRead };
+			case ResourceUse::TransferWrite:	return { Stage::eTransfer, Access::eTransferWrite, Layout::eUndefined, true };
+		}
+		throw std::runtime_error("unknown resource use");
+	}
+
+	void reset() {
+		resources.clear();
+		passes.clear();
+	}
+
+	//An image owned by someone else (swapchain, offscreen target). initial is how it was last used before this
+	//frame's graph, finalUse the state it has to be left in.
+	ResourceId importImage(const char* name, vk::Image image, vk::ImageView view, vk::ImageAspectFlags aspect,
+			ResourceState initial, std::optional<ResourceUse> finalUse = std::nullopt)
+	{
+		Resource& resource = resources.emplace_back();
+		resource.name = name;
+		resource.isImage = true;
+		resource.image = image;
+		resource.view = view;
+		resource.aspect = aspect;
+		resource.initial = initial;
+		resource.finalUse = finalUse;
+		return static_cast<ResourceId>(resources.size() - 1);
+	}
+
+	//Buffers only get memory barriers, anything from before the graph is the importer's business
+	ResourceId importBuffer(const char* name, vk::Buffer buffer) {
+		Resource& resource = resources.emplace_back();
+		resource.name = name;
+		resource.buffer = buffer;
+		return static_cast<ResourceId>(resources.size() - 1);
+	}
+
+	ResourceId createImage(const char* name, const TransientImageDesc& desc) {
+		Resource& resource = resources.emplace_back();
+		resource.name = name;
+		resource.isImage = true;
+		resource.transient = true;
+		resource.desc = desc;
+		resource.aspect = desc.aspect;
+		return static_cast<ResourceId>(resources.size() - 1);
+	}
+
+	PassBuilder addPass(const char* name, ExecuteFn execute) {
+		passes.push_back(Pass{ .name = name, .execute = std::move(execute) });
+		return PassBuilder(*this, static_cast<uint32_t>(passes.size() - 1));
+	}
+
+	//only valid from inside a pass (transients are realized by execute())
+	[[nodiscard]] vk::Image image(ResourceId id) const {
+		const Resource& resource = resources[id];
+		return resource.transient ? *transients->images[resource.physical] : resource.image;
+	}
+	[[nodiscard]] vk::ImageView view(ResourceId id) const {
+		const Resource& resource = resources[id];
+		return resource.transient ? *transients->views[resource.physical] : resource.view;
+	}
+
+	//Culls, realizes transients and records every live pass with its barriers. lastSubmittedValue is the frame
+	//timeline value replaced transient images are retired against.
+	void execute(const vk::raii::CommandBuffer& commandBuffer, uint64_t lastSubmittedValue) {
+		cullPasses();
+		realizeTransients(lastSubmittedValue);
+
+		tracking.assign(resources.size(), Tracking{});
+		for (ResourceId id = 0; id < resources.size(); id++) {
+			const Resource& resource = resources[id];
+			const ResourceState& before = resource.transient ? resource.handoff : resource.initial;
+			tracking[id] = Tracking{ .layout = before.layout, .writeStage = before.stage, .writeAccess = before.access };
+		}
+
+		for (uint32_t passIndex = 0; passIndex < passes.size(); passIndex++) {
+			Pass& pass = passes[passIndex];
+			if (pass.culled) {
+				continue;
+			}
+			for (const auto& [id, how] : pass.uses) {
+				transition(id, stateOf(how), passIndex);
+			}
+			flushBarriers(commandBuffer);
+			pass.execute(commandBuffer);
+		}
+
+		for (ResourceId id = 0; id < resources.size(); id++) {
+			if (resources[id].finalUse) {
+				transition(id, stateOf(*resources[id].finalUse), static_cast<uint32_t>(passes.size()));
+			}
+		}
+		flushBarriers(commandBuffer);
+		stats.frames++;
+	}
+
+	[[nodiscard]] const RenderGraphStats& statistics() const { return stats; }
+
+private:
+	//what one set of transient descriptions/lifetimes was realized as, retired as a whole when they change
+	struct TransientImages {
+		GpuAllocator* allocator = nullptr;
+		std::vector<vk::raii::Image> images;
+		std::vector<vk::raii::ImageView> views;
+		std::vector<GpuAllocation> blocks;
+
+		TransientImages() = default;
+		TransientImages(const TransientImages&) = delete;
+		TransientImages& operator=(const TransientImages&) = delete;
+		~TransientImages() {
+			views.clear();
+			images.clear();
+			for (const GpuAllocation& block : blocks) {
+				allocator->free(block);
+			}
+		}
+	};
+
+	//everything realizeTransients() keys the physical images on
+	struct TransientKey {
+		TransientImageDesc desc;
+		vk::ImageUsageFlags usage;
+		uint32_t firstPass;
+		uint32_t lastPass;
+
+		bool operator==(const TransientKey&) const = default;
+	};
+
+	struct Resource {
+		const char* name = "";
+		bool isImage = false;
+		bool transient = false;
+		vk::Image image;
+		vk::ImageView view;
+		vk::Buffer buffer;
+		vk::ImageAspectFlags aspect;
+		ResourceState initial;
+		std::optional<ResourceUse> finalUse;
+		TransientImageDesc desc;
+		uint32_t physical = 0;		//index into transients
+		ResourceState handoff;		//for transients, whatever last used their memory
+	};
+
+	struct Pass {
+		const char* name;
+		ExecuteFn execute;
+		std::vector<std::pair<ResourceId, ResourceUse>> uses = {};
+		bool sideEffects = false;
+		bool culled = false;
+	};
+
+	struct Tracking {
+		vk::ImageLayout layout = vk::ImageLayout::eUndefined;
+		vk::PipelineStageFlags2 writeStage = {};	//last write (or prior use for imports) no barrier has waited on yet
+		vk::AccessFlags2 writeAccess = {};
+		vk::PipelineStageFlags2 readStages = {};	//reads since then, a later write or transition has to wait for them
+		vk::PipelineStageFlags2 visibleStages = {};	//what the last barrier already made that write visible to
+		vk::AccessFlags2 visibleAccess = {};
+	};
+
+	const vk::raii::Device& device;
+	GpuAllocator& allocator;
+	DeletionQueue& deletionQueue;
+
+	std::vector<Resource> resources;
+	std::vector<Pass> passes;
+	std::vector<Tracking> tracking;
+
+	std::unique_ptr<TransientImages> transients;
+	std::vector<TransientKey> transientKeys;	//what transients was built for
+	std::vector<ResourceState> handoffs;		//per physical image, see realizeTransients()
+
+	vk::MemoryBarrier2 pendingMemoryBarrier;
+	std::vector<vk::ImageMemoryBarrier2> pendingImageBarriers;
+
+	RenderGraphStats stats;
+
+	//Walks backwards keeping a pass if it has side effects or writes something a kept pass (or a final use) reads
+	void cullPasses() {
+		std::vector<bool> needed(resources.size(), false);
+		for (ResourceId id = 0; id < resources.size(); id++) {
+			needed[id] = resources[id].finalUse.has_value();
+		}
+		for (uint32_t i = static_cast<uint32_t>(passes.size()); i-- > 0;) {
+			Pass& pass = passes[i];
+			bool live = pass.sideEffects || std::ranges::any_of(pass.uses, [&](const auto& use) {
+				return stateOf(use.second).write && needed[use.first];
+			});
+			pass.culled = !live;
+			if (live) {
+				for (const auto& [id, how] : pass.uses) {
+					if (!stateOf(how).write) {
+						needed[id] = true;
+					}
+				}
+			}
+		}
+		stats.passes += passes.size();
+		stats.culledPasses += std::ranges::count_if(passes, [](const Pass& pass) { return pass.culled; });
+	}
+
+	//Builds (or reuses) the images behind this frame's live transients. Sorted by first use, each one goes into the
+	//first memory block whose current occupant's last use is before its own first use. The first use of an image in a
+	//shared block has to wait on the previous occupant, or on the block's last occupant from the previous frame
+	//since transients are reused by every frame in flight.
+	void realizeTransients(uint64_t lastSubmittedValue) {
+		std::vector<ResourceId> live;
+		std::vector<TransientKey> keys;
+		for (ResourceId id = 0; id < resources.size(); id++) {
+			if (!resources[id].transient) {
+				continue;
+			}
+			TransientKey key{ .desc = resources[id].desc, .usage = {}, .firstPass = UINT32_MAX, .lastPass = 0 };
+			for (uint32_t i = 0; i < passes.size(); i++) {
+				if (passes[i].culled) {
+					continue;
+				}
+				for (const auto& [useId, how] : passes[i].uses) {
+					if (useId == id) {
+						key.usage |= imageUsageOf(how);
+						key.firstPass = std::min(key.firstPass, i);
+						key.lastPass = std::max(key.lastPass, i);
+					}
+				}
+			}
+			if (key.firstPass != UINT32_MAX) {
+				live.push_back(id);
+				keys.push_back(key);
+			}
+		}
+		//first use order, so the greedy block assignment below sees lifetimes in the order they start
+		std::vector<uint32_t> order(live.size());
+		for (uint32_t i = 0; i < order.size(); i++) {
+			order[i] = i;
+		}
+		std::ranges::stable_sort(order, {}, [&](uint32_t i) { return keys[i].firstPass; });
+		std::vector<TransientKey> sortedKeys;
+		for (uint32_t i : order) {
+			sortedKeys.push_back(keys[i]);
+		}
+
+		if (!transients || sortedKeys != transientKeys) {
+			if (transients) {
+				deletionQueue.retire(std::move(transients), lastSubmittedValue);
+			}
+			buildTransients(sortedKeys);
+			transientKeys = std::move(sortedKeys);
+		}
+
+		for (uint32_t slot = 0; slot < order.size(); slot++) {
+			Resource& resource = resources[live[order[slot]]];
+			resource.physical = slot;
+			resource.handoff = handoffs[slot];
+		}
+	}
+
+	void buildTransients(const std::vector<TransientKey>& keys) {
+		auto built = std::make_unique<TransientImages>();
+		built->allocator = &allocator;
+
+		struct Block {
+			vk::MemoryRequirements requirements;
+			bool lazy = false;
+			uint32_t lastPass = 0;
+			std::vector<uint32_t> occupants = {};
+		};
+		std::vector<Block> blocks;
+		std::vector<uint32_t> blockOf(keys.size());
+		uint64_t unaliased = 0;
+
+		for (uint32_t i = 0; i < keys.size(); i++) {
+			const TransientKey& key = keys[i];
+			vk::ImageUsageFlags usage = key.usage;
+			if (key.desc.lazy) {
+				constexpr vk::ImageUsageFlags attachmentUsage = vk::ImageUsageFlagBits::eColorAttachment |
+					vk::ImageUsageFlagBits::eDepthStencilAttachment | vk::ImageUsageFlagBits::eInputAttachment;
+				if (usage & ~attachmentUsage) {
+					throw std::runtime_error("lazy transient image is used as something other than an attachment");
+				}
+				usage |= vk::ImageUsageFlagBits::eTransientAttachment;
+			}
+			built->images.emplace_back(device, vk::ImageCreateInfo{
+				.imageType = vk::ImageType::e2D,
+				.format = key.desc.format,
+				.extent = { key.desc.extent.width, key.desc.extent.height, 1 },
+				.mipLevels = 1,
+				.arrayLayers = 1,
+				.samples = key.desc.samples,
+				.tiling = vk::ImageTiling::eOptimal,
+				.usage = usage,
+				.sharingMode = vk::SharingMode::eExclusive,
+				.initialLayout = vk::ImageLayout::eUndefined });
+			vk::MemoryRequirements requirements = built->images.back().getMemoryRequirements();
+			unaliased += requirements.size;
+
+			auto fits = std::ranges::find_if(blocks, [&](const Block& block) {
+				//lazy memory types can only back transient attachments, so lazy and regular images never share
+				return block.lazy == key.desc.lazy && block.lastPass < key.firstPass &&
+					(block.requirements.memoryTypeBits & requirements.memoryTypeBits);
+			});
+			if (fits == blocks.end()) {
+				blocks.push_back(Block{ .requirements = requirements, .lazy = key.desc.lazy });
+				fits = std::prev(blocks.end());
+			} else {
+				fits->requirements.size = std::max(fits->requirements.size, requirements.size);
+				fits->requirements.alignment = std::max(fits->requirements.alignment, requirements.alignment);
+				fits->requirements.memoryTypeBits &= requirements.memoryTypeBits;
+			}
+			fits->lastPass = key.lastPass;
+			fits->occupants.push_back(i);
+			blockOf[i] = static_cast<uint32_t>(std::distance(blocks.begin(), fits));
+		}
+
+		uint64_t backed = 0;
+		uint64_t lazy = 0;
+		for (const Block& block : blocks) {
+			vk::MemoryPropertyFlags preferred = block.lazy ? vk::MemoryPropertyFlagBits::eLazilyAllocated : vk::MemoryPropertyFlags{};
+			const GpuAllocation& allocation = built->blocks.emplace_back(
+				allocator.allocate(block.requirements, vk::MemoryPropertyFlagBits::eDeviceLocal, preferred, false));
+			backed += block.requirements.size;
+			if (allocator.propertiesOf(allocation) & vk::MemoryPropertyFlagBits::eLazilyAllocated) {
+				lazy += block.requirements.size;
+			}
+		}
+		for (uint32_t i = 0; i < keys.size(); i++) {
+			const GpuAllocation& block = built->blocks[blockOf[i]];
+			built->images[i].bindMemory(block.memory, block.offset);
+			built->views.emplace_back(device, vk::ImageViewCreateInfo{
+				.image = *built->images[i],
+				.viewType = vk::ImageViewType::e2D,
+				.format = keys[i].desc.format,
+				.subresourceRange = { keys[i].desc.aspect, 0, 1, 0, 1 } });
+		}
+
+		//every use of whichever image had the memory before, so the first barrier waits for all of it
+		handoffs.assign(keys.size(), ResourceState{});
+		for (const Block& block : blocks) {
+			for (size_t n = 0; n < block.occupants.size(); n++) {
+				uint32_t previous = n == 0 ? block.occupants.back() : block.occupants[n - 1];
+				handoffs[block.occupants[n]] = accessesOf(keys[previous].usage);
+			}
+		}
+
+		transients = std::move(built);
+		stats.transientBytes = backed;
+		stats.unaliasedBytes = unaliased;
+		stats.lazyBytes = lazy;
+	}
+
+	static vk::ImageUsageFlags imageUsageOf(ResourceUse use) {
+		switch (use) {
+			case ResourceUse::ColorAttachment:	return vk::ImageUsageFlagBits::eColorAttachment;
+			case ResourceUse::DepthAttachment:	return vk::ImageUsageFlagBits::eDepthStencilAttachment;
+			case ResourceUse::FragmentSampled:	return vk::ImageUsageFlagBits::eSampled;
+			case ResourceUse::TransferSrc:		return vk::ImageUsageFlagBits::eTransferSrc;
+			case ResourceUse::TransferDst:		return vk::ImageUsageFlagBits::eTransferDst;
+			default:				throw std::runtime_error("resource use is not valid for an image");
+		}
+	}
+
+	//stages and write accesses an image with this usage can have been touched with
+	static ResourceState accessesOf(vk::ImageUsageFlags usage) {
+		ResourceState state;
+		for (ResourceUse use : { ResourceUse::ColorAttachment, ResourceUse::DepthAttachment, ResourceUse::FragmentSampled,
+					 ResourceUse::TransferSrc, ResourceUse::TransferDst }) {
+			if (usage & imageUsageOf(use)) {
+				ResourceState useState = stateOf(use);
+				state.stage |= useState.stage;
+				if (useState.write) {
+					state.access |= useState.access;
+				}
+			}
+		}
+		return state;
+	}
+
+	//Union of the reads of a resource from pass `from` on, up to the next write or layout change. A barrier
+	//for the first of them covers all of them.
+	ResourceState readersFrom(ResourceId id, uint32_t from, vk::ImageLayout layout) const {
+		ResourceState readers;
+		for (uint32_t i = from; i < passes.size(); i++) {
+			if (passes[i].culled) {
+				continue;
+			}
+			for (const auto& [useId, how] : passes[i].uses) {
+				if (useId != id) {
+					continue;
+				}
+				ResourceState state = stateOf(how);
+				if (state.write || (resources[id].isImage && state.layout != layout)) {
+					return readers;
+				}
+				readers.stage |= state.stage;
+				readers.access |= state.access;
+			}
+		}
+		const Resource& resource = resources[id];
+		if (resource.finalUse) {
+			ResourceState state = stateOf(*resource.finalUse);
+			if (!resource.isImage || state.layout == layout) {
+				readers.stage |= state.stage;
+				readers.access |= state.access;
+			}
+		}
+		return readers;
+	}
+
+	//Queues whatever barrier this use of the resource needs before pass passIndex
+	void transition(ResourceId id, const ResourceState& use, uint32_t passIndex) {
+		const Resource& resource = resources[id];
+		Tracking& track = tracking[id];
+		bool layoutChange = resource.isImage && use.layout != track.layout;
+
+		if (use.write || layoutChange) {
+			vk::PipelineStageFlags2 srcStage = track.writeStage | track.readStages;
+			if (!srcStage && !layoutChange) {
+				//first thing that touches it at all
+				track.writeStage = use.stage;
+				track.writeAccess = use.access;
+				return;
+			}
+			//a read that needs a new layout transitions once for every read after it with the same layout
+			ResourceState dst = use.write ? use : readersFrom(id, passIndex, use.layout);
+			queueBarrier(id, srcStage, track.writeAccess, dst.stage, dst.access, track.layout, use.layout);
+			track.layout = use.layout;
+			if (use.write) {
+				track.writeStage = use.stage;
+				track.writeAccess = use.access;
+				track.readStages = {};
+				track.visibleStages = {};
+				track.visibleAccess = {};
+			} else {
+				track.writeStage = {};
+				track.writeAccess = {};
+				track.readStages = use.stage;
+				track.visibleStages = dst.stage;
+				track.visibleAccess = dst.access;
+			}
+			return;
+		}
+
+		bool covered = (track.visibleStages & use.stage) == use.stage && (track.visibleAccess & use.access) == use.access;
+		if (track.writeStage && !covered) {
+			ResourceState dst = readersFrom(id, passIndex, use.layout);
+			queueBarrier(id, track.writeStage, track.writeAccess, dst.stage, dst.access, track.layout, track.layout);
+			track.visibleStages |= dst.stage;
+			track.visibleAccess |= dst.access;
+		}
+		track.readStages |= use.stage;
+	}
+
+	void queueBarrier(ResourceId id, vk::PipelineStageFlags2 srcStage, vk::AccessFlags2 srcAccess,
+			vk::PipelineStageFlags2 dstStage, vk::AccessFlags2 dstAccess, vk::ImageLayout oldLayout, vk::ImageLayout newLayout)
+	{
+		const Resource& resource = resources[id];
+		if (!resource.isImage) {
+			pendingMemoryBarrier.srcStageMask |= srcStage;
+			pendingMemoryBarrier.srcAccessMask |= srcAccess;
+			pendingMemoryBarrier.dstStageMask |= dstStage;
+			pendingMemoryBarrier.dstAccessMask |= dstAccess;
+			return;
+		}
+		pendingImageBarriers.push_back(vk::ImageMemoryBarrier2{
+			.srcStageMask = srcStage,
+			.srcAccessMask = srcAccess,
+			.dstStageMask = dstStage,
+			.dstAccessMask = dstAccess,
+			.oldLayout = oldLayout,
+			.newLayout = newLayout,
+			.srcQueueFamilyIndex = vk::QueueFamilyIgnored,
+			.dstQueueFamilyIndex = vk::QueueFamilyIgnored,
+			.image = image(id),
+			.subresourceRange = { resource.aspect, 0, vk::RemainingMipLevels, 0, vk::RemainingArrayLayers } });
+	}
+
+	void flushBarriers(const vk::raii::CommandBuffer& commandBuffer) {
+		bool memory = static_cast<bool>(pendingMemoryBarrier.srcStageMask | pendingMemoryBarrier.dstStageMask);
+		if (!memory && pendingImageBarriers.empty()) {
+			return;
+		}
+		commandBuffer.pipelineBarrier2(vk::DependencyInfo{
+			.memoryBarrierCount = memory ? 1u : 0u,
+			.pMemoryBarriers = &pendingMemoryBarrier,
+			.imageMemoryBarrierCount = static_cast<uint32_t>(pendingImageBarriers.size()),
+			.pImageMemoryBarriers = pendingImageBarriers.data() });
+		stats.barrierBatches++;
+		stats.memoryBarriers += memory ? 1 : 0;
+		stats.imageBarriers += pendingImageBarriers.size();
+		pendingMemoryBarrier = vk::MemoryBarrier2{};
+		pendingImageBarriers.clear();
+	}
+};
@@ -0,0 +1,366 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <numeric>
+#include <stdexcept>
+#include <type_traits>
+#include <vector>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+#include "FrameArena.hpp"
+#include "JobSystem.hpp"
+
+//Same layout as InstanceData in HelloTriangle.hpp (and cull.slang), the scene writes these straight into the mapped
+//instance buffer
+struct PackedInstance {
+	float offset[2];
+	float scaleRotation[2];		//x = uniform scale, y = rotation in radians
+	float color[4];
+	uint32_t materialId;
+	uint32_t padding[3];
+};
+static_assert(sizeof(PackedInstance) == 48, "PackedInstance has to match InstanceData");
+
+constexpr uint32_t SCENE_NO_PARENT = UINT32_MAX;
+
+//One object as it is added, the transform is relative to the parent (2D similarity: offset, rotation, uniform scale)
+struct SceneObjectDesc {
+	uint32_t parent = SCENE_NO_PARENT;	//has to be added already
+	float offset[2] = { 0.0f, 0.0f };
+	float rotation = 0.0f;
+	float scale = 1.0f;
+	float color[4] = { 1.0f, 1.0f, 1.0f, 1.0f };
+	uint32_t materialId = 0;
+};
+
+struct SceneBounds {
+	float min[2];
+	float max[2];
+};
+
+//Scene objects as structure of arrays: one array per transform component, bounds component, color channel and material
+//id, indexed by storage slot. Slots are sorted by hierarchy depth (relayout() after adds), so every level is one
+//contiguous range whose parents all live in the level before it. update() then walks the levels in order and each one
+//is a flat loop with no dependencies inside it: split over the job system's workers, 8 objects at a time with AVX2
+//(parents are gathered) or one at a time without it. World rotations are carried as cos/sin and combined with the
+//angle sum identities, so the update has no trig at all.
+//
+//Object ids are handed out by add() and stay valid across relayouts, slots don't.
+class SceneStore {
+public:
+	//levels smaller than this run on the calling thread, waking the workers costs more than the loop
+	static constexpr uint32_t MIN_PARALLEL_OBJECTS = 4096;
+
+	[[nodiscard]] uint32_t size() const { return static_cast<uint32_t>(slotOfId.size()); }
+	[[nodiscard]] uint32_t levelCount() const { return levelStart.empty() ? 0 : static_cast<uint32_t>(levelStart.size() - 1); }
+	[[nodiscard]] static bool simdAvailable() {
+#if defined(__AVX2__)
+		return true;
+#else
+		return false;
+#endif
+	}
+	//benchmarks compare against the scalar loop with this, it never changes the results beyond rounding
+	void forceScalar(bool scalar) { scalarOnly = scalar; }
+
+	uint32_t add(const SceneObjectDesc& desc) {
+		auto id = static_cast<uint32_t>(slotOfId.size());
+		uint32_t depth = 0;
+		int32_t parent = -1;
+		if (desc.parent != SCENE_NO_PARENT) {
+			if (desc.parent >= id) {
+				throw std::runtime_error("scene object parent has to be added before its children");
+			}
+			parent = static_cast<int32_t>(slotOfId[desc.parent]);
+			depth = depthOf[slotOfId[desc.parent]] + 1;
+		}
+		//appended at the end, relayout() moves it into its level before the next update
+		slotOfId.push_back(id);
+		idOfSlot.push_back(id);
+		depthOf.push_back(depth);
+		parentSlot.push_back(parent);
+		localX.push_back(desc.offset[0]);
+		localY.push_back(desc.offset[1]);
+		localRotation.push_back(desc.rotation);
+		localCos.push_back(std::cos(desc.rotation));
+		localSin.push_back(std::sin(desc.rotation));
+		localScale.push_back(desc.scale);
+		colorR.push_back(desc.color[0]);
+		colorG.push_back(desc.color[1]);
+		colorB.push_back(desc.color[2]);
+		colorA.push_back(desc.color[3]);
+		materialIds.push_back(desc.materialId);
+		layoutDirty = true;
+		return id;
+	}
+
+	void setLocalRotation(uint32_t id, float radians) {
+		uint32_t slot = slotOfId[id];
+		localRotation[slot] = radians;
+		localCos[slot] = std::cos(radians);
+		localSin[slot] = std::sin(radians);
+	}
+
+	void setLocalOffset(uint32_t id, float x, float y) {
+		localX[slotOfId[id]] = x;
+		localY[slotOfId[id]] = y;
+	}
+
+	//Recomputes every world transform and bounding box (a circle of meshRadius * world scale, as an aabb) and writes
+	//the instances to out[0, size()) in slot order. jobs may be null to run everything on the calling thread. Per
+	//worker scratch comes out of arena, which the caller resets once per frame.
+	SceneBounds update(JobSystem* jobs, FrameArena& arena, PackedInstance* out, float meshRadius) {
+		if (layoutDirty) {
+			relayout();
+		}
+		uint32_t workers = jobs ? jobs->workerCount() : 1;
+		auto* partials = arena.allocate<WorkerBounds>(workers);
+		for (uint32_t worker = 0; worker < workers; worker++) {
+			partials[worker] = WorkerBounds{};
+		}
+
+		for (uint32_t level = 0; level < levelCount(); level++) {
+			uint32_t first = levelStart[level];
+			uint32_t count = levelStart[level + 1] - first;
+			auto chunk = [&](uint32_t worker, uint32_t begin, uint32_t end) {
+				if (level == 0) {
+					updateRange<true>(first + begin, first + end, meshRadius, out, partials[worker]);
+				} else {
+					updateRange<false>(first + begin, first + end, meshRadius, out, partials[worker]);
+				}
+			};
+			if (jobs && count >= MIN_PARALLEL_OBJECTS) {
+				jobs->parallelFor(count, chunk);
+			} else {
+				chunk(0, 0, count);
+			}
+		}
+
+		SceneBounds bounds = partials[0].bounds;
+		for (uint32_t worker = 1; worker < workers; worker++) {
+			for (int axis = 0; axis < 2; axis++) {
+				bounds.min[axis] = std::min(bounds.min[axis], partials[worker].bounds.min[axis]);
+				bounds.max[axis] = std::max(bounds.max[axis], partials[worker].bounds.max[axis]);
+			}
+		}
+		return bounds;
+	}
+
+	//world space results of the last update(), by id
+	[[nodiscard]] std::array<float, 2> worldOffset(uint32_t id) const { return { worldX[slotOfId[id]], worldY[slotOfId[id]] }; }
+	[[nodiscard]] float worldRotationOf(uint32_t id) const { return worldRotation[slotOfId[id]]; }
+	[[nodiscard]] float worldScaleOf(uint32_t id) const { return worldScale[slotOfId[id]]; }
+	[[nodiscard]] SceneBounds boundsOf(uint32_t id) const {
+		uint32_t slot = slotOfId[id];
+		return { { minX[slot], minY[slot] }, { maxX[slot], maxY[slot] } };
+	}
+
+private:
+	//one cache line each so workers never write to the same one
+	struct alignas(64) WorkerBounds {
+		SceneBounds bounds = { { std::numeric_limits<float>::max(), std::numeric_limits<float>::max() },
+				       { std::numeric_limits<float>::lowest(), std::numeric_limits<float>::lowest() } };
+	};
+
+	std::vector<uint32_t> slotOfId;
+	std::vector<uint32_t> idOfSlot;
+	std::vector<uint32_t> depthOf;
+	std::vector<uint32_t> levelStart;	//first slot of every depth, plus the end
+	bool layoutDirty = false;
+	bool scalarOnly = false;
+
+	//by slot
+	std::vector<int32_t> parentSlot;	//-1 for roots
+	std::vector<float> localX, localY, localRotation, localCos, localSin, localScale;
+	std::vector<float> worldX, worldY, worldRotation, worldCos, worldSin, worldScale;
+	std::vector<float> minX, minY, maxX, maxY;
+	std::vector<float> colorR, colorG, colorB, colorA;
+	std::vector<uint32_t> materialIds;
+
+	//Stable counting sort of the slots by depth, so objects keep their add order within a level
+	void relayout() {
+		uint32_t count = size();
+		uint32_t depths = count == 0 ? 0 : *std::max_element(depthOf.begin(), depthOf.end()) + 1;
+		levelStart.assign(depths + 1, 0);
+		for (uint32_t depth : depthOf) {
+			levelStart[depth + 1]++;
+		}
+		std::partial_sum(levelStart.begin(), levelStart.end(), levelStart.begin());
+
+		std::vector<uint32_t> order(count);		//new slot -> old slot
+		std::vector<uint32_t> newSlotOf(count);		//old slot -> new slot
+		std::vector<uint32_t> fill(levelStart.begin(), levelStart.end() - 1);
+		for (uint32_t slot = 0; slot < count; slot++) {
+			uint32_t to = fill[depthOf[slot]]++;
+			order[to] = slot;
+			newSlotOf[slot] = to;
+		}
+
+		auto permute = [&](auto& values) {
+			std::remove_reference_t<decltype(values)> sorted(count);
+			for (uint32_t slot = 0; slot < count; slot++) {
+				sorted[slot] = values[order[slot]];
+			}
+			values.swap(sorted);
+		};
+		permute(idOfSlot);
+		permute(depthOf);
+		permute(parentSlot);
+		for (int32_t& parent : parentSlot) {
+			if (parent >= 0) {
+				parent = static_cast<int32_t>(newSlotOf[static_cast<uint32_t>(parent)]);
+			}
+		}
+		for (auto* values : { &localX, &localY, &localRotation, &localCos, &localSin, &localScale, &colorR, &colorG, &colorB, &colorA }) {
+			permute(*values);
+		}
+		permute(materialIds);
+		for (uint32_t slot = 0; slot < count; slot++) {
+			slotOfId[idOfSlot[slot]] = slot;
+		}
+		for (auto* values : { &worldX, &worldY, &worldRotation, &worldCos, &worldSin, &worldScale, &minX, &minY, &maxX, &maxY }) {
+			values->assign(count, 0.0f);
+		}
+		layoutDirty = false;
+	}
+
+	//Roots take their local transform as is, everything else composes with its parent (one level up, so already done):
+	//	rotation = parent + local, scale = parent * local, offset = parent + parent scale * R(parent) * local offset
+	template <bool ROOTS>
+	void updateRange(uint32_t begin, uint32_t end, float meshRadius, PackedInstance* out, WorkerBounds& partial) {
+		uint32_t i = begin;
+#if defined(__AVX2__)
+		if (!scalarOnly) {
+			i = updateRangeAvx2<ROOTS>(begin, end, meshRadius, out, partial);
+		}
+#endif
+		SceneBounds& bounds = partial.bounds;
+		for (; i < end; i++) {
+			float x = localX[i], y = localY[i], c = localCos[i], s = localSin[i], rotation = localRotation[i], scale = localScale[i];
+			if constexpr (!ROOTS) {
+				auto p = static_cast<uint32_t>(parentSlot[i]);
+				float pc = worldCos[p], ps = worldSin[p], pScale = worldScale[p];
+				float rx = (pc * x - ps * y) * pScale;
+				float ry = (ps * x + pc * y) * pScale;
+				x = worldX[p] + rx;
+				y = worldY[p] + ry;
+				float wc = pc * c - ps * s;
+				s = ps * c + pc * s;
+				c = wc;
+				rotation += worldRotation[p];
+				scale *= pScale;
+			}
+			worldX[i] = x;
+			worldY[i] = y;
+			worldCos[i] = c;
+			worldSin[i] = s;
+			worldRotation[i] = rotation;
+			worldScale[i] = scale;
+			float radius = meshRadius * scale;
+			minX[i] = x - radius;
+			minY[i] = y - radius;
+			maxX[i] = x + radius;
+			maxY[i] = y + radius;
+			bounds.min[0] = std::min(bounds.min[0], minX[i]);
+			bounds.min[1] = std::min(bounds.min[1], minY[i]);
+			bounds.max[0] = std::max(bounds.max[0], maxX[i]);
+			bounds.max[1] = std::max(bounds.max[1], maxY[i]);
+			out[i] = pack(i);
+		}
+	}
+
+	[[nodiscard]] PackedInstance pack(uint32_t slot) const {
+		return PackedInstance{
+			.offset = { worldX[slot], worldY[slot] },
+			.scaleRotation = { worldScale[slot], worldRotation[slot] },
+			.color = { colorR[slot], colorG[slot], colorB[slot], colorA[slot] },
+			.materialId = materialIds[slot],
+			.padding = {} };
+	}
+
+#if defined(__AVX2__)
+	static __m256 multiplyAdd(__m256 a, __m256 b, __m256 c) {
+#if defined(__FMA__)
+		return _mm256_fmadd_ps(a, b, c);
+#else
+		return _mm256_add_ps(_mm256_mul_ps(a, b), c);
+#endif
+	}
+
+	//Whole groups of 8, returns where the scalar tail has to pick up
+	template <bool ROOTS>
+	uint32_t updateRangeAvx2(uint32_t begin, uint32_t end, float meshRadius, PackedInstance* out, WorkerBounds& partial) {
+		__m256 boundsMinX = _mm256_set1_ps(partial.bounds.min[0]), boundsMinY = _mm256_set1_ps(partial.bounds.min[1]);
+		__m256 boundsMaxX = _mm256_set1_ps(partial.bounds.max[0]), boundsMaxY = _mm256_set1_ps(partial.bounds.max[1]);
+		__m256 radius = _mm256_set1_ps(meshRadius);
+		uint32_t i = begin;
+		for (; i + 8 <= end; i += 8) {
+			__m256 x = _mm256_loadu_ps(&localX[i]), y = _mm256_loadu_ps(&localY[i]);
+			__m256 c = _mm256_loadu_ps(&localCos[i]), s = _mm256_loadu_ps(&localSin[i]);
+			__m256 rotation = _mm256_loadu_ps(&localRotation[i]), scale = _mm256_loadu_ps(&localScale[i]);
+			if constexpr (!ROOTS) {
+				__m256i p = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(&parentSlot[i]));
+				__m256 pc = _mm256_i32gather_ps(worldCos.data(), p, 4), ps = _mm256_i32gather_ps(worldSin.data(), p, 4);
+				__m256 pScale = _mm256_i32gather_ps(worldScale.data(), p, 4);
+				__m256 rx = _mm256_mul_ps(multiplySubtract(pc, x, ps, y), pScale);
+				__m256 ry = _mm256_mul_ps(multiplyAdd(ps, x, _mm256_mul_ps(pc, y)), pScale);
+				x = _mm256_add_ps(_mm256_i32gather_ps(worldX.data(), p, 4), rx);
+				y = _mm256_add_ps(_mm256_i32gather_ps(worldY.data(), p, 4), ry);
+				__m256 wc = multiplySubtract(pc, c, ps, s);
+				s = multiplyAdd(ps, c, _mm256_mul_ps(pc, s));
+				c = wc;
+				rotation = _mm256_add_ps(rotation, _mm256_i32gather_ps(worldRotation.data(), p, 4));
+				scale = _mm256_mul_ps(scale, pScale);
+			}
+			_mm256_storeu_ps(&worldX[i], x);
+			_mm256_storeu_ps(&worldY[i], y);
+			_mm256_storeu_ps(&worldCos[i], c);
+			_mm256_storeu_ps(&worldSin[i], s);
+			_mm256_storeu_ps(&worldRotation[i], rotation);
+			_mm256_storeu_ps(&worldScale[i], scale);
+			__m256 r = _mm256_mul_ps(radius, scale);
+			__m256 lowX = _mm256_sub_ps(x, r), lowY = _mm256_sub_ps(y, r), highX = _mm256_add_ps(x, r), highY = _mm256_add_ps(y, r);
+			_mm256_storeu_ps(&minX[i], lowX);
+			_mm256_storeu_ps(&minY[i], lowY);
+			_mm256_storeu_ps(&maxX[i], highX);
+			_mm256_storeu_ps(&maxY[i], highY);
+			boundsMinX = _mm256_min_ps(boundsMinX, lowX);
+			boundsMinY = _mm256_min_ps(boundsMinY, lowY);
+			boundsMaxX = _mm256_max_ps(boundsMaxX, highX);
+			boundsMaxY = _mm256_max_ps(boundsMaxY, highY);
+			//the interleave to 48 byte instances stays scalar, it reads the lines just written
+			for (uint32_t lane = 0; lane < 8; lane++) {
+				out[i + lane] = pack(i + lane);
+			}
+		}
+		partial.bounds.min[0] = horizontal(boundsMinX, [](float a, float b) { return std::min(a, b); });
+		partial.bounds.min[1] = horizontal(boundsMinY, [](float a, float b) { return std::min(a, b); });
+		partial.bounds.max[0] = horizontal(boundsMaxX, [](float a, float b) { return std::max(a, b); });
+		partial.bounds.max[1] = horizontal(boundsMaxY, [](float a, float b) { return std::max(a, b); });
+		return i;
+	}
+
+	//a * b - c * d
+	static __m256 multiplySubtract(__m256 a, __m256 b, __m256 c, __m256 d) {
+		return _mm256_sub_ps(_mm256_mul_ps(a, b), _mm256_mul_ps(c, d));
+	}
+
+	template <typename Op>
+	static float horizontal(__m256 values, Op op) {
+		alignas(32) float lanes[8];
+		_mm256_store_ps(lanes, values);
+		float result = lanes[0];
+		for (int lane = 1; lane < 8; lane++) {
+			result = op(result, lanes[lane]);
+		}
+		return result;
+	}
+#endif
+};
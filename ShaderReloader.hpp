@@ -0,0 +1,183 @@
+#pragma once
+
+#include <vulkan/vulkan_raii.hpp>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <filesystem>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "AssetIO.hpp"
+#include "PipelineStateCache.hpp"
+
+#ifdef __linux__
+#include <poll.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+#ifndef SLANGC_PATH
+#define SLANGC_PATH "slangc"
+#endif
+
+//One hot-reloadable pipeline: the slang source, the spir-v it compiles to and the entry points to compile
+struct ReloadableShader {
+	std::string source;			//file name inside the watched directory, e.g. shader.slang
+	std::string output;			//e.g. slang.spv
+	std::vector<std::string> entryPoints;
+};
+
+//Watches the shader directory with inotify on a background thread. A changed .slang gets recompiled with slangc
+//(into a temp file that is renamed over the .spv), a changed .spv gets a new pipeline variant cache from the build
+//callback, still on the background thread. The build callback prebuilds the variant in use so the finished cache
+//waits in a slot until the render loop picks it up with takeReady() at a frame boundary, and neither the compile
+//nor the pipeline build ever blocks a frame.
+//
+//A failed compile or build is only logged, the old pipeline stays in use.
+class ShaderReloader {
+public:
+	using BuildFn = std::function<std::unique_ptr<PipelineStateCache>(std::span<const uint32_t> spirv)>;
+
+	ShaderReloader(std::string directory, ReloadableShader shader, BuildFn build)
+		: directory(std::move(directory)), shader(std::move(shader)), build(std::move(build))
+	{
+#ifdef __linux__
+		inotifyFd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+		if (inotifyFd < 0 || inotify_add_watch(inotifyFd, this->directory.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO) < 0) {
+			throw std::runtime_error("failed to watch shader directory " + this->directory);
+		}
+		thread = std::thread([this] { watchLoop(); });
+		std::cout << "[hot-reload] watching " << this->directory << "\n";
+#else
+		std::cerr << "[hot-reload] needs inotify, shader reloading is disabled on this platform\n";
+#endif
+	}
+
+	~ShaderReloader() {
+		stopping = true;
+		if (thread.joinable()) {
+			thread.join();
+		}
+#ifdef __linux__
+		if (inotifyFd >= 0) {
+			close(inotifyFd);
+		}
+#endif
+	}
+
+	ShaderReloader(const ShaderReloader&) = delete;
+	ShaderReloader& operator=(const ShaderReloader&) = delete;
+
+	//Render thread, once per frame. Hands over the newest finished pipelines if there are any.
+	std::optional<std::unique_ptr<PipelineStateCache>> takeReady() {
+		std::lock_guard lock(mutex);
+		std::optional<std::unique_ptr<PipelineStateCache>> taken = std::move(ready);
+		ready.reset();
+		return taken;
+	}
+
+	[[nodiscard]] uint32_t reloadCount() const { return reloads; }
+
+private:
+	std::string directory;
+	ReloadableShader shader;
+	BuildFn build;
+
+	std::thread thread;
+	std::atomic<bool> stopping = false;
+	std::atomic<uint32_t> reloads = 0;
+
+	std::mutex mutex;
+	std::optional<std::unique_ptr<PipelineStateCache>> ready;	//a newer build replaces one that was never picked up
+
+#ifdef __linux__
+	int inotifyFd = -1;
+
+	//Gathers every file name touched in one burst, editors tend to write a file several times per save
+	std::set<std::string> readChanges() {
+		std::set<std::string> changed;
+		alignas(inotify_event) char buffer[4096];
+		while (true) {
+			ssize_t length = read(inotifyFd, buffer, sizeof(buffer));
+			if (length <= 0) {
+				return changed;
+			}
+			for (ssize_t offset = 0; offset < length;) {
+				auto event = reinterpret_cast<const inotify_event*>(buffer + offset);
+				if (event->len > 0) {
+					changed.insert(event->name);
+				}
+				offset += static_cast<ssize_t>(sizeof(inotify_event) + event->len);
+			}
+		}
+	}
+
+	void watchLoop() {
+		while (!stopping) {
+			//short timeout so the destructor never waits long for the join
+			pollfd descriptor{ .fd = inotifyFd, .events = POLLIN, .revents = 0 };
+			if (poll(&descriptor, 1, 100) <= 0) {
+				continue;
+			}
+			//let the writer finish its burst before reading it
+			std::this_thread::sleep_for(std::chrono::milliseconds(50));
+			std::set<std::string> changed = readChanges();
+
+			if (changed.contains(shader.source)) {
+				//the rename below shows up as a .spv change on the next wakeup, which is what rebuilds the pipeline
+				compileSource();
+			}
+			if (changed.contains(shader.output)) {
+				rebuildPipeline();
+			}
+		}
+	}
+#endif
+
+	void compileSource() {
+		std::filesystem::path dir(directory);
+		std::string temp = (dir / (shader.output + ".tmp")).string();
+		std::string command = std::string("\"") + SLANGC_PATH + "\" \"" + (dir / shader.source).string() +
+			"\" -target spirv -profile spirv_1_4 -emit-spirv-directly -fvk-use-entrypoint-name";
+		for (const auto& entryPoint : shader.entryPoints) {
+			command += " -entry " + entryPoint;
+		}
+		command += " -o \"" + temp + "\"";
+
+		if (std::system(command.c_str()) != 0) {
+			std::cerr << "[hot-reload] " << shader.source << " failed to compile, keeping the current pipeline\n";
+			return;
+		}
+		std::error_code error;
+		std::filesystem::rename(temp, dir / shader.output, error);
+		if (error) {
+			std::cerr << "[hot-reload] could not replace " << shader.output << ": " << error.message() << "\n";
+		}
+	}
+
+	void rebuildPipeline() {
+		auto start = std::chrono::steady_clock::now();
+		try {
+			//always the loose file, it is the one that changed even when startup loaded from an archive
+			MappedFile file((std::filesystem::path(directory) / shader.output).string());
+			std::unique_ptr<PipelineStateCache> pipelines = build(spirvWords(file.bytes()));
+			{
+				std::lock_guard lock(mutex);
+				ready = std::move(pipelines);
+			}
+			reloads++;
+			std::cout << "[hot-reload] " << shader.output << " pipeline rebuilt in "
+				  << std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count() << " ms\n";
+		} catch (const std::exception& e) {
+			std::cerr << "[hot-reload] " << shader.output << " rebuild failed, keeping the current pipeline: " << e.what() << "\n";
+		}
+	}
+};
@@ -0,0 +1,478 @@
+#pragma once
+
+#include <vulkan/vulkan_raii.hpp>
+#include <algorithm>
+#include <bit>
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <iostream>
+#include <mutex>
+#include <optional>
+#include <ostream>
+#include <span>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "AssetIO.hpp"
+#include "BenchmarkStats.hpp"
+#include "GpuAllocator.hpp"
+
+//Binary ppm (P6, 8 bit) header, the pixels follow at dataOffset as tightly packed rgb
+struct PpmHeader {
+	uint32_t width = 0;
+	uint32_t height = 0;
+	size_t dataOffset = 0;
+};
+
+//throws on anything that isn't an 8 bit P6 file with its full pixel data present
+static PpmHeader parsePpmHeader(std::span<const std::byte> bytes) {
+	size_t cursor = 0;
+	auto peek = [&]() { return cursor < bytes.size() ? static_cast<char>(bytes[cursor]) : '\0'; };
+	auto skipSpaceAndComments = [&]() {
+		while (cursor < bytes.size()) {
+			char c = peek();
+			if (c == '#') {
+				while (cursor < bytes.size() && peek() != '\n') cursor++;
+			} else if (c == ' ' || c == '\t' || c == '\r' || c == '\n') {
+				cursor++;
+			} else {
+				return;
+			}
+		}
+	};
+	auto readNumber = [&]() {
+		skipSpaceAndComments();
+		uint64_t value = 0;
+		size_t start = cursor;
+		while (peek() >= '0' && peek() <= '9' && value < (1u << 24)) {
+			value = value * 10 + static_cast<uint64_t>(peek() - '0');
+			cursor++;
+		}
+		if (cursor == start) {
+			throw std::runtime_error("malformed ppm header");
+		}
+		return value;
+	};
+
+	if (bytes.size() < 2 || peek() != 'P' || static_cast<char>(bytes[1]) != '6') {
+		throw std::runtime_error("only binary (P6) ppm textures are supported");
+	}
+	cursor = 2;
+	PpmHeader header;
+	header.width = static_cast<uint32_t>(readNumber());
+	header.height = static_cast<uint32_t>(readNumber());
+	if (readNumber() != 255) {
+		throw std::runtime_error("only 8 bit ppm textures are supported");
+	}
+	//exactly one whitespace byte separates the header from the pixels
+	header.dataOffset = cursor + 1;
+	if (header.width == 0 || header.height == 0 ||
+	    header.dataOffset + uint64_t(header.width) * header.height * 3 > bytes.size()) {
+		throw std::runtime_error("ppm texture is truncated");
+	}
+	return header;
+}
+
+struct TextureStreamStats {
+	uint64_t bytesUploaded = 0;
+	uint32_t texturesLoaded = 0;
+	uint32_t texturesFailed = 0;
+	std::vector<double> latencyMs;		//request() until the gpu finished the frame that made it resident
+	double streamingSeconds = 0.0;		//first request until the last texture went resident
+
+	void report(std::ostream& out) const {
+		double mbPerSecond = streamingSeconds > 0.0 ? static_cast<double>(bytesUploaded) / (1024.0 * 1024.0) / streamingSeconds : 0.0;
+		out << "[textures] loaded=" << texturesLoaded << " failed=" << texturesFailed << " bytes=" << bytesUploaded
+		    << " upload_mb_per_s=" << mbPerSecond
+		    << " latency_p50_ms=" << FrameTimings::percentile(latencyMs, 0.50)
+		    << " latency_max_ms=" << FrameTimings::percentile(latencyMs, 1.0) << "\n";
+	}
+};
+
+//Streams rgba8 textures from disk without ever blocking the frame:
+//
+//	worker thread	maps the file, parses it and expands the pixels straight into its own staging ring
+//	update()	render thread, once per frame, never waits: retires finished copies and submits everything decoded
+//			since the last call as one batch on the transfer queue, which signals a timeline value
+//	recordGraphicsWork()
+//			render thread, in the frame's command buffer: for batches the transfer timeline has passed, acquires
+//			ownership, blits the mip chain (blits need a graphics queue) and moves the image to shader read
+//
+//Statistics only count work the gpu has finished: bytes once the transfer timeline passes their batch, latency once
+//the frame timeline passes the frame that recorded the mips. collect() does that accounting, update() calls it.
+//
+//The frame submission has to wait on graphicsWaitValue() of the transfer timeline. By then the value has already been
+//reached so it costs nothing, but it is what orders the acquire after the release on the other queue.
+class TextureStreamer {
+public:
+	static constexpr vk::Format FORMAT = vk::Format::eR8G8B8A8Srgb;
+
+	TextureStreamer(const vk::raii::Device& device, GpuAllocator& allocator, const vk::raii::Queue& transferQueue,
+			uint32_t transferFamily, uint32_t graphicsFamily, vk::DeviceSize stagingSize)
+		: device(device), allocator(allocator), transferQueue(transferQueue),
+		  transferFamily(transferFamily), graphicsFamily(graphicsFamily),
+		  staging(allocator, device, stagingSize)
+	{
+		vk::SemaphoreTypeCreateInfo typeInfo{ .semaphoreType = vk::SemaphoreType::eTimeline, .initialValue = 0 };
+		transferTimeline = vk::raii::Semaphore(device, vk::SemaphoreCreateInfo{ .pNext = &typeInfo });
+		commandPool = vk::raii::CommandPool(device, vk::CommandPoolCreateInfo{
+			.flags = vk::CommandPoolCreateFlagBits::eTransient,
+			.queueFamilyIndex = transferFamily });
+		worker = std::thread([this] { workerLoop(); });
+	}
+
+	~TextureStreamer() {
+		{
+			std::lock_guard lock(mutex);
+			stopping = true;
+		}
+		wake.notify_all();
+		ringSpace.notify_all();
+		worker.join();
+	}
+
+	TextureStreamer(const TextureStreamer&) = delete;
+	TextureStreamer& operator=(const TextureStreamer&) = delete;
+
+	//Queues a load and returns the texture's id right away, poll isResident() to know when it can be sampled
+	uint32_t request(const std::string& path) {
+		auto id = static_cast<uint32_t>(textures.size());
+		Texture& texture = textures.emplace_back();
+		texture.path = path;
+		texture.requested = std::chrono::steady_clock::now();
+		if (!firstRequest) {
+			firstRequest = texture.requested;
+		}
+		{
+			std::lock_guard lock(mutex);
+			jobs.push_back({ id, path });
+		}
+		wake.notify_all();
+		return id;
+	}
+
+	//completedFrameValue is the frame timeline's counter, the timeline recordGraphicsWork()'s frameValue is on
+	void update(uint64_t completedFrameValue) {
+		collect(completedFrameValue);
+
+		std::vector<Decoded> batch;
+		{
+			std::unique_lock lock(mutex, std::try_to_lock);
+			if (!lock.owns_lock()) {
+				return;
+			}
+			for (uint32_t id : failed) {
+				textures[id].state = State::Failed;
+				stats.texturesFailed++;
+			}
+			failed.clear();
+			//a writer still filling a range tagged with nextBatchValue would miss this batch, so wait for the next frame
+			if (writersInProgress > 0 || decoded.empty()) {
+				return;
+			}
+			batch.swap(decoded);
+			nextBatchValue++;
+		}
+		submitBatch(batch, nextBatchValue - 1);
+	}
+
+	//Retires finished copies and accounts whatever the gpu has finished since the last call. Never waits, also used
+	//once the device is idle so the last textures make it into the statistics.
+	void collect(uint64_t completedFrameValue) {
+		uint64_t completed = transferTimeline.getCounterValue();
+		staging.retire(completed);
+		std::erase_if(batches, [&](const Batch& batch) {
+			if (batch.value > completed) {
+				return false;
+			}
+			stats.bytesUploaded += batch.bytes;
+			return true;
+		});
+		ringSpace.notify_all();
+
+		auto now = std::chrono::steady_clock::now();
+		while (!residentFrames.empty() && residentFrames.front().frameValue <= completedFrameValue) {
+			stats.texturesLoaded++;
+			stats.latencyMs.push_back(std::chrono::duration<double, std::milli>(now - residentFrames.front().requested).count());
+			stats.streamingSeconds = std::chrono::duration<double>(now - *firstRequest).count();
+			residentFrames.pop_front();
+		}
+	}
+
+	//Outside of any rendering block, in the command buffer whose submission signals frameValue on the frame timeline
+	void recordGraphicsWork(const vk::raii::CommandBuffer& commandBuffer, uint64_t frameValue) {
+		uint64_t completed = transferTimeline.getCounterValue();
+		for (Texture& texture : textures) {
+			if (texture.state != State::Transferring || texture.batchValue > completed) {
+				continue;
+			}
+			recordMipChain(commandBuffer, texture);
+			texture.state = State::Resident;
+			waitValue = std::max(waitValue, texture.batchValue);
+			residentFrames.push_back({ frameValue, texture.requested });
+		}
+	}
+
+	[[nodiscard]] const vk::raii::Semaphore& timeline() const { return transferTimeline; }
+	[[nodiscard]] uint64_t graphicsWaitValue() const { return waitValue; }
+	[[nodiscard]] bool isResident(uint32_t id) const { return id < textures.size() && textures[id].state == State::Resident; }
+	[[nodiscard]] vk::ImageView view(uint32_t id) const { return *textures[id].view; }
+	[[nodiscard]] size_t textureCount() const { return textures.size(); }
+	[[nodiscard]] const TextureStreamStats& statistics() const { return stats; }
+
+private:
+	enum class State { Loading, Transferring, Resident, Failed };
+
+	struct Texture {
+		std::string path;
+		State state = State::Loading;
+		GpuImage image;
+		vk::raii::ImageView view = nullptr;
+		uint32_t width = 0, height = 0, mipLevels = 1;
+		uint64_t batchValue = 0;
+		std::chrono::steady_clock::time_point requested;
+	};
+
+	struct Job {
+		uint32_t id;
+		std::string path;
+	};
+
+	struct Decoded {
+		uint32_t id;
+		uint32_t width, height;
+		StagingRing::Span span;
+	};
+
+	struct Batch {
+		vk::raii::CommandBuffer commandBuffer = nullptr;
+		uint64_t value = 0;
+		uint64_t bytes = 0;
+	};
+
+	struct ResidentFrame {
+		uint64_t frameValue;		//frame timeline value of the frame that recorded the mips
+		std::chrono::steady_clock::time_point requested;
+	};
+
+	const vk::raii::Device& device;
+	GpuAllocator& allocator;
+	const vk::raii::Queue& transferQueue;
+	uint32_t transferFamily;
+	uint32_t graphicsFamily;
+
+	//render thread only
+	std::deque<Texture> textures;		//deque so references stay put as textures are added
+	vk::raii::CommandPool commandPool = nullptr;
+	std::vector<Batch> batches;		//after the pool so their command buffers are freed first
+	vk::raii::Semaphore transferTimeline = nullptr;
+	uint64_t waitValue = 0;
+	std::deque<ResidentFrame> residentFrames;	//in frame order, accounted by collect()
+	std::optional<std::chrono::steady_clock::time_point> firstRequest;
+	TextureStreamStats stats;
+
+	//shared with the worker
+	StagingRing staging;
+	std::mutex mutex;
+	std::condition_variable wake;		//new jobs or stopping
+	std::condition_variable ringSpace;	//update() retired staging ranges
+	std::deque<Job> jobs;
+	std::vector<Decoded> decoded;
+	std::vector<uint32_t> failed;
+	uint32_t writersInProgress = 0;
+	uint64_t nextBatchValue = 1;		//staging ranges are tagged with the batch (timeline value) that will copy them
+	bool stopping = false;
+	std::thread worker;			//last, so it starts after everything above exists
+
+	void workerLoop() {
+		while (true) {
+			Job job;
+			{
+				std::unique_lock lock(mutex);
+				wake.wait(lock, [this] { return stopping || !jobs.empty(); });
+				if (stopping) {
+					return;
+				}
+				job = std::move(jobs.front());
+				jobs.pop_front();
+			}
+			try {
+				decode(job);
+			} catch (const std::exception& e) {
+				std::cerr << "[textures] " << job.path << ": " << e.what() << "\n";
+				std::lock_guard lock(mutex);
+				failed.push_back(job.id);
+			}
+		}
+	}
+
+	void decode(const Job& job) {
+		MappedFile file(job.path);
+		PpmHeader header = parsePpmHeader(file.bytes());
+		vk::DeviceSize size = vk::DeviceSize(header.width) * header.height * 4;
+		if (size > staging.capacity()) {
+			throw std::runtime_error("texture is larger than the streaming staging ring");
+		}
+
+		std::optional<StagingRing::Span> span;
+		{
+			std::unique_lock lock(mutex);
+			//the ring only frees up as update() retires batches, which happens every frame
+			ringSpace.wait(lock, [&] {
+				span = stopping ? std::nullopt : staging.allocate(size, 16, nextBatchValue);
+				return stopping || span.has_value();
+			});
+			if (stopping) {
+				return;
+			}
+			writersInProgress++;
+		}
+
+		//rgb -> rgba straight from the page cache into the mapped staging memory, the only copy of the pixels
+		const auto* source = reinterpret_cast<const uint8_t*>(file.bytes().data() + header.dataOffset);
+		auto* destination = static_cast<uint8_t*>(span->data);
+		for (size_t pixel = 0; pixel < size_t(header.width) * header.height; pixel++) {
+			destination[pixel * 4 + 0] = source[pixel * 3 + 0];
+			destination[pixel * 4 + 1] = source[pixel * 3 + 1];
+			destination[pixel * 4 + 2] = source[pixel * 3 + 2];
+			destination[pixel * 4 + 3] = 255;
+		}
+
+		std::lock_guard lock(mutex);
+		decoded.push_back({ job.id, header.width, header.height, *span });
+		writersInProgress--;
+	}
+
+	void submitBatch(const std::vector<Decoded>& items, uint64_t value) {
+		vk::CommandBufferAllocateInfo allocInfo{
+			.commandPool = commandPool,
+			.level = vk::CommandBufferLevel::ePrimary,
+			.commandBufferCount = 1 };
+		Batch& batch = batches.emplace_back();
+		batch.commandBuffer = std::move(vk::raii::CommandBuffers(device, allocInfo).front());
+		batch.value = value;
+		const vk::raii::CommandBuffer& commandBuffer = batch.commandBuffer;
+		commandBuffer.begin(vk::CommandBufferBeginInfo{ .flags = vk::CommandBufferUsageFlagBits::eOneTimeSubmit });
+
+		for (const Decoded& item : items) {
+			Texture& texture = textures[item.id];
+			texture.width = item.width;
+			texture.height = item.height;
+			texture.mipLevels = std::bit_width(std::max(item.width, item.height));
+			texture.image = GpuImage(allocator, device, vk::ImageCreateInfo{
+				.imageType = vk::ImageType::e2D,
+				.format = FORMAT,
+				.extent = { item.width, item.height, 1 },
+				.mipLevels = texture.mipLevels,
+				.arrayLayers = 1,
+				.samples = vk::SampleCountFlagBits::e1,
+				.tiling = vk::ImageTiling::eOptimal,
+				.usage = vk::ImageUsageFlagBits::eTransferDst | vk::ImageUsageFlagBits::eTransferSrc | vk::ImageUsageFlagBits::eSampled,
+				.sharingMode = vk::SharingMode::eExclusive,
+				.initialLayout = vk::ImageLayout::eUndefined }, vk::MemoryPropertyFlagBits::eDeviceLocal);
+			texture.view = vk::raii::ImageView(device, vk::ImageViewCreateInfo{
+				.image = texture.image.handle(),
+				.viewType = vk::ImageViewType::e2D,
+				.format = FORMAT,
+				.subresourceRange = { vk::ImageAspectFlagBits::eColor, 0, texture.mipLevels, 0, 1 } });
+
+			imageBarrier(commandBuffer, texture, 0, texture.mipLevels,
+				vk::PipelineStageFlagBits2::eNone, vk::AccessFlagBits2::eNone, vk::ImageLayout::eUndefined,
+				vk::PipelineStageFlagBits2::eTransfer, vk::AccessFlagBits2::eTransferWrite, vk::ImageLayout::eTransferDstOptimal);
+			commandBuffer.copyBufferToImage(item.span.buffer, texture.image.handle(), vk::ImageLayout::eTransferDstOptimal,
+				vk::BufferImageCopy{
+					.bufferOffset = item.span.offset,
+					.imageSubresource = { vk::ImageAspectFlagBits::eColor, 0, 0, 1 },
+					.imageExtent = { item.width, item.height, 1 } });
+			if (transferFamily != graphicsFamily) {
+				//release half of the ownership transfer, dst stage/access are ignored
+				imageBarrier(commandBuffer, texture, 0, texture.mipLevels,
+					vk::PipelineStageFlagBits2::eTransfer, vk::AccessFlagBits2::eTransferWrite, vk::ImageLayout::eTransferDstOptimal,
+					vk::PipelineStageFlagBits2::eNone, vk::AccessFlagBits2::eNone, vk::ImageLayout::eTransferDstOptimal,
+					transferFamily, graphicsFamily);
+			}
+			texture.state = State::Transferring;
+			texture.batchValue = value;
+			batch.bytes += vk::DeviceSize(item.width) * item.height * 4;
+		}
+		commandBuffer.end();
+
+		vk::CommandBufferSubmitInfo commandBufferInfo{ .commandBuffer = commandBuffer };
+		vk::SemaphoreSubmitInfo signalInfo{
+			.semaphore = transferTimeline,
+			.value = value,
+			.stageMask = vk::PipelineStageFlagBits2::eAllCommands };
+		transferQueue.submit2(vk::SubmitInfo2{
+			.commandBufferInfoCount = 1,
+			.pCommandBufferInfos = &commandBufferInfo,
+			.signalSemaphoreInfoCount = 1,
+			.pSignalSemaphoreInfos = &signalInfo });
+	}
+
+	void recordMipChain(const vk::raii::CommandBuffer& commandBuffer, const Texture& texture) {
+		if (transferFamily != graphicsFamily) {
+			//acquire half, src stage/access are ignored
+			imageBarrier(commandBuffer, texture, 0, texture.mipLevels,
+				vk::PipelineStageFlagBits2::eNone, vk::AccessFlagBits2::eNone, vk::ImageLayout::eTransferDstOptimal,
+				vk::PipelineStageFlagBits2::eBlit, vk::AccessFlagBits2::eTransferRead | vk::AccessFlagBits2::eTransferWrite,
+				vk::ImageLayout::eTransferDstOptimal, transferFamily, graphicsFamily);
+		}
+
+		int32_t width = static_cast<int32_t>(texture.width);
+		int32_t height = static_cast<int32_t>(texture.height);
+		for (uint32_t level = 1; level < texture.mipLevels; level++) {
+			imageBarrier(commandBuffer, texture, level - 1, 1,
+				vk::PipelineStageFlagBits2::eAllTransfer, vk::AccessFlagBits2::eTransferWrite, vk::ImageLayout::eTransferDstOptimal,
+				vk::PipelineStageFlagBits2::eBlit, vk::AccessFlagBits2::eTransferRead, vk::ImageLayout::eTransferSrcOptimal);
+			int32_t nextWidth = std::max(width / 2, 1);
+			int32_t nextHeight = std::max(height / 2, 1);
+			vk::ImageBlit2 region{
+				.srcSubresource = { vk::ImageAspectFlagBits::eColor, level - 1, 0, 1 },
+				.srcOffsets = std::array{ vk::Offset3D{ 0, 0, 0 }, vk::Offset3D{ width, height, 1 } },
+				.dstSubresource = { vk::ImageAspectFlagBits::eColor, level, 0, 1 },
+				.dstOffsets = std::array{ vk::Offset3D{ 0, 0, 0 }, vk::Offset3D{ nextWidth, nextHeight, 1 } } };
+			commandBuffer.blitImage2(vk::BlitImageInfo2{
+				.srcImage = texture.image.handle(),
+				.srcImageLayout = vk::ImageLayout::eTransferSrcOptimal,
+				.dstImage = texture.image.handle(),
+				.dstImageLayout = vk::ImageLayout::eTransferDstOptimal,
+				.regionCount = 1,
+				.pRegions = &region,
+				.filter = vk::Filter::eLinear });
+			width = nextWidth;
+			height = nextHeight;
+		}
+
+		//every level but the last is in transfer src now, the last one is still transfer dst
+		if (texture.mipLevels > 1) {
+			imageBarrier(commandBuffer, texture, 0, texture.mipLevels - 1,
+				vk::PipelineStageFlagBits2::eBlit, vk::AccessFlagBits2::eTransferRead, vk::ImageLayout::eTransferSrcOptimal,
+				vk::PipelineStageFlagBits2::eFragmentShader, vk::AccessFlagBits2::eShaderSampledRead, vk::ImageLayout::eShaderReadOnlyOptimal);
+		}
+		imageBarrier(commandBuffer, texture, texture.mipLevels - 1, 1,
+			vk::PipelineStageFlagBits2::eAllTransfer, vk::AccessFlagBits2::eTransferWrite, vk::ImageLayout::eTransferDstOptimal,
+			vk::PipelineStageFlagBits2::eFragmentShader, vk::AccessFlagBits2::eShaderSampledRead, vk::ImageLayout::eShaderReadOnlyOptimal);
+	}
+
+	static void imageBarrier(const vk::raii::CommandBuffer& commandBuffer, const Texture& texture, uint32_t baseLevel, uint32_t levelCount,
+			vk::PipelineStageFlags2 srcStage, vk::AccessFlags2 srcAccess, vk::ImageLayout oldLayout,
+			vk::PipelineStageFlags2 dstStage, vk::AccessFlags2 dstAccess, vk::ImageLayout newLayout,
+			uint32_t srcFamily = vk::QueueFamilyIgnored, uint32_t dstFamily = vk::QueueFamilyIgnored)
+	{
+		vk::ImageMemoryBarrier2 barrier{
+			.srcStageMask = srcStage,
+			.srcAccessMask = srcAccess,
+			.dstStageMask = dstStage,
+			.dstAccessMask = dstAccess,
+			.oldLayout = oldLayout,
+			.newLayout = newLayout,
+			.srcQueueFamilyIndex = srcFamily,
+			.dstQueueFamilyIndex = dstFamily,
+			.image = texture.image.handle(),
+			.subresourceRange = { vk::ImageAspectFlagBits::eColor, baseLevel, levelCount, 0, 1 } };
+		commandBuffer.pipelineBarrier2(vk::DependencyInfo{ .imageMemoryBarrierCount = 1, .pImageMemoryBarriers = &barrier });
+	}
+};
@@ -0,0 +1,109 @@
+#pragma once
+
+#include <vulkan/vulkan_raii.hpp>
+#include <glm/glm.hpp>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <type_traits>
+
+#include "GpuAllocator.hpp"
+
+//Matches FrameUniforms in shaders/shader.slang (ConstantBuffer, std140)
+struct FrameUniforms {
+	glm::mat4 viewProj;
+	float time;			//seconds since startup
+	float padding[3];
+};
+static_assert(sizeof(FrameUniforms) == 80, "FrameUniforms has to match the std140 layout in shader.slang");
+
+//Matches DrawConstants in shaders/shader.slang, pushed before every draw
+struct DrawConstants {
+	float spin;			//radians per second added to every instance's rotation in the draw
+};
+
+//Per frame uniform data without per frame allocations or map/unmap: one persistently mapped, host coherent buffer
+//carved up by a RingAllocator whose tags are frame timeline values. Each push() copies a struct into the slice of
+//the frame that signals the tag and returns the dynamic offset to bind it with, retire() hands slices back once
+//the timeline has passed them. Frames in flight each get their own slice, so nothing is overwritten while read.
+//
+//The descriptor set has a single dynamic uniform buffer binding covering `range` bytes. It can't live in the
+//bindless set, update-after-bind layouts don't allow dynamic buffers.
+class UniformRing {
+public:
+	UniformRing(const vk::raii::Device& device, GpuAllocator& allocator, vk::DeviceSize capacity, vk::DeviceSize alignment,
+			uint32_t range, vk::ShaderStageFlags stages)
+		: alignment(alignment), range(range),
+		  buffer(allocator, device, capacity, vk::BufferUsageFlagBits::eUniformBuffer,
+			 vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent,
+			 vk::MemoryPropertyFlagBits::eDeviceLocal),
+		  ring(capacity)
+	{
+		vk::DescriptorSetLayoutBinding binding{
+			.binding = 0,
+			.descriptorType = vk::DescriptorType::eUniformBufferDynamic,
+			.descriptorCount = 1,
+			.stageFlags = stages };
+		descriptorSetLayout = vk::raii::DescriptorSetLayout(device, vk::DescriptorSetLayoutCreateInfo{
+			.bindingCount = 1,
+			.pBindings = &binding });
+
+		vk::DescriptorPoolSize poolSize{ .type = vk::DescriptorType::eUniformBufferDynamic, .descriptorCount = 1 };
+		descriptorPool = vk::raii::DescriptorPool(device, vk::DescriptorPoolCreateInfo{
+			.flags = vk::DescriptorPoolCreateFlagBits::eFreeDescriptorSet,
+			.maxSets = 1,
+			.poolSizeCount = 1,
+			.pPoolSizes = &poolSize });
+		descriptorSet = std::move(vk::raii::DescriptorSets(device, vk::DescriptorSetAllocateInfo{
+			.descriptorPool = descriptorPool,
+			.descriptorSetCount = 1,
+			.pSetLayouts = &*descriptorSetLayout }).front());
+
+		vk::DescriptorBufferInfo bufferInfo{ .buffer = buffer.handle(), .offset = 0, .range = range };
+		device.updateDescriptorSets(vk::WriteDescriptorSet{
+			.dstSet = descriptorSet,
+			.dstBinding = 0,
+			.descriptorCount = 1,
+			.descriptorType = vk::DescriptorType::eUniformBufferDynamic,
+			.pBufferInfo = &bufferInfo }, {});
+	}
+
+	UniformRing(const UniformRing&) = delete;
+	UniformRing& operator=(const UniformRing&) = delete;
+
+	//Copies data into the frame's slice, tag is the timeline value that frame signals. Always takes a whole `range`
+	//so the binding never reads past the slice.
+	template <typename T>
+	uint32_t push(const T& data, uint64_t tag) {
+		static_assert(std::is_trivially_copyable_v<T>, "uniform data is copied with memcpy");
+		if (sizeof(T) > range) {
+			throw std::runtime_error("uniform data is larger than the ring's binding range");
+		}
+		auto offset = ring.allocate(range, alignment, tag);
+		if (!offset) {
+			throw std::runtime_error("uniform ring is full, the frames in flight need more than its capacity");
+		}
+		std::memcpy(static_cast<char*>(buffer.mapped()) + *offset, &data, sizeof(T));
+		return static_cast<uint32_t>(*offset);
+	}
+
+	void retire(uint64_t completedTag) { ring.retire(completedTag); }
+
+	void bind(const vk::raii::CommandBuffer& commandBuffer, vk::PipelineBindPoint bindPoint, vk::PipelineLayout pipelineLayout,
+			uint32_t set, uint32_t offset) const
+	{
+		commandBuffer.bindDescriptorSets(bindPoint, pipelineLayout, set, *descriptorSet, offset);
+	}
+
+	[[nodiscard]] vk::DescriptorSetLayout layout() const { return *descriptorSetLayout; }
+
+private:
+	vk::DeviceSize alignment;
+	uint32_t range;
+	GpuBuffer buffer;
+	RingAllocator ring;
+
+	vk::raii::DescriptorSetLayout descriptorSetLayout = nullptr;
+	vk::raii::DescriptorPool descriptorPool = nullptr;
+	vk::raii::DescriptorSet descriptorSet = nullptr;
+};
@@ -0,0 +1,43 @@
+#include <filesystem>
+#include <iostream>
+
+#include "AssetIO.hpp"
+#include "MeshCooker.hpp"
+
+//Cooks .obj meshes into .mesh files (see CookedMesh.hpp) in the output directory, named after the source
+//(models/bunny.obj -> <output dir>/bunny.mesh). They can go through assetpack like any other asset.
+int main(int argc, char** argv) {
+	if (argc < 3) {
+		std::cerr << "Usage: " << argv[0] << " <output dir> <mesh.obj>...\n";
+		return EXIT_FAILURE;
+	}
+
+	try {
+		std::filesystem::path outputDir(argv[1]);
+		std::filesystem::create_directories(outputDir);
+		for (int i = 2; i < argc; i++) {
+			std::filesystem::path source(argv[i]);
+			if (source.extension() != ".obj") {
+				throw std::runtime_error(source.string() + ": only .obj meshes can be imported");
+			}
+			MappedFile file(source.string());
+			auto bytes = file.bytes();
+			ImportedMesh mesh = MeshCooker::importObj({ reinterpret_cast<const char*>(bytes.data()), bytes.size() });
+
+			std::string outputPath = (outputDir / source.filename().replace_extension(".mesh")).string();
+			CookStats stats = MeshCooker::cook(mesh, outputPath);
+
+			//read it back the way the runtime will, so a broken file fails here and not at load time
+			MappedFile cooked(outputPath);
+			CookedMesh check(cooked.bytes());
+			if (check.info().vertexCount != stats.vertices || check.meshlets().size() != stats.meshlets) {
+				throw std::runtime_error(outputPath + " does not read back what was cooked");
+			}
+			stats.report(std::cout, source.filename().string());
+		}
+	} catch (const std::exception& e) {
+		std::cerr << e.what() << std::endl;
+		return EXIT_FAILURE;
+	}
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,27 @@
+#include <filesystem>
+#include <iostream>
+
+#include "AssetIO.hpp"
+
+//Packs loose files into an asset archive, each asset is named after its file name (shaders/slang.spv -> slang.spv)
+int main(int argc, char** argv) {
+	if (argc < 3) {
+		std::cerr << "Usage: " << argv[0] << " <output.pak> <file>...\n";
+		return EXIT_FAILURE;
+	}
+
+	try {
+		std::vector<std::pair<std::string, std::string>> assets;
+		for (int i = 2; i < argc; i++) {
+			assets.emplace_back(std::filesystem::path(argv[i]).filename().string(), argv[i]);
+		}
+		AssetArchive::write(argv[1], assets);
+
+		AssetArchive archive(argv[1]);
+		std::cout << "[assetpack] " << argv[1] << " assets=" << archive.assetCount() << " bytes=" << archive.mapping()->size() << "\n";
+	} catch (const std::exception& e) {
+		std::cerr << e.what() << std::endl;
+		return EXIT_FAILURE;
+	}
+	return EXIT_SUCCESS;
+}
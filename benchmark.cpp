@@ -0,0 +1,30 @@
+#include "HelloTriangle.hpp"
+
+//Renders a fixed number of frames and prints throughput numbers, headless by default so it runs on
+//boxes with no display or gpu (e.g. VK_ICD_FILENAMES pointing at lavapipe)
+int main(int argc, char** argv) {
+	try {
+		AppConfig config;
+		config.headless = true;
+		config.benchmarkFrames = 1000;
+		config.warmupFrames = 50;
+		if (!parseArgs(argc, argv, config)) {
+			return EXIT_SUCCESS;
+		}
+
+		HelloTriangleApplication app(config);
+		if (config.sweepInstances) {
+			const std::vector<uint32_t> counts = { 1, 10, 100, 1000, 10000, 100000, 1000000 };
+			for (const auto& [count, timings] : app.runInstanceSweep(counts)) {
+				timings.reportThroughput(std::cout, count, app.trianglesPerInstance());
+			}
+		} else {
+			FrameTimings timings = app.runBenchmark();
+			timings.report(std::cout, config.headless ? "headless" : "windowed");
+		}
+	} catch (const std::exception& e) {
+		std::cerr << e.what() << std::endl;
+		return EXIT_FAILURE;
+	}
+	return EXIT_SUCCESS;
+}
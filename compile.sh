@@ -1 +1,2 @@
 /home/jermiah/vulkansdk/1.4.313.0/x86_64/bin/slangc shaders/shader.slang -target spirv -profile spirv_1_4 -emit-spirv-directly -fvk-use-entrypoint-name -entry vertMain -entry fragMain -o shaders/slang.spv
+/home/jermiah/vulkansdk/1.4.313.0/x86_64/bin/slangc shaders/cull.slang -target spirv -profile spirv_1_4 -emit-spirv-directly -fvk-use-entrypoint-name -entry cullMain -entry scanMain -entry compactMain -o shaders/cull.spv
@@ -1,9 +1,13 @@
 #include "HelloTriangle.hpp"
 
-int main() {
-	HelloTriangleApplication app;
-
+int main(int argc, char** argv) {
 	try {
+		AppConfig config;
+		if (!parseArgs(argc, argv, config)) {
+			return EXIT_SUCCESS;
+		}
+
+		HelloTriangleApplication app(config);
 		app.run();
 	} catch (const std::exception& e) {
 		std::cerr << e.what() << std::endl;
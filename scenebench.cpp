@@ -0,0 +1,75 @@
+#include <chrono>
+#include <cmath>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "Scene.hpp"
+
+//Microbenchmark for SceneStore::update(): builds a hierarchy with a fixed fan out (so most objects are several levels
+//deep) and times full updates single threaded and on every core, with and without SIMD.
+static void buildTree(SceneStore& scene, uint32_t objects, uint32_t fanOut) {
+	for (uint32_t id = 0; id < objects; id++) {
+		uint32_t hash = id * 2654435761u;
+		SceneObjectDesc desc{
+			.parent = id == 0 ? SCENE_NO_PARENT : (id - 1) / fanOut,
+			.offset = { static_cast<float>(hash & 0xff) / 255.0f - 0.5f, static_cast<float>((hash >> 8) & 0xff) / 255.0f - 0.5f },
+			.rotation = static_cast<float>((hash >> 16) & 0xff) * 0.01f,
+			.scale = 0.9f,
+			.color = { 1.0f, 1.0f, 1.0f, 1.0f },
+			.materialId = id % 16 };
+		scene.add(desc);
+	}
+}
+
+int main(int argc, char** argv) {
+	try {
+		uint32_t objects = argc > 1 ? static_cast<uint32_t>(std::stoul(argv[1])) : 1'000'000;
+		uint32_t iterations = argc > 2 ? static_cast<uint32_t>(std::stoul(argv[2])) : 100;
+		if (objects == 0 || iterations == 0) {
+			std::cerr << "Usage: " << argv[0] << " [objects] [iterations]\n";
+			return EXIT_FAILURE;
+		}
+
+		SceneStore scene;
+		buildTree(scene, objects, 8);
+		std::vector<PackedInstance> out(objects);
+		FrameArena arena;
+		JobSystem jobs(0);
+
+		auto run = [&](const char* simd, bool scalar, JobSystem* threads) {
+			scene.forceScalar(scalar);
+			//first update also sorts the slots into levels, keep it out of the timing
+			arena.reset();
+			scene.update(threads, arena, out.data(), 0.5f);
+			auto start = std::chrono::steady_clock::now();
+			for (uint32_t i = 0; i < iterations; i++) {
+				arena.reset();
+				//animate the root so every frame really is different
+				scene.setLocalRotation(0, static_cast<float>(i) * 0.01f);
+				scene.update(threads, arena, out.data(), 0.5f);
+			}
+			double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+			double perObject = ns / (static_cast<double>(iterations) * objects);
+			std::cout << std::fixed << std::setprecision(3)
+				  << "[scene-bench] objects=" << objects
+				  << " levels=" << scene.levelCount()
+				  << " threads=" << (threads ? threads->workerCount() : 1)
+				  << " simd=" << simd
+				  << " ns_per_object=" << perObject
+				  << " mobjects_per_s=" << 1e3 / perObject << "\n";
+		};
+
+		run("scalar", true, nullptr);
+		run("scalar", true, &jobs);
+		if (SceneStore::simdAvailable()) {
+			run("avx2", false, nullptr);
+			run("avx2", false, &jobs);
+		}
+	} catch (const std::exception& e) {
+		std::cerr << e.what() << std::endl;
+		return EXIT_FAILURE;
+	}
+	return EXIT_SUCCESS;
+}